@@ -33,17 +33,15 @@
 static bool
 bloom_src(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip != NULL)
 	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
 		uint32_t fold, mask, addr;
 		char *mem;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
         	fold = get_arg0(uint32_t, args);
 		mem  = get_arg1(char *, args);
         	mask = get_arg2(uint32_t, args);
@@ -64,17 +62,15 @@ bloom_src(arguments_t args, SkBuff b)
 static bool
 bloom_dst(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip != NULL)
 	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
 		uint32_t fold, mask, addr;
 		char *mem;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
         	fold = get_arg0(uint32_t, args);
 		mem  = get_arg1(char *, args);
         	mask = get_arg2(uint32_t, args);
@@ -94,17 +90,15 @@ bloom_dst(arguments_t args, SkBuff b)
 static bool
 bloom(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip != NULL)
 	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
 		uint32_t fold, mask, addr;
 		char *mem;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
         	fold = get_arg0(uint32_t, args);
 		mem  = get_arg1(char *, args);
         	mask = get_arg2(uint32_t, args);
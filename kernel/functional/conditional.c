@@ -21,14 +21,178 @@
  *
  ****************************************************************/
 
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+
 #include "conditional.h"
 
+
+/*
+ * switch: dispatch on the value of a property in O(1).
+ *
+ * The i-th key of the vector selects the first function of the i-th case of
+ * the chain; the tail of the chain is the default. At init time the chain is
+ * turned into a direct-indexed table (small keys) or an open-addressing hash.
+ */
+
+#define Q_SWITCH_DIRECT_MAX	4096
+
+struct switch_entry
+{
+	uint64_t	key;
+	function_t	fun;
+};
+
+struct switch_table
+{
+	function_t	fallback;
+	size_t		size;
+	int		bits;		/* hashed table only, 0 when direct */
+	struct switch_entry entry[];
+};
+
+
+static inline function_t const *
+switch_lookup(struct switch_table const *tab, uint64_t key)
+{
+	size_t n, i;
+
+	if (tab->bits == 0)
+		return key < tab->size && tab->entry[key].fun.fun ? &tab->entry[key].fun : NULL;
+
+	for(n = 0, i = hash_64(key, tab->bits); n < tab->size; n++, i = (i + 1) & (tab->size - 1))
+	{
+		if (tab->entry[i].fun.fun == NULL)
+			return NULL;
+		if (tab->entry[i].key == key)
+			return &tab->entry[i].fun;
+	}
+
+	return NULL;
+}
+
+
+static Action_SkBuff
+switch_on(arguments_t args, SkBuff b)
+{
+	property_t prop = get_arg0(property_t, args);
+	struct switch_table const *tab = get_arg1(struct switch_table *, args);
+	uint64_t ret = EVAL_PROPERTY(prop, b);
+
+	if (IS_JUST(ret)) {
+		function_t const *fun = switch_lookup(tab, FROM_JUST(ret));
+		if (fun)
+			return EVAL_FUNCTION((*fun), b);
+	}
+
+	return EVAL_FUNCTION(tab->fallback, b);
+}
+
+
+/* a case evaluated outside a switch runs its own function */
+
+static Action_SkBuff
+switch_case(arguments_t args, SkBuff b)
+{
+	function_t fun_ = get_arg0(function_t, args);
+
+	return EVAL_FUNCTION(fun_, b);
+}
+
+
+static int switch_init(arguments_t args)
+{
+	uint64_t *keys = get_array1(uint64_t, args);
+	size_t i, n = get_len_array1(args);
+	struct pfq_functional *cs = get_arg2(struct pfq_functional *, args);
+	struct switch_table *tab;
+	uint64_t max = 0;
+	size_t size;
+	int bits = 0;
+
+	for(i = 0; i < n; i++)
+		max = keys[i] > max ? keys[i] : max;
+
+	if (n && max < Q_SWITCH_DIRECT_MAX)
+		size = max + 1;
+	else {
+		size = roundup_pow_of_two(max_t(size_t, n * 2, 2));
+		bits = ilog2(size);
+	}
+
+	tab = kzalloc(sizeof(struct switch_table) + size * sizeof(struct switch_entry), GFP_KERNEL);
+	if (!tab) {
+		printk(KERN_INFO "[PFQ|init] switch: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	tab->size = size;
+	tab->bits = bits;
+
+	for(i = 0; i < n; i++)
+	{
+		struct switch_entry *e;
+		size_t j;
+
+		if (cs->ptr != switch_case) {
+			printk(KERN_INFO "[PFQ|init] switch: %zu keys but %zu cases!\n", n, i);
+			kfree(tab);
+			return -EPERM;
+		}
+
+		/* the first case of duplicate keys wins, as in a chain of when */
+
+		if (bits == 0)
+			e = &tab->entry[keys[i]];
+		else
+			for(j = hash_64(keys[i], bits), e = &tab->entry[j];
+			    e->fun.fun && e->key != keys[i];
+			    j = (j + 1) & (size - 1), e = &tab->entry[j]);
+
+		if (e->fun.fun == NULL) {
+			e->key = keys[i];
+			e->fun.fun = (struct pfq_functional *)cs->arg[0].value;
+		}
+
+		cs = (struct pfq_functional *)cs->arg[1].value;
+	}
+
+	if (cs->ptr == switch_case) {
+		printk(KERN_INFO "[PFQ|init] switch: %zu keys but more cases!\n", n);
+		kfree(tab);
+		return -EPERM;
+	}
+
+	tab->fallback.fun = cs;
+
+	set_arg1(args, tab);
+
+	pr_devel("[PFQ|init] switch: %zu cases, %s table of %zu entries.\n", n, bits ? "hashed" : "direct", size);
+	return 0;
+}
+
+
+static int switch_fini(arguments_t args)
+{
+	struct switch_table *tab = get_arg1(struct switch_table *, args);
+
+	kfree(tab);
+
+	pr_devel("[PFQ|fini] switch: table freed@%p!\n", tab);
+	return 0;
+}
+
+
 struct pfq_function_descr high_order_functions[] = {
 
         { "conditional", "(SkBuff -> Bool) -> (SkBuff -> Action SkBuff) -> (SkBuff -> Action SkBuff) -> SkBuff -> Action SkBuff ",  conditional  },
         { "when",        "(SkBuff -> Bool) -> (SkBuff -> Action SkBuff) -> SkBuff -> Action SkBuff", 				    when         },
         { "unless",      "(SkBuff -> Bool) -> (SkBuff -> Action SkBuff) -> SkBuff -> Action SkBuff", 				    unless       },
 
+        { "switch",      "(SkBuff -> Word64) -> [Word64] -> (SkBuff -> Action SkBuff) -> SkBuff -> Action SkBuff", switch_on, switch_init, switch_fini },
+        { "case",        "(SkBuff -> Action SkBuff) -> (SkBuff -> Action SkBuff) -> SkBuff -> Action SkBuff", 			    switch_case  },
+
         { NULL }};
 
 
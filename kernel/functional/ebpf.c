@@ -0,0 +1,123 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/filter.h>
+
+#include <pf_q-module.h>
+#include <pf_q-bpf.h>
+
+
+/*
+ * eBPF socket filter programs, loaded by user space with bpf(BPF_PROG_LOAD)
+ * and passed by fd. The init function takes a reference to the program,
+ * which runs JIT compiled (net.core.bpf_jit_enable) on the packet.
+ *
+ * The return value of the program, for ebpf_action:
+ *
+ * 	0 			drop
+ * 	Q_EBPF_STEER | hash 	steer by the (31 bits) hash
+ * 	Q_EBPF_MARK  | value 	mark the packet with the (30 bits) value, and pass
+ * 	any other value 	pass
+ */
+
+
+static inline unsigned int
+ebpf_run(arguments_t args, SkBuff b)
+{
+	struct sk_filter *prog = get_arg0(struct sk_filter *, args);
+
+	return pfq_sk_filter_run(prog, b.skb);
+}
+
+
+static bool
+ebpf(arguments_t args, SkBuff b)
+{
+	return ebpf_run(args, b) != 0;
+}
+
+
+static uint64_t
+ebpf_value(arguments_t args, SkBuff b)
+{
+	return JUST(ebpf_run(args, b) & ~(1U << 31));
+}
+
+
+static Action_SkBuff
+ebpf_action(arguments_t args, SkBuff b)
+{
+	unsigned int ret = ebpf_run(args, b);
+
+	if (ret == 0)
+		return Drop(b);
+
+	if (ret & Q_EBPF_STEER)
+		return Steering(b, ret & ~Q_EBPF_STEER);
+
+	if (ret & Q_EBPF_MARK)
+		set_mark(b, ret & ~Q_EBPF_MARK);
+
+	return Pass(b);
+}
+
+
+static int ebpf_init(arguments_t args)
+{
+	int fd = get_arg0(int, args);
+	struct sk_filter *prog;
+
+	prog = pfq_alloc_sk_filter_fd(fd);
+	if (prog == NULL) {
+		printk(KERN_INFO "[PFQ|init] ebpf: fd=%d is not a socket filter program!\n", fd);
+		return -EINVAL;
+	}
+
+	set_arg0(args, prog);
+
+	pr_devel("[PFQ|init] ebpf: program@%p (fd=%d)\n", prog, fd);
+	return 0;
+}
+
+
+static int ebpf_fini(arguments_t args)
+{
+	struct sk_filter *prog = get_arg0(struct sk_filter *, args);
+
+	pfq_free_sk_filter(prog);
+
+	pr_devel("[PFQ|fini] ebpf: program@%p released!\n", prog);
+	return 0;
+}
+
+
+struct pfq_function_descr ebpf_functions[] = {
+
+        { "ebpf",	 "CInt -> SkBuff -> Bool", 		ebpf, 		ebpf_init, 	ebpf_fini },
+        { "ebpf_value",	 "CInt -> SkBuff -> Word64", 		ebpf_value, 	ebpf_init, 	ebpf_fini },
+        { "ebpf_action", "CInt -> SkBuff -> Action SkBuff", 	ebpf_action, 	ebpf_init, 	ebpf_fini },
+
+        { NULL }};
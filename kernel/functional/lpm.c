@@ -0,0 +1,258 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/inet.h>
+#include <linux/jhash.h>
+
+#include <pf_q-module.h>
+#include <pf_q-lpm.h>
+
+
+/*
+ * Exact longest-prefix match against a list of IPv4 and IPv6 networks
+ * ("10.0.0.0/8", "2001:db8::/32", a plain address is a host route). The
+ * tables are built by the init function, see pf_q-lpm.h.
+ */
+
+struct lpm_tables
+{
+	struct pfq_lpm_table ip;
+	struct pfq_lpm_table ip6;
+};
+
+
+static inline uint32_t
+lpm_ip(struct pfq_lpm_table const *t, __be32 addr)
+{
+	return pfq_lpm_lookup(t, pfq_lpm_key_from_bytes((const uint8_t *)&addr, 4));
+}
+
+
+static inline uint32_t
+lpm_ip6(struct pfq_lpm_table const *t, struct in6_addr const *addr)
+{
+	return pfq_lpm_lookup(t, pfq_lpm_key_from_bytes(addr->s6_addr, 16));
+}
+
+
+/* values of the longest prefixes matching the source and the destination address */
+
+static bool
+lpm_match(struct lpm_tables const *lt, SkBuff b, uint32_t *src, uint32_t *dst)
+{
+	struct pfq_hdr_cache *hc = pfq_parse(b.skb);
+
+	if (hc->flags & Q_HDR_IP) {
+
+		struct iphdr _iph;
+		const struct iphdr *ip = pfq_ip_hdr(b.skb, &_iph);
+		if (ip == NULL)
+			return false;
+
+		*src = lpm_ip(&lt->ip, ip->saddr);
+		*dst = lpm_ip(&lt->ip, ip->daddr);
+		return true;
+	}
+
+	if (hc->flags & Q_HDR_IP6) {
+
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6 = pfq_ip6_hdr(b.skb, &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		*src = lpm_ip6(&lt->ip6, &ip6->saddr);
+		*dst = lpm_ip6(&lt->ip6, &ip6->daddr);
+		return true;
+	}
+
+	return false;
+}
+
+
+static bool
+lpm(arguments_t args, SkBuff b)
+{
+	struct lpm_tables *lt = get_arg0(struct lpm_tables *, args);
+	uint32_t src, dst;
+
+	return lpm_match(lt, b, &src, &dst) && (src || dst);
+}
+
+
+static bool
+lpm_src(arguments_t args, SkBuff b)
+{
+	struct lpm_tables *lt = get_arg0(struct lpm_tables *, args);
+	uint32_t src, dst;
+
+	return lpm_match(lt, b, &src, &dst) && src;
+}
+
+
+static bool
+lpm_dst(arguments_t args, SkBuff b)
+{
+	struct lpm_tables *lt = get_arg0(struct lpm_tables *, args);
+	uint32_t src, dst;
+
+	return lpm_match(lt, b, &src, &dst) && dst;
+}
+
+
+static Action_SkBuff
+lpm_filter(arguments_t args, SkBuff b)
+{
+	return lpm(args, b) ? Pass(b) : Drop(b);
+}
+
+
+/* packets of the same pair of networks go to the same socket (in both the directions) */
+
+static Action_SkBuff
+steering_lpm(arguments_t args, SkBuff b)
+{
+	struct lpm_tables *lt = get_arg0(struct lpm_tables *, args);
+	uint32_t src, dst;
+
+	if (!lpm_match(lt, b, &src, &dst) || (!src && !dst))
+		return Drop(b);
+
+	return Steering(b, jhash_2words(min(src, dst), max(src, dst), 0));
+}
+
+
+static int
+lpm_parse(const char *str, struct pfq_lpm_prefix *p)
+{
+	u8 addr[16];
+	const char *end;
+	int len, bits;
+
+	if (strchr(str, ':')) {
+		if (!in6_pton(str, -1, addr, '/', &end))
+			return -EINVAL;
+		bits = 128;
+	}
+	else {
+		if (!in4_pton(str, -1, addr, '/', &end))
+			return -EINVAL;
+		bits = 32;
+	}
+
+	len = bits;
+
+	if (*end == '/' && (kstrtoint(end + 1, 10, &len) != 0 || len < 0 || len > bits))
+		return -EINVAL;
+
+	p->addr = pfq_lpm_key_from_bytes(addr, bits / 8);
+	p->len  = len;
+	return bits;
+}
+
+
+static int lpm_init(arguments_t args)
+{
+	const char **nets = get_array0(const char *, args);
+	size_t n, len = get_len_array0(args), n4 = 0, n6 = 0;
+	struct pfq_lpm_prefix *p4, *p6;
+	struct lpm_tables *lt;
+	int ret = -ENOMEM;
+
+	lt = kzalloc(sizeof(struct lpm_tables), GFP_KERNEL);
+	p4 = vmalloc((len + 1) * sizeof(struct pfq_lpm_prefix));
+	p6 = vmalloc((len + 1) * sizeof(struct pfq_lpm_prefix));
+
+	if (!lt || !p4 || !p6) {
+		printk(KERN_INFO "[PFQ|init] lpm: out of memory!\n");
+		goto out;
+	}
+
+	for(n = 0; n < len; n++)
+	{
+		struct pfq_lpm_prefix p;
+
+		/* the value of a prefix is its position in the list, plus one */
+
+		p.value = n + 1;
+
+		switch(lpm_parse(nets[n], &p))
+		{
+		case 32:  p4[n4++] = p; break;
+		case 128: p6[n6++] = p; break;
+		default:
+			printk(KERN_INFO "[PFQ|init] lpm: invalid network '%s'!\n", nets[n]);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	if (pfq_lpm_build(&lt->ip, p4, n4) < 0 ||
+	    pfq_lpm_build(&lt->ip6, p6, n6) < 0) {
+		printk(KERN_INFO "[PFQ|init] lpm: out of memory!\n");
+		pfq_lpm_free(&lt->ip);
+		goto out;
+	}
+
+	set_arg0(args, lt);
+
+	pr_devel("[PFQ|init] lpm: %zu IPv4 prefixes (%zu ranges), %zu IPv6 prefixes (%zu ranges)\n",
+		 n4, lt->ip.size, n6, lt->ip6.size);
+
+	lt = NULL;
+	ret = 0;
+out:
+	vfree(p4);
+	vfree(p6);
+	kfree(lt);
+	return ret;
+}
+
+
+static int lpm_fini(arguments_t args)
+{
+	struct lpm_tables *lt = get_arg0(struct lpm_tables *, args);
+
+	pfq_lpm_free(&lt->ip);
+	pfq_lpm_free(&lt->ip6);
+	kfree(lt);
+
+	pr_devel("[PFQ|fini] lpm: tables freed@%p!\n", lt);
+	return 0;
+}
+
+
+struct pfq_function_descr lpm_functions[] = {
+
+        { "lpm",	 "[String] -> SkBuff -> Bool", 		 lpm, 		lpm_init, 	lpm_fini },
+        { "lpm_src",	 "[String] -> SkBuff -> Bool", 		 lpm_src, 	lpm_init, 	lpm_fini },
+        { "lpm_dst",	 "[String] -> SkBuff -> Bool", 		 lpm_dst, 	lpm_init, 	lpm_fini },
+        { "lpm_filter",	 "[String] -> SkBuff -> Action SkBuff",  lpm_filter, 	lpm_init, 	lpm_fini },
+        { "steer_lpm",	 "[String] -> SkBuff -> Action SkBuff",  steering_lpm, 	lpm_init, 	lpm_fini },
+
+        { NULL }};
+
@@ -73,6 +73,86 @@ dec_counter(arguments_t args, SkBuff b)
 }
 
 
+static Action_SkBuff
+count_by(arguments_t args, SkBuff b)
+{
+        const int idx = get_arg0(int,args);
+        property_t prop = get_arg1(property_t,args);
+        struct pfq_state_map *map;
+        uint64_t ret, *value;
+
+        map = get_state_map(b, idx);
+        if (!map) {
+                if (printk_ratelimit())
+                        printk(KERN_INFO "[PFQ/lang] state map[%d]: not created!\n", idx);
+                return Pass(b);
+        }
+
+        ret = EVAL_PROPERTY(prop, b);
+        if (IS_JUST(ret)) {
+                value = pfq_state_map_lookup(map, FROM_JUST(ret), true);
+                if (value)
+                        (*value)++;
+        }
+
+        return Pass(b);
+}
+
+
+static Action_SkBuff
+count_min(arguments_t args, SkBuff b)
+{
+        property_t prop = get_arg0(property_t,args);
+        struct pfq_sketch *s = get_sketch(b);
+        uint64_t ret;
+
+        if (!s) {
+                if (printk_ratelimit())
+                        printk(KERN_INFO "[PFQ/lang] count_min: sketch not created!\n");
+                return Pass(b);
+        }
+
+        ret = EVAL_PROPERTY(prop, b);
+        if (IS_JUST(ret))
+                pfq_sketch_update(s, FROM_JUST(ret));
+
+        return Pass(b);
+}
+
+
+static bool
+heavy_hitter(arguments_t args, SkBuff b)
+{
+        property_t prop = get_arg0(property_t,args);
+        const uint64_t threshold = get_arg1(uint64_t,args);
+        struct pfq_sketch *s = get_sketch(b);
+        uint64_t ret;
+
+        if (!s)
+                return false;
+
+        ret = EVAL_PROPERTY(prop, b);
+        if (IS_JUST(ret))
+                return pfq_sketch_estimate(s, FROM_JUST(ret)) >= threshold;
+
+        return false;
+}
+
+
+static Action_SkBuff
+flow_track(arguments_t args, SkBuff b)
+{
+        struct pfq_flow_track *ft = get_flow_track(b);
+
+        if (ft)
+                pfq_flow_track_update(ft, b.skb);
+        else if (printk_ratelimit())
+                printk(KERN_INFO "[PFQ/lang] flow_track: flow table not enabled!\n");
+
+        return Pass(b);
+}
+
+
 static Action_SkBuff
 crc16_sum(arguments_t args, SkBuff b)
 {
@@ -130,23 +210,20 @@ log_buff(arguments_t args, SkBuff b)
 static Action_SkBuff
 log_packet(arguments_t args, SkBuff b)
 {
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
 	if (!printk_ratelimit())
 		return Pass(b);
 
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip != NULL)
 	{
-		struct iphdr _iph;
-		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
-		if (ip == NULL)
-			return Pass(b);
-
 		switch(ip->protocol)
 		{
 		case IPPROTO_UDP: {
 			struct udphdr _udph; const struct udphdr *udp;
-			udp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct udphdr), &_udph);
+			udp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_UDP, &_udph);
 			if (udp == NULL)
 				return Pass(b);
 
@@ -156,7 +233,7 @@ log_packet(arguments_t args, SkBuff b)
 		}
 		case IPPROTO_TCP: {
 			struct tcphdr _tcph; const struct tcphdr *tcp;
-			tcp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
+			tcp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_TCP, &_tcph);
 			if (tcp == NULL)
 				return Pass(b);
 
@@ -468,6 +545,10 @@ struct pfq_function_descr misc_functions[] = {
         { "inc", 	"CInt -> SkBuff -> Action SkBuff",     		inc_counter 	},
         { "dec", 	"CInt -> SkBuff -> Action SkBuff",    		dec_counter 	},
  	{ "mark", 	"CULong -> SkBuff -> Action SkBuff",  		mark		},
+        { "count_by", 	"CInt -> (SkBuff -> Word64) -> SkBuff -> Action SkBuff", count_by },
+        { "count_min", 	"(SkBuff -> Word64) -> SkBuff -> Action SkBuff", count_min },
+        { "heavy_hitter", "(SkBuff -> Word64) -> Word64 -> SkBuff -> Bool", heavy_hitter },
+        { "flow_track", "SkBuff -> Action SkBuff", 			flow_track	},
         { "crc16", 	"SkBuff -> Action SkBuff", 			crc16_sum	},
         { "log_msg",  	"String -> SkBuff -> Action SkBuff", 		log_msg 	},
         { "log_buff",   "SkBuff -> Action SkBuff", 			log_buff 	},
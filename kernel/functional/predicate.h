@@ -165,233 +165,112 @@ skb_header_available(struct sk_buff *skb, int offset, int len)
 static inline bool
 is_ip(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	        return skb_header_available(b.skb, b.skb->mac_len, sizeof(struct iphdr));
-
-        return false;
+	return (pfq_parse(b.skb)->flags & Q_HDR_IP) != 0;
 }
 
 static inline bool
 is_ip6(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IPV6))
-                return skb_header_available(b.skb, b.skb->mac_len, sizeof(struct ipv6hdr));
-
-        return false;
+	return (pfq_parse(b.skb)->flags & Q_HDR_IP6) != 0;
 }
 
+
 static inline bool
-is_udp(SkBuff b)
+__is_l4(SkBuff b, int l3, u8 protocol)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct pfq_hdr_cache *hc = pfq_parse(b.skb);
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
-		if (ip->protocol != IPPROTO_UDP)
-                        return false;
+	return (hc->flags & l3) && (hc->flags & Q_HDR_L4) && hc->l4_proto == protocol;
+}
 
-                return skb_header_available(b.skb, b.skb->mac_len  + (ip->ihl<<2), sizeof(struct udphdr));
-	}
 
-        return false;
+static inline bool
+is_udp(SkBuff b)
+{
+	return __is_l4(b, Q_HDR_IP, IPPROTO_UDP);
 }
 
 
 static inline bool
 is_udp6(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IPV6))
-	{
-		struct ipv6hdr _iph6;
-    		const struct ipv6hdr *ip6;
-
-		ip6 = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph6), &_iph6);
- 		if (ip6 == NULL)
-                        return false;
-
-		if (ip6->nexthdr != IPPROTO_UDP)
-                        return false;
-
-                return skb_header_available(b.skb, b.skb->mac_len  + sizeof(struct ipv6hdr), sizeof(struct udphdr));
-	}
-
-        return false;
+	return __is_l4(b, Q_HDR_IP6, IPPROTO_UDP);
 }
 
 static inline bool
 is_tcp(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
-		if (ip->protocol != IPPROTO_TCP)
-                        return false;
-
-		return skb_header_available(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct tcphdr));
-	}
-
-        return false;
+	return __is_l4(b, Q_HDR_IP, IPPROTO_TCP);
 }
 
 
 static inline bool
 is_tcp6(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IPV6))
-	{
-		struct ipv6hdr _iph6;
-    		const struct ipv6hdr *ip6;
-
-		ip6 = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph6), &_iph6);
- 		if (ip6 == NULL)
-                        return false;
-
-		if (ip6->nexthdr != IPPROTO_TCP)
-                        return false;
-
-                return skb_header_available(b.skb, b.skb->mac_len  + sizeof(struct ipv6hdr), sizeof(struct tcphdr));
-	}
-
-        return false;
+	return __is_l4(b, Q_HDR_IP6, IPPROTO_TCP);
 }
 
 static inline bool
 is_icmp(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
-		if (ip->protocol != IPPROTO_ICMP)
-                        return false;
-
-		return skb_header_available(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct icmphdr));
-	}
-
-        return false;
+	return __is_l4(b, Q_HDR_IP, IPPROTO_ICMP);
 }
 
 
 static inline bool
 is_icmp6(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IPV6))
-	{
-		struct ipv6hdr _iph6;
-    		const struct ipv6hdr *ip6;
-
-		ip6 = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph6), &_iph6);
- 		if (ip6 == NULL)
-                        return false;
-
-		if (ip6->nexthdr != IPPROTO_ICMPV6)
-                        return false;
-
-		// ... the icmpv6 header is 32 bits long.
-
-                return skb_header_available(b.skb, b.skb->mac_len  + sizeof(struct ipv6hdr), 32 >> 3);
-	}
-
-        return false;
+	return __is_l4(b, Q_HDR_IP6, IPPROTO_ICMPV6);
 }
 
 
 static inline bool
 has_addr(SkBuff b, __be32 addr, __be32 mask)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		if ((ip->saddr & mask) == (addr & mask) ||
-		    (ip->daddr & mask) == (addr & mask))
-			return true;
-	}
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return false;
 
-        return false;
+	return (ip->saddr & mask) == (addr & mask) ||
+	       (ip->daddr & mask) == (addr & mask);
 }
 
 
 static inline bool
 has_src_addr(SkBuff b, __be32 addr, __be32 mask)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		if ((ip->saddr & mask) == (addr & mask))
-			return true;
-	}
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return false;
 
-        return false;
+	return (ip->saddr & mask) == (addr & mask);
 }
 
 static inline bool
 has_dst_addr(SkBuff b, __be32 addr, __be32 mask)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		if ((ip->daddr & mask) == (addr & mask))
-			return true;
-	}
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return false;
 
-        return false;
+	return (ip->daddr & mask) == (addr & mask);
 }
 
 
 static inline bool
 is_flow(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
-		if (ip->protocol != IPPROTO_UDP &&
-		    ip->protocol != IPPROTO_TCP)
-                        return false;
-
-		return skb_header_available(b.skb, b.skb->mac_len + (ip->ihl<<2), ip->protocol == IPPROTO_UDP ? sizeof(struct udphdr) : sizeof(struct tcphdr));
-	}
-
-        return false;
+	return __is_l4(b, Q_HDR_IP, IPPROTO_UDP) ||
+	       __is_l4(b, Q_HDR_IP, IPPROTO_TCP);
 }
 
 
@@ -405,159 +284,99 @@ is_l3_proto(SkBuff b, u16 type)
 static inline bool
 is_l4_proto(SkBuff b, u8 protocol)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
-                return ip->protocol == protocol;
-	}
+	struct pfq_hdr_cache *hc = pfq_parse(b.skb);
 
-	return false;
+	return (hc->flags & Q_HDR_IP) && hc->l4_proto == protocol;
 }
 
 
 static inline bool
 is_frag(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return false;
 
-                return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) != 0;
-	}
-
-	return false;
+	return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) != 0;
 }
 
 static inline bool
 is_first_frag(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return false;
 
-                return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) == __constant_htons(IP_MF);
-	}
-
-	return false;
+	return (ip->frag_off & __constant_htons(IP_MF|IP_OFFSET)) == __constant_htons(IP_MF);
 }
 
 static inline bool
 is_more_frag(SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return false;
+
+	return (ip->frag_off & __constant_htons(IP_OFFSET)) != 0;
+}
+
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
+/* udp and tcp headers share the position of the ports */
 
-                return (ip->frag_off & __constant_htons(IP_OFFSET)) != 0;
+static inline const struct udphdr *
+__flow_ports(SkBuff b, struct tcphdr *buf)
+{
+	struct pfq_hdr_cache *hc = pfq_parse(b.skb);
+
+	if (!(hc->flags & Q_HDR_IP))
+		return NULL;
+
+	switch(hc->l4_proto)
+	{
+	case IPPROTO_UDP:
+	case IPPROTO_TCP:
+		return pfq_l4_hdr(b.skb, Q_HDR_IP, hc->l4_proto, buf);
 	}
 
-	return false;
+	return NULL;
 }
 
+
 static inline bool
 has_src_port(SkBuff b, uint16_t port)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
-		switch(ip->protocol)
-		{
-                case IPPROTO_UDP: {
-                	struct udphdr _udph; const struct udphdr *udp;
-			udp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct udphdr), &_udph);
-			if (udp == NULL)
-				return false;
-
-			return udp->source == htons(port);
-		}
-		case IPPROTO_TCP: {
-                	struct tcphdr _tcph; const struct tcphdr *tcp;
-			tcp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
-			if (tcp == NULL)
-				return false;
-
-			return tcp->source == htons(port);
-		}
-
-		default:
-			return false;
-		}
-	}
+	struct tcphdr _buf;
+	const struct udphdr *ports = __flow_ports(b, &_buf);
 
-	return false;
+	return ports && ports->source == htons(port);
 }
 
 static inline bool
 has_dst_port(SkBuff b, uint16_t port)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return false;
-
-		switch(ip->protocol)
-		{
-                case IPPROTO_UDP: {
-                	struct udphdr _udph; const struct udphdr *udp;
-			udp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct udphdr), &_udph);
-			if (udp == NULL)
-				return false;
-
-			return udp->dest == htons(port);
-		}
-		case IPPROTO_TCP: {
-                	struct tcphdr _tcph; const struct tcphdr *tcp;
-			tcp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
-			if (tcp == NULL)
-				return false;
-
-			return tcp->dest == htons(port);
-		}
-
-		default:
-			return false;
-		}
-	}
+	struct tcphdr _buf;
+	const struct udphdr *ports = __flow_ports(b, &_buf);
 
-	return false;
+	return ports && ports->dest == htons(port);
 }
 
 
 static inline bool
 has_port(SkBuff b, uint16_t port)
 {
-	return has_src_port(b, port) || has_dst_port(b, port);
+	struct tcphdr _buf;
+	const struct udphdr *ports = __flow_ports(b, &_buf);
+
+	return ports && (ports->source == htons(port) || ports->dest == htons(port));
 }
 
 
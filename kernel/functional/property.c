@@ -23,6 +23,7 @@
 
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/jhash.h>
 
 #include <pf_q-module.h>
 
@@ -34,184 +35,169 @@
 static uint64_t
 ip_tos(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
 
-		return JUST(ip->tos);
-	}
-
-        return NOTHING;
+	return JUST(ip->tos);
 }
 
 
 static uint64_t
 ip_tot_len(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
 
-		return JUST(ntohs(ip->tot_len));
-	}
-
-        return NOTHING;
+	return JUST(ntohs(ip->tot_len));
 }
 
 
 static uint64_t
 ip_id(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
 
-		return JUST(ntohs(ip->id));
-	}
-
-        return NOTHING;
+	return JUST(ntohs(ip->id));
 }
 
 
 static uint64_t
 ip_ttl(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		return JUST(ip->ttl);
-	}
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
 
-        return NOTHING;
+	return JUST(ip->ttl);
 }
 
 static uint64_t
 ip_frag(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
 
-		return JUST(ntohs(ip->frag_off));
-	}
-
-        return NOTHING;
+	return JUST(ntohs(ip->frag_off));
 }
 
 
-/****************************************************************
- * 			tcp properties
- ****************************************************************/
-
 static uint64_t
-tcp_source(arguments_t args, SkBuff b)
+ip_saddr(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		struct tcphdr _tcp;
-		const struct tcphdr *tcp;
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	return JUST(ntohl(ip->saddr));
+}
 
-		if (ip->protocol != IPPROTO_TCP)
-                        return NOTHING;
 
-		tcp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_tcp), &_tcp);
-		if (tcp == NULL)
-			return NOTHING;
+static uint64_t
+ip_daddr(arguments_t args, SkBuff b)
+{
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		return JUST(ntohs(tcp->source));
-	}
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
 
-        return NOTHING;
+	return JUST(ntohl(ip->daddr));
 }
 
 
+/* 64-bit hash of the 5-tuple (ports are 0 for protocols other than TCP/UDP) */
+
 static uint64_t
-tcp_dest(arguments_t args, SkBuff b)
+ip_flow(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
+	u32 ports = 0, h1, h2;
+
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return NOTHING;
+
+	if (ip->protocol == IPPROTO_TCP || ip->protocol == IPPROTO_UDP) {
+		struct tcphdr _l4;	/* large enough for udp, ports come first in both */
+		const __be32 *pp = pfq_l4_hdr(b.skb, Q_HDR_IP, ip->protocol, &_l4);
+		if (pp)
+			ports = (__force u32)*pp;
+	}
+
+	h1 = jhash_3words((__force u32)ip->saddr, (__force u32)ip->daddr, ports, ip->protocol);
+	h2 = jhash_3words((__force u32)ip->daddr, ports, (__force u32)ip->saddr, ip->protocol);
 
-		struct tcphdr _tcp;
-		const struct tcphdr *tcp;
+	return JUST((uint64_t)h1 << 32 | h2);
+}
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
 
-		if (ip->protocol != IPPROTO_TCP)
-                        return NOTHING;
+/****************************************************************
+ * 			tcp properties
+ ****************************************************************/
 
-		tcp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_tcp), &_tcp);
-		if (tcp == NULL)
-			return NOTHING;
+static uint64_t
+tcp_source(arguments_t args, SkBuff b)
+{
+	struct tcphdr _tcp;
+	const struct tcphdr *tcp;
 
-		return JUST(ntohs(tcp->dest));
-	}
+	tcp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_TCP, &_tcp);
+	if (tcp == NULL)
+		return NOTHING;
 
-        return NOTHING;
+	return JUST(ntohs(tcp->source));
 }
 
+
 static uint64_t
-tcp_hdrlen_(arguments_t args, SkBuff b)
+tcp_dest(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		struct tcphdr _tcp;
-		const struct tcphdr *tcp;
+	struct tcphdr _tcp;
+	const struct tcphdr *tcp;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	tcp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_TCP, &_tcp);
+	if (tcp == NULL)
+		return NOTHING;
 
-		if (ip->protocol != IPPROTO_TCP)
-                        return NOTHING;
+	return JUST(ntohs(tcp->dest));
+}
 
-		tcp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_tcp), &_tcp);
-		if (tcp == NULL)
-			return NOTHING;
+static uint64_t
+tcp_hdrlen_(arguments_t args, SkBuff b)
+{
+	struct tcphdr _tcp;
+	const struct tcphdr *tcp;
 
-		return JUST(tcp->doff * 4);
-	}
+	tcp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_TCP, &_tcp);
+	if (tcp == NULL)
+		return NOTHING;
 
-        return NOTHING;
+	return JUST(tcp->doff * 4);
 }
 
 /****************************************************************
@@ -221,144 +207,79 @@ tcp_hdrlen_(arguments_t args, SkBuff b)
 static uint64_t
 udp_source(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		struct udphdr _udp;
-		const struct udphdr *udp;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
+	struct udphdr _udp;
+	const struct udphdr *udp;
 
-		if (ip->protocol != IPPROTO_TCP)
-                        return NOTHING;
+	udp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_UDP, &_udp);
+	if (udp == NULL)
+		return NOTHING;
 
-		udp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_udp), &_udp);
-		if (udp == NULL)
-			return NOTHING;
-
-		return JUST(ntohs(udp->source));
-	}
-
-        return NOTHING;
+	return JUST(ntohs(udp->source));
 }
 
 
 static uint64_t
 udp_dest(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		struct udphdr _udp;
-		const struct udphdr *udp;
+	struct udphdr _udp;
+	const struct udphdr *udp;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
-
-		if (ip->protocol != IPPROTO_TCP)
-                        return NOTHING;
-
-		udp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_udp), &_udp);
-		if (udp == NULL)
-			return NOTHING;
-
-		return JUST(ntohs(udp->dest));
-	}
+	udp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_UDP, &_udp);
+	if (udp == NULL)
+		return NOTHING;
 
-        return NOTHING;
+	return JUST(ntohs(udp->dest));
 }
 
 static uint64_t
 udp_len(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct udphdr _udp;
+	const struct udphdr *udp;
 
-		struct udphdr _udp;
-		const struct udphdr *udp;
+	udp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_UDP, &_udp);
+	if (udp == NULL)
+		return NOTHING;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
-
-		if (ip->protocol != IPPROTO_TCP)
-                        return NOTHING;
-
-		udp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_udp), &_udp);
-		if (udp == NULL)
-			return NOTHING;
-
-		return JUST(ntohs(udp->len));
-	}
-
-        return NOTHING;
+	return JUST(ntohs(udp->len));
 }
 
 
 static uint64_t
 icmp_type(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-
-		struct icmphdr _icmp;
-		const struct icmphdr *icmp;
-
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
-
-		if (ip->protocol != IPPROTO_ICMP)
-                        return NOTHING;
+	struct icmphdr _icmp;
+	const struct icmphdr *icmp;
 
-		icmp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_icmp), &_icmp);
-		if (icmp == NULL)
-			return NOTHING;
+	icmp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_ICMP, &_icmp);
+	if (icmp == NULL)
+		return NOTHING;
 
-		return JUST(icmp->type);
-	}
-
-        return NOTHING;
+	return JUST(icmp->type);
 }
 
 
 static uint64_t
 icmp_code(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct icmphdr _icmp;
+	const struct icmphdr *icmp;
 
-		struct icmphdr _icmp;
-		const struct icmphdr *icmp;
+	icmp = pfq_l4_hdr(b.skb, Q_HDR_IP, IPPROTO_ICMP, &_icmp);
+	if (icmp == NULL)
+		return NOTHING;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return NOTHING;
-
-		if (ip->protocol != IPPROTO_ICMP)
-                        return NOTHING;
+	return JUST(icmp->code);
+}
 
-		icmp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_icmp), &_icmp);
-		if (icmp == NULL)
-			return NOTHING;
 
-		return JUST(icmp->code);
-	}
+static uint64_t
+vlan_vid(arguments_t args, SkBuff b)
+{
+	if ((b.skb->vlan_tci & VLAN_VID_MASK) == 0)
+		return NOTHING;
 
-        return NOTHING;
+	return JUST(b.skb->vlan_tci & VLAN_VID_MASK);
 }
 
 
@@ -376,6 +297,9 @@ struct pfq_function_descr property_functions[] = {
         { "ip_id",  	 "SkBuff -> Word64", ip_id 	     	},
         { "ip_frag",	 "SkBuff -> Word64", ip_frag      	},
         { "ip_ttl", 	 "SkBuff -> Word64", ip_ttl 	     	},
+        { "ip_saddr", 	 "SkBuff -> Word64", ip_saddr 	     	},
+        { "ip_daddr", 	 "SkBuff -> Word64", ip_daddr 	     	},
+        { "ip_flow", 	 "SkBuff -> Word64", ip_flow 	     	},
 
         { "tcp_source",  "SkBuff -> Word64", tcp_source   	},
         { "tcp_dest", 	 "SkBuff -> Word64", tcp_dest     	},
@@ -388,6 +312,8 @@ struct pfq_function_descr property_functions[] = {
         { "icmp_type",   "SkBuff -> Word64", icmp_type    	},
         { "icmp_code",   "SkBuff -> Word64", icmp_code    	},
 
+        { "vlan_vid",    "SkBuff -> Word64", vlan_vid     	},
+
 	{ "get_mark", 	 "SkBuff -> Word64", __get_mark     	},
 
         { NULL }};
@@ -25,8 +25,86 @@
 #include <linux/module.h>
 #include <linux/swab.h>
 #include <linux/inetdevice.h>
+#include <linux/jhash.h>
 
 #include <pf_q-module.h>
+#include <pf_q-global.h>
+
+
+/*
+ * Symmetric hashes: the fields of the two endpoints are sorted before being
+ * mixed by jhash, so that both the directions of a flow get the same hash.
+ * The xor hashes (steer_hash=0) are kept for comparison.
+ */
+
+enum { steer_hash_xor, steer_hash_jhash, steer_hash_nic };
+
+#define STEER_HASH_SEED 	0x5bd1e995
+
+
+static inline uint32_t
+symmetric_hash_ip(__be32 saddr, __be32 daddr)
+{
+	u32 a = (__force u32)saddr, b = (__force u32)daddr;
+
+	return jhash_2words(min(a,b), max(a,b), STEER_HASH_SEED);
+}
+
+
+static inline uint32_t
+symmetric_hash_flow(__be32 saddr, __be32 daddr, __be16 source, __be16 dest, u8 protocol)
+{
+	u32 a = (__force u32)saddr, b = (__force u32)daddr;
+	u32 p = (__force u16)source, q = (__force u16)dest;
+
+	return jhash_3words(min(a,b), max(a,b), (min(p,q) << 16) | max(p,q), STEER_HASH_SEED ^ protocol);
+}
+
+
+static inline uint32_t
+symmetric_hash_ip6(struct in6_addr const *saddr, struct in6_addr const *daddr)
+{
+	u32 addr[8];
+
+	if (memcmp(saddr, daddr, sizeof(struct in6_addr)) > 0)
+		swap(saddr, daddr);
+
+	memcpy(addr, saddr, sizeof(struct in6_addr));
+	memcpy(addr + 4, daddr, sizeof(struct in6_addr));
+
+	return jhash2(addr, 8, STEER_HASH_SEED);
+}
+
+
+static inline uint32_t
+symmetric_hash_link(struct ethhdr const *eth)
+{
+	unsigned char const *s = eth->h_source, *d = eth->h_dest;
+	u32 addr[3];
+
+	if (memcmp(s, d, ETH_ALEN) > 0)
+		swap(s, d);
+
+	memcpy(addr, s, ETH_ALEN);
+	memcpy((char *)addr + ETH_ALEN, d, ETH_ALEN);
+
+	return jhash2(addr, 3, STEER_HASH_SEED);
+}
+
+
+/* the L4 hash computed by the NIC, if any (symmetric only if the NIC is configured with a symmetric key) */
+
+static inline bool
+nic_hash(struct sk_buff const *skb, uint32_t *hash)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,14,0))
+	if (skb->l4_hash) {
+		*hash = skb->hash;
+		return true;
+	}
+#endif
+	return false;
+}
 
 
 static Action_SkBuff
@@ -61,6 +139,9 @@ steering_link(arguments_t args, SkBuff b)
 {
         uint32_t * w;
 
+	if (steer_hash != steer_hash_xor)
+		return Steering(b, symmetric_hash_link(eth_hdr(b.skb)));
+
         w = (uint32_t *)eth_hdr(b.skb);
 
 	return Steering(b, w[0] ^ w[1] ^ w[2]); // 3 * sizeof(uint32_t) = 12 bytes.
@@ -80,22 +161,20 @@ steering_vlan_id(arguments_t args, SkBuff b)
 static Action_SkBuff
 steering_ip(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
-		__be32 hash;
+	struct iphdr _iph;
+	const struct iphdr *ip;
+	__be32 hash;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return Drop(b);
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return Drop(b);
 
-		hash = ip->saddr ^ ip->daddr;
+	if (steer_hash != steer_hash_xor)
+		return Steering(b, symmetric_hash_ip(ip->saddr, ip->daddr));
 
-        	return Steering(b, *(uint32_t *)&hash);
-	}
+	hash = ip->saddr ^ ip->daddr;
 
-        return Drop(b);
+	return Steering(b, *(uint32_t *)&hash);
 }
 
 
@@ -127,71 +206,73 @@ steering_net(arguments_t args, SkBuff b)
 	__be32 mask    = get_arg1(__be32, args);
 	__be32 submask = get_arg2(__be32, args);
 
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return Drop(b);
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	if (ip == NULL)
+		return Drop(b);
 
-		if ((ip->saddr & mask) == addr)
-        		return Steering(b, __swab32(ntohl(ip->saddr & submask)));
+	if ((ip->saddr & mask) == addr)
+		return Steering(b, __swab32(ntohl(ip->saddr & submask)));
 
-		if ((ip->daddr & mask) == addr)
-        		return Steering(b, __swab32(ntohl(ip->daddr & submask)));
-	}
+	if ((ip->daddr & mask) == addr)
+		return Steering(b, __swab32(ntohl(ip->daddr & submask)));
 
-        return Drop(b);
+	return Drop(b);
 }
 
 
 static Action_SkBuff
 steering_flow(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IP))
-	{
-		struct iphdr _iph;
-    		const struct iphdr *ip;
+	struct pfq_hdr_cache *hc = pfq_parse(b.skb);
 
-		struct udphdr _udp;
-		const struct udphdr *udp;
-               	__be32 hash;
+	struct iphdr _iph;
+	const struct iphdr *ip;
 
-		ip = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_iph), &_iph);
- 		if (ip == NULL)
-                        return Drop(b);
+	struct tcphdr _l4;	/* udp and tcp ports share the same position */
+	const struct udphdr *udp;
+	__be32 hash;
+	uint32_t h;
 
-		if (ip->protocol != IPPROTO_UDP &&
-		    ip->protocol != IPPROTO_TCP)
-                        return Drop(b);
+	if (!(hc->flags & Q_HDR_IP))
+		return Drop(b);
 
-		udp = skb_header_pointer(b.skb, b.skb->mac_len + (ip->ihl<<2), sizeof(_udp), &_udp);
-		if (udp == NULL)
-			return Drop(b);  /* broken */
+	if (steer_hash == steer_hash_nic && nic_hash(b.skb, &h))
+		return Steering(b, h);
 
-		hash = ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest;
+	if (hc->l4_proto != IPPROTO_UDP &&
+	    hc->l4_proto != IPPROTO_TCP)
+		return Drop(b);
 
-        	return Steering(b, *(uint32_t *)&hash);
-	}
+	ip = pfq_ip_hdr(b.skb, &_iph);
+	udp = pfq_l4_hdr(b.skb, Q_HDR_IP, hc->l4_proto, &_l4);
+	if (ip == NULL || udp == NULL)
+		return Drop(b);  /* broken */
 
-        return Drop(b);
+	if (steer_hash != steer_hash_xor)
+		return Steering(b, symmetric_hash_flow(ip->saddr, ip->daddr, udp->source, udp->dest, ip->protocol));
+
+	hash = ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest;
+
+	return Steering(b, *(uint32_t *)&hash);
 }
 
 
 static Action_SkBuff
 steering_ip6(arguments_t args, SkBuff b)
 {
-	if (eth_hdr(b.skb)->h_proto == __constant_htons(ETH_P_IPV6))
+	struct ipv6hdr _ip6h;
+	const struct ipv6hdr *ip6;
+
+	ip6 = pfq_ip6_hdr(b.skb, &_ip6h);
+	if (ip6 != NULL)
 	{
-		struct ipv6hdr _ip6h;
-    		const struct ipv6hdr *ip6;
 		__be32 hash;
 
-		ip6 = skb_header_pointer(b.skb, b.skb->mac_len, sizeof(_ip6h), &_ip6h);
- 		if (ip6 == NULL)
-                        return Drop(b);
+		if (steer_hash != steer_hash_xor)
+			return Steering(b, symmetric_hash_ip6(&ip6->saddr, &ip6->daddr));
 
 		hash = ip6->saddr.in6_u.u6_addr32[0] ^
 		       ip6->saddr.in6_u.u6_addr32[1] ^
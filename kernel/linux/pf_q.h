@@ -121,6 +121,31 @@ static inline void smp_wmb() { barrier(); }
 #define Q_SO_TX_FLUSH			35
 #define Q_SO_TX_ASYNC			36
 
+#define Q_SO_SET_RX_MODE 		37
+#define Q_SO_GET_RX_MODE 		38
+
+#define Q_SO_SET_RX_WAKEUP 		39	/* wakeup threshold, in packets */
+#define Q_SO_GET_RX_WAKEUP 		40
+#define Q_SO_SET_RX_WAKEUP_DELAY 	41	/* max wakeup delay, in usec (0 = disabled) */
+#define Q_SO_GET_RX_WAKEUP_DELAY 	42
+
+#define Q_SO_GROUP_STEERING 		43	/* steering mode of the group */
+#define Q_SO_SET_WEIGHT 		44	/* steering weight of the socket */
+#define Q_SO_GET_WEIGHT 		45
+#define Q_SO_GROUP_SPILL 		46	/* overflow policy of a steering group */
+
+#define Q_SO_SET_RX_HDR_EXT 		47	/* extended packet header: 1 = enabled, 0 = disabled (default) */
+#define Q_SO_GET_RX_HDR_EXT 		48
+
+#define Q_SO_GET_GROUP_LANG_STATS 	49	/* per-node counters of the group computation */
+#define Q_SO_GROUP_FUNCTION_ARG 	50	/* replace an argument of the running computation */
+#define Q_SO_GROUP_EBPF 		51	/* eBPF socket filter of the group, by program fd */
+#define Q_SO_GROUP_STATE_MAP 		52	/* create/resize/remove a state map of the group */
+#define Q_SO_GET_GROUP_STATE_MAP 	53	/* read the entries of a state map */
+#define Q_SO_GROUP_FLOW_TRACK 		54	/* flow table and export ring of the group (flow_track) */
+#define Q_SO_GROUP_SKETCH 		55	/* count-min sketch and top-K of the group (count_min) */
+#define Q_SO_GET_GROUP_TOPK 		56	/* read the merged top-K (heavy hitters) */
+
 
 /* general placeholders */
 
@@ -131,6 +156,33 @@ static inline void smp_wmb() { barrier(); }
 #define Q_NO_KTHREAD         		-1
 #define Q_ANY_CPU	     		65535
 
+/* Rx queue modes */
+
+#define Q_RX_MODE_DOUBLE_BUFFER 	0	/* default */
+#define Q_RX_MODE_PERCPU_RINGS  	1	/* a single-producer ring per cpu */
+#define Q_RX_MODE_RING          	2	/* a multi-producer ring, per-slot commit */
+
+#define Q_RX_MODE_PACKED        	0x10	/* flag: variable-length slots (Q_RX_MODE_PERCPU_RINGS only) */
+
+/* Rx wakeup: a sleeping reader is woken up after this number of packets (default) */
+
+#define Q_RX_WAKEUP_DEFAULT     	8192
+
+/* steering modes: how a hash is mapped to a socket of the group */
+
+#define Q_STEERING_FOLD         	0	/* default: hash modulo the number of sockets */
+#define Q_STEERING_CONSISTENT   	1	/* Maglev consistent hashing, weighted */
+
+#define Q_MAX_STEERING_WEIGHT   	16
+
+/* spill policies: where a steered packet goes when the queue of its socket is congested */
+
+#define Q_SPILL_NONE            	0	/* default: the packet is dropped by the congested socket */
+#define Q_SPILL_NEW_FLOWS       	1	/* new flows move to the least loaded socket (and stick to it) */
+#define Q_SPILL_ALL             	2	/* every packet moves to the least loaded socket */
+
+#define Q_SPILL_THRESHOLD_DEFAULT 	90	/* fill level of the queue, in percent */
+
 /* timestamp */
 
 #define Q_TSTAMP_OFF         	     	0       /* default */
@@ -167,7 +219,13 @@ static inline void smp_wmb() { barrier(); }
 /* additional constants */
 
 #define Q_MAX_COUNTERS          	64
+#define Q_MAX_LANG_STATS_NODES  	64
 #define Q_MAX_TX_QUEUES 		4
+#define Q_MAX_STATE_MAPS 		8
+#define Q_MAX_STATE_MAP_SIZE 		(1 << 20)	/* entries per cpu */
+#define Q_MAX_SKETCH_DEPTH 		8		/* rows */
+#define Q_MAX_SKETCH_WIDTH 		(1 << 20)	/* counters per row */
+#define Q_MAX_TOPK 			1024
 
 
 /* PFQ socket queue */
@@ -179,9 +237,34 @@ struct pfq_rx_queue
         unsigned int            size;       /* queue length in slots */
         unsigned int            slot_size;  /* sizeof(pfq_pkthdr) + caplen  */
 
+        unsigned int            mode;       /* Q_RX_MODE_... */
+        unsigned int            rings;      /* number of rings (ring modes) */
+
+} __attribute__((aligned(64)));
+
+
+/* Rx ring: free-running byte counters, on different cache lines */
+
+struct pfq_rx_ring
+{
+        uint64_t                prod __attribute__((aligned(64)));   /* written by the kernel */
+        uint64_t                cons __attribute__((aligned(64)));   /* written by the user-space */
+
 } __attribute__((aligned(64)));
 
 
+/* commit version of the slots at the given position of a ring (never 0).
+ * In Q_RX_MODE_RING the reader clears the commit of the slots it releases,
+ * so that a slot left from an older lap cannot look committed. */
+
+#define Q_RX_RING_COMMIT(pos, ring_bytes) 	((uint8_t)(1 + ((pos)/(ring_bytes)) % 255))
+
+/* packed slots: each pfq_pkthdr is followed by caplen bytes, aligned to 8.
+ * A header with len 0, or less room than a header, marks the end of the ring */
+
+#define Q_RX_PACKED_SLOT_SIZE(caplen) 		((sizeof(struct pfq_pkthdr) + (caplen) + 7) & ~(size_t)7)
+
+
 struct pfq_tx_queue
 {
         unsigned int   		prod;
@@ -241,6 +324,33 @@ struct pfq_pkthdr
 } __attribute__((packed));
 
 
+/* extended packet header: when enabled, it trails the packet bytes of each slot
+ * (fixed slots: the last bytes of the slot; packed slots: right after Q_RX_PACKED_SLOT_SIZE(caplen)).
+ * Offsets are relative to the first byte of the packet and may exceed caplen. */
+
+#define Q_PKTHDR_EXT_IP 		0x02	/* IPv4 header present, l4_proto is the IP protocol */
+#define Q_PKTHDR_EXT_IP6 		0x04	/* IPv6 header present, l4_proto is the next header */
+#define Q_PKTHDR_EXT_L4 		0x08	/* the whole transport header is in the packet */
+#define Q_PKTHDR_EXT_HASH 		0x10	/* hash is the steering hash of the group */
+
+struct pfq_pkthdr_ext
+{
+        uint32_t    hash;       /* flow hash computed for steering */
+
+        uint16_t    l3_off;     /* offset of the network header */
+        uint16_t    l4_off;     /* offset of the transport header */
+
+        uint8_t     l4_proto;   /* transport protocol */
+        uint8_t     flags;      /* Q_PKTHDR_EXT_... */
+
+        uint8_t     reserved[6];
+
+} __attribute__((packed));
+
+
+#define Q_RX_HDR_EXT_SIZE(ext) 			((ext) ? sizeof(struct pfq_pkthdr_ext) : 0)
+
+
 struct pfq_pkthdr_tx
 {
 	uint64_t len;
@@ -255,6 +365,12 @@ struct pfq_pkthdr_tx
    +                             +                             +                            +
    | <------+ queue rx  +------> |  <----+ queue rx +------>   |  <----+ queue tx +------>  |  <----+ queue tx +------>
    +                             +                             +                            +
+
+   In ring modes (a single ring for Q_RX_MODE_RING) the Rx area holds the array of pfq_rx_ring descriptors, followed by the rings:
+
+   +------------------+-----------------------------+---------------------+     +---------------------+
+   | pfq_queue_hdr    | pfq_rx_ring[0..rings-1]     | ring 0 (size slots) | ... | ring n-1            | queue tx ...
+   +------------------+-----------------------------+---------------------+     +---------------------+
    */
 
 
@@ -325,12 +441,35 @@ struct pfq_group_join
         unsigned long class_mask;
 };
 
+struct pfq_group_steering
+{
+        int gid;
+        int mode;       /* Q_STEERING_... */
+};
+
+struct pfq_group_spill
+{
+        int gid;
+        int policy;     /* Q_SPILL_... */
+        int threshold;  /* fill level of the queue (percent) a socket is considered congested at */
+};
+
 struct pfq_group_computation
 {
         int gid;
         struct pfq_computation_descr __user *prog;
 };
 
+/* runtime update of an argument: the computation is not reinstalled */
+
+struct pfq_group_function_arg
+{
+        int gid;
+        int index;      /* function, as numbered in the computation descriptor */
+        int arg;        /* argument of the function */
+        struct pfq_functional_arg_descr value;
+};
+
 
 struct pfq_group_context
 {
@@ -348,6 +487,19 @@ struct pfq_fprog
         struct sock_fprog fcode;
 };
 
+/* pfq_group_ebpf: per-group eBPF socket filter, loaded with bpf(BPF_PROG_LOAD) */
+
+struct pfq_group_ebpf
+{
+        int gid;
+        int fd;         /* program fd, -1 resets the filter */
+};
+
+/* return value of eBPF programs run by the PFQ/lang ebpf_action function */
+
+#define Q_EBPF_STEER    0x80000000      /* steer by the low 31 bits (hash) */
+#define Q_EBPF_MARK     0x40000000      /* mark by the low 30 bits and pass */
+
 
 /* pfq statistics for socket and groups */
 
@@ -362,6 +514,8 @@ struct pfq_stats
 
 	unsigned long int frwd;      	/* forwarded to devices */
 	unsigned long int kern;		/* forwarded to kernel  */
+
+	unsigned long int spill;	/* steered to another socket (queue congestion) */
 };
 
 
@@ -372,4 +526,143 @@ struct pfq_counters
         unsigned long int counter[Q_MAX_COUNTERS];
 };
 
+
+/* PFQ/lang profiling counters, per node of a computation (lang_profile module parameter) */
+
+struct pfq_lang_node_stats
+{
+        uint64_t run;           /* invocations */
+        uint64_t drop;          /* packets dropped (or consumed) */
+        uint64_t steer;         /* packets steered */
+        uint64_t cycles;        /* TSC cycles */
+};
+
+
+struct pfq_lang_stats
+{
+        int     gid;
+        int     size;           /* number of nodes of the computation */
+
+        struct pfq_lang_node_stats node[Q_MAX_LANG_STATS_NODES];
+};
+
+/* state maps: per-group, per-cpu key/value tables used by stateful functions */
+
+#define Q_STATE_KEY_INVALID 	((uint64_t)-1)		/* reserved, cannot be stored */
+
+struct pfq_state_entry
+{
+        uint64_t key;
+        uint64_t value;
+};
+
+
+struct pfq_group_state_map
+{
+        int     gid;
+        int     index;          /* 0..Q_MAX_STATE_MAPS-1 */
+        size_t  size;           /* entries per cpu (rounded up to a power of 2), 0 removes the map */
+};
+
+
+struct pfq_group_state
+{
+        int     gid;
+        int     index;
+        int     aggregate;      /* 1: the values of a key are summed across cpus */
+        size_t  size;           /* in: room of the entry buffer, out: entries copied */
+        size_t  total;          /* out: entries in the map */
+        uint64_t miss;          /* out: lookups failed because the map was full */
+
+        struct pfq_state_entry __user *entry;
+};
+
+
+/* flow tracking: per-cpu IPv4 5-tuple tables, expired records are exported through a ring */
+
+#define Q_FLOW_END_IDLE 		1	/* idle timeout */
+#define Q_FLOW_END_ACTIVE 		2	/* active timeout */
+#define Q_FLOW_END_EVICTED 		3	/* table full */
+#define Q_FLOW_END_FLUSH 		4	/* flow table removed */
+
+#define Q_MAX_FLOW_TABLE_SIZE 		(1 << 20)	/* flows per cpu */
+#define Q_MAX_FLOW_RING_SIZE 		(1 << 22)	/* records */
+
+/* mmap offset (in pages) of the export ring of a group, 0 is the socket queue */
+
+#define Q_FLOW_RING_PGOFF(gid) 		((gid) + 1)
+
+
+struct pfq_flow_record
+{
+        uint32_t saddr;                 /* network byte order */
+        uint32_t daddr;
+        uint16_t sport;                 /* network byte order, 0 if not TCP/UDP */
+        uint16_t dport;
+        uint8_t  proto;
+        uint8_t  tcp_flags;             /* union of the TCP flags seen */
+        uint8_t  reason;                /* Q_FLOW_END_... */
+        uint8_t  reserved;
+
+        uint64_t packets;
+        uint64_t bytes;
+        uint64_t first;                 /* timestamp of the first packet, nsec since epoch */
+        uint64_t last;                  /* timestamp of the last packet */
+};
+
+
+struct pfq_flow_ring
+{
+        volatile uint64_t prod;         /* records written, by the kernel */
+        uint64_t size;                  /* records (power of 2) */
+        uint64_t drop;                  /* records lost, ring full */
+        char     pad0[64 - 3 * sizeof(uint64_t)];
+
+        volatile uint64_t cons;         /* records read, by user-space */
+        char     pad1[64 - sizeof(uint64_t)];
+
+        struct pfq_flow_record record[];
+};
+
+
+#define Q_FLOW_RING_MEM(n)      (sizeof(struct pfq_flow_ring) + (size_t)(n) * sizeof(struct pfq_flow_record))
+
+
+struct pfq_group_flow_track
+{
+        int     gid;
+        int     idle_timeout;           /* seconds */
+        int     active_timeout;         /* seconds */
+        size_t  size;                   /* flows per cpu, 0 removes the flow table */
+        size_t  ring;                   /* records of the export ring (power of 2) */
+};
+
+
+/* heavy hitters: per-cpu count-min sketch and top-K of the group */
+
+struct pfq_group_sketch
+{
+        int     gid;
+        int     depth;                  /* rows (hash functions) */
+        size_t  width;                  /* counters per row (rounded up to a power of 2), 0 removes the sketch */
+        size_t  topk;                   /* keys tracked per cpu */
+};
+
+
+struct pfq_heavy_hitter
+{
+        uint64_t key;
+        uint64_t count;                 /* estimated packets */
+};
+
+
+struct pfq_group_topk
+{
+        int     gid;
+        int     reset;                  /* 1: start a new measurement window after the read */
+        size_t  size;                   /* in: room of the entry buffer, out: entries copied */
+
+        struct pfq_heavy_hitter __user *entry;
+};
+
 #endif /* PF_Q_LINUX_H */
@@ -105,7 +105,6 @@ gc_copy_buff(struct gc_data *gc, struct gc_buff orig)
 
 	ret = gc_make_buff(gc, skb);
 
-	PFQ_CB(ret.skb)->group_mask = PFQ_CB(orig.skb)->group_mask;
 	PFQ_CB(ret.skb)->direct     = PFQ_CB(orig.skb)->direct;
 	PFQ_CB(ret.skb)->monad      = PFQ_CB(orig.skb)->monad;
 
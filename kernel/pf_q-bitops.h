@@ -24,6 +24,8 @@
 #ifndef PF_Q_BITOPS_H
 #define PF_Q_BITOPS_H
 
+#include <linux/types.h>
+#include <linux/bitops.h>
 #include <asm/bitops.h>
 
 
@@ -64,4 +66,61 @@
 }
 
 
+/* multi-word bitmaps (of socket and group ids): n is the index of the bit set */
+
+#define pfq_bitmap_foreach(map, words, n, ...) \
+{ \
+	size_t _w; \
+	for(_w = 0; _w < (words); _w++) \
+	{ \
+		unsigned long _mask = (map)[_w]; \
+		for(; _mask; _mask &= _mask - 1) \
+		{ \
+			n = _w * BITS_PER_LONG + pfq_ctz(_mask); \
+			__VA_ARGS__ \
+		} \
+	} \
+}
+
+
+static inline
+void pfq_bitmap_zero(unsigned long *map, size_t words)
+{
+	size_t n;
+	for(n = 0; n < words; n++)
+		map[n] = 0;
+}
+
+
+static inline
+void pfq_bitmap_or(unsigned long *dst, unsigned long const *src, size_t words)
+{
+	size_t n;
+	for(n = 0; n < words; n++)
+		dst[n] |= src[n];
+}
+
+
+static inline
+bool pfq_bitmap_empty(unsigned long const *map, size_t words)
+{
+	size_t n;
+	for(n = 0; n < words; n++)
+		if (map[n])
+			return false;
+	return true;
+}
+
+
+static inline
+bool pfq_bitmap_equal(unsigned long const *a, unsigned long const *b, size_t words)
+{
+	size_t n;
+	for(n = 0; n < words; n++)
+		if (a[n] != b[n])
+			return false;
+	return true;
+}
+
+
 #endif /* PF_Q_BITOPS_H */
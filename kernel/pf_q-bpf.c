@@ -56,6 +56,35 @@ pfq_alloc_sk_filter(struct sock_fprog *fprog)
 }
 
 
+/* an eBPF socket filter already loaded by user space (bpf(BPF_PROG_LOAD)) */
+
+struct sk_filter *
+pfq_alloc_sk_filter_fd(int fd)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0))
+       	struct sock sk;
+       	int rv;
+
+       	sock_init_data(NULL, &sk);
+       	sk.sk_filter = NULL;
+       	atomic_set(&sk.sk_omem_alloc, 0);
+       	sock_reset_flag(&sk, SOCK_FILTER_LOCKED);
+
+        pr_devel("[PFQ] BPF: new eBPF program (fd %d)\n", fd);
+
+	if ((rv = sk_attach_bpf(fd, &sk))) {
+		pr_devel("[PFQ] BPF: sk_attach_bpf error: (%d)!\n", rv);
+        	return NULL;
+	}
+
+	return sk.sk_filter;
+#else
+	printk(KERN_INFO "[PFQ] BPF: eBPF programs not supported by this kernel!\n");
+	return NULL;
+#endif
+}
+
+
 void
 pfq_free_sk_filter(struct sk_filter *filter)
 {
@@ -25,10 +25,27 @@
 #ifndef PF_Q_BPF_H
 #define PF_Q_BPF_H
 
+#include <linux/version.h>
 #include <linux/filter.h>
 
 struct sk_filter * pfq_alloc_sk_filter(struct sock_fprog *fprog);
+struct sk_filter * pfq_alloc_sk_filter_fd(int fd);
 
 void pfq_free_sk_filter(struct sk_filter *filter);
 
+
+/* classic programs are converted to eBPF and JIT compiled by the kernel (>= 3.16, net.core.bpf_jit_enable) */
+
+static inline
+unsigned int pfq_sk_filter_run(struct sk_filter *filter, struct sk_buff *skb)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3,15,0))
+	return sk_run_filter(skb, filter->insns);
+#elif (LINUX_VERSION_CODE < KERNEL_VERSION(4,4,0))
+	return SK_RUN_FILTER(filter, skb);
+#else
+	return bpf_prog_run_save_cb(filter->prog, skb);  /* eBPF programs may write the control buffer */
+#endif
+}
+
 #endif /* PF_Q_BPF_H */
@@ -31,19 +31,20 @@
 
 static DEFINE_SEMAPHORE(devmap_sem);
 
-atomic_long_t   pfq_devmap [Q_MAX_DEVICE][Q_MAX_HW_QUEUE];
+atomic_long_t   pfq_devmap [Q_MAX_DEVICE][Q_MAX_HW_QUEUE][Q_MAX_GROUP_WORDS];
 atomic_t        pfq_devmap_monitor [Q_MAX_DEVICE];
 
 
 void pfq_devmap_monitor_update(void)
 {
-    int i,j;
+    int i,j,w;
     for(i=0; i < Q_MAX_DEVICE; ++i)
     {
         unsigned long val = 0;
         for(j=0; j < Q_MAX_HW_QUEUE; ++j)
         {
-            val |= atomic_long_read(&pfq_devmap[i][j]);
+            for(w=0; w < Q_MAX_GROUP_WORDS; ++w)
+                val |= atomic_long_read(&pfq_devmap[i][j][w]);
         }
 
         atomic_set(&pfq_devmap_monitor[i], val ? 1 : 0);
@@ -53,7 +54,7 @@ void pfq_devmap_monitor_update(void)
 
 int pfq_devmap_update(int action, int index, int queue, int gid)
 {
-    int n = 0, i,q;
+    int n = 0, i,q, w = BIT_WORD(gid);
 
     if (unlikely(gid >= Q_MAX_GROUP || gid < 0)) {
         pr_devel("[PF_Q] devmap_update: bad gid (%u)\n",gid);
@@ -74,18 +75,18 @@ int pfq_devmap_update(int action, int index, int queue, int gid)
             /* map_set... */
             if (action == map_set) {
 
-                tmp = atomic_long_read(&pfq_devmap[i][q]);
-                tmp |= 1L << gid;
-                atomic_long_set(&pfq_devmap[i][q], tmp);
+                tmp = atomic_long_read(&pfq_devmap[i][q][w]);
+                tmp |= BIT_MASK(gid);
+                atomic_long_set(&pfq_devmap[i][q][w], tmp);
                 n++;
                 continue;
             }
 
             /* map_reset */
-            tmp = atomic_long_read(&pfq_devmap[i][q]);
-            if (tmp & (1L<<gid)) {
-                tmp &= ~(1L<<gid);
-                atomic_long_set(&pfq_devmap[i][q], tmp);
+            tmp = atomic_long_read(&pfq_devmap[i][q][w]);
+            if (tmp & BIT_MASK(gid)) {
+                tmp &= ~BIT_MASK(gid);
+                atomic_long_set(&pfq_devmap[i][q][w], tmp);
                 n++;
                 continue;
             }
@@ -34,7 +34,7 @@
 
 enum { map_reset, map_set };
 
-extern atomic_long_t pfq_devmap [Q_MAX_DEVICE][Q_MAX_HW_QUEUE];
+extern atomic_long_t pfq_devmap [Q_MAX_DEVICE][Q_MAX_HW_QUEUE][Q_MAX_GROUP_WORDS];
 extern atomic_t      pfq_devmap_monitor [Q_MAX_DEVICE];
 
 
@@ -60,10 +60,12 @@ int __pfq_devmap_equal(int i1, int q1, int i2, int q2)
 }
 
 
+/* return the w-th word of the mask of groups bound to the device/queue */
+
 static inline
-unsigned long __pfq_devmap_get_groups(int d, int q)
+unsigned long __pfq_devmap_get_groups(int d, int q, int w)
 {
-        return atomic_long_read(&pfq_devmap[d & Q_MAX_DEVICE_MASK][q & Q_MAX_HW_QUEUE_MASK]);
+        return atomic_long_read(&pfq_devmap[d & Q_MAX_DEVICE_MASK][q & Q_MAX_HW_QUEUE_MASK][w]);
 }
 
 
@@ -23,6 +23,8 @@
 
 #include <linux/kernel.h>
 #include <linux/printk.h>
+#include <linux/percpu.h>
+#include <linux/timex.h>
 #include <linux/pf_q.h>
 
 #include <asm/uaccess.h>
@@ -33,6 +35,8 @@
 #include <pf_q-symtable.h>
 #include <pf_q-signature.h>
 #include <pf_q-engine.h>
+#include <pf_q-bitops.h>
+#include <pf_q-global.h>
 
 #include <functional/headers.h>
 
@@ -155,47 +159,194 @@ pfq_bind(SkBuff b, struct pfq_computation_tree *prg)
 }
 
 
+/* profiled evaluation: the counters of the nodes are updated on this cpu */
+
+static bool
+pfq_node_steers(fanout_t const *before, fanout_t const *after)
+{
+	return is_steering(*after) && (!is_steering(*before) || before->hash != after->hash);
+}
+
+
+static Action_SkBuff
+pfq_bind_profile(SkBuff b, struct pfq_computation_tree *prg)
+{
+	struct pfq_lang_node_stats *stats = this_cpu_ptr(prg->stats);
+        struct pfq_functional_node *node = prg->entry_point;
+
+        while (node)
+        {
+		struct pfq_lang_node_stats *ns = &stats[node - prg->node];
+		fanout_t before = PFQ_CB(b.skb)->monad->fanout;
+		cycles_t start = get_cycles();
+                fanout_t *a;
+
+                b = pfq_apply(&node->fun, b).value;
+
+		ns->cycles += get_cycles() - start;
+		ns->run++;
+
+                if (b.skb == NULL) {
+			ns->drop++;
+                        return Pass(b);
+		}
+
+                a = &PFQ_CB(b.skb)->monad->fanout;
+
+                if (is_drop(*a)) {
+			ns->drop++;
+                        return Pass(b);
+		}
+
+		if (pfq_node_steers(&before, a))
+			ns->steer++;
+
+                node = node->next;
+        }
+
+        return Pass(b);
+}
+
+
 Action_SkBuff
 pfq_run(struct pfq_computation_tree *prg, SkBuff b)
 {
-#ifdef PFQ_LANG_PROFILE
-	static uint64_t nrun, total;
-	uint64_t stop, start;
-#endif
+	if (unlikely(lang_profile))
+		return pfq_bind_profile(b, prg);
+
+	return pfq_bind(b, prg);
+}
+
+
+/*
+ * Batch-at-a-time evaluation: every node of the computation runs over all
+ * the live packets of the batch before the next one. The bitmask 'live'
+ * is updated in place: a packet leaves it when dropped (or consumed).
+ */
+
+void
+pfq_run_batch(struct pfq_computation_tree *prg, struct gc_queue_buff *buffs, unsigned long long *live)
+{
+        struct pfq_functional_node *node = prg->entry_point;
+	struct pfq_lang_node_stats *stats = NULL;
+	unsigned long long mask;
+	SkBuff buff;
+	size_t n;
 
-#ifdef PFQ_LANG_PROFILE
-	start = get_cycles();
+	if (unlikely(lang_profile))
+		stats = this_cpu_ptr(prg->stats);
 
-	b =
-#else
-	return
-#endif
+        while (node && *live)
+        {
+		struct pfq_lang_node_stats *ns = stats ? &stats[node - prg->node] : NULL;
+		cycles_t start = ns ? get_cycles() : 0;
+
+		mask = *live;
+
+		for_each_gcbuff_bitmask(buffs, mask, buff, n)
+		{
+			fanout_t before = PFQ_CB(buff.skb)->monad->fanout;
 
-	pfq_bind(b, prg);
+			buff = pfq_apply(&node->fun, buff).value;
 
-#ifdef PFQ_LANG_PROFILE
+			buffs->queue[n] = buff;
 
-	stop = get_cycles();
-	total += (stop-start);
+			if (buff.skb == NULL || is_drop(PFQ_CB(buff.skb)->monad->fanout)) {
+				*live &= ~(1ULL << n);
+				if (ns)
+					ns->drop++;
+			}
+			else if (ns && pfq_node_steers(&before, &PFQ_CB(buff.skb)->monad->fanout))
+				ns->steer++;
 
-	if ((nrun++ % 1048576) == 0)
-		printk(KERN_INFO "[PFQ] PFQ/lang run: %llu_tsc.\n", total/nrun);
+			if (ns)
+				ns->run++;
+		}
 
-	return b;
-#endif
+		if (ns)
+			ns->cycles += get_cycles() - start;
 
+                node = node->next;
+        }
+}
+
+
+/* sum the per-cpu counters of a node */
+
+void
+pfq_computation_stats(struct pfq_computation_tree const *prg, size_t index, struct pfq_lang_node_stats *ret)
+{
+	int cpu;
+
+	ret->run = ret->drop = ret->steer = ret->cycles = 0;
+
+	if (prg->stats == NULL || index >= prg->size)
+		return;
+
+	for_each_possible_cpu(cpu)
+	{
+		struct pfq_lang_node_stats const *ns = per_cpu_ptr(prg->stats, cpu) + index;
+
+		ret->run    += ns->run;
+		ret->drop   += ns->drop;
+		ret->steer  += ns->steer;
+		ret->cycles += ns->cycles;
+	}
 }
 
 
 struct pfq_computation_tree *
 pfq_computation_alloc (struct pfq_computation_descr const *descr)
 {
-        struct pfq_computation_tree * c = kzalloc(sizeof(size_t) + descr->size * sizeof(struct pfq_functional_node), GFP_KERNEL);
+        struct pfq_computation_tree * c = kzalloc(sizeof(struct pfq_computation_tree) + descr->size * sizeof(struct pfq_functional_node), GFP_KERNEL);
+        if (c == NULL)
+        	return NULL;
+
         c->size = descr->size;
+
+        c->stats = __alloc_percpu(max_t(size_t, descr->size, 1) * sizeof(struct pfq_lang_node_stats),
+        			  __alignof__(struct pfq_lang_node_stats));
+        if (c->stats == NULL) {
+        	kfree(c);
+        	return NULL;
+	}
+
         return c;
 }
 
 
+void
+pfq_computation_free(struct pfq_computation_tree *c)
+{
+	size_t n;
+
+	if (c == NULL)
+		return;
+
+	for(n = 0; n < c->size; n++)
+	{
+		int i;
+		for(i = 0; i < sizeof(c->node[n].arg_mem)/sizeof(c->node[n].arg_mem[0]); i++)
+			kfree(c->node[n].arg_mem[i]);
+	}
+
+	free_percpu(c->stats);
+	kfree(c);
+}
+
+
+static size_t
+argument_size(struct pfq_functional_arg_descr const *arg)
+{
+	size_t s = is_arg_string(arg)     ?  strlen_user(arg->addr) :
+		   is_arg_vector(arg) 	  ?  arg->size * arg->nelem :
+		   is_arg_vector_str(arg) ?  arg->nelem * sizeof(char *) + strlen_user(arg->addr) :
+		   is_arg_data  (arg) 	  ?  (arg->size > 8 ? arg->size : 0 ) : 0;
+
+	return ALIGN(s, 8);
+}
+
+
 void *
 pfq_context_alloc(struct pfq_computation_descr const *descr)
 {
@@ -211,12 +362,7 @@ pfq_context_alloc(struct pfq_computation_descr const *descr)
 		{
 			if (fun->arg[i].addr) {
 
-				size_t s = is_arg_string(&fun->arg[i])     ?  strlen_user(fun->arg[i].addr) :
-					   is_arg_vector(&fun->arg[i]) 	   ?  fun->arg[i].size * fun->arg[i].nelem :
-					   is_arg_vector_str(&fun->arg[i]) ?  fun->arg[i].nelem * sizeof(char *) + strlen_user(fun->arg[i].addr) :
-					   is_arg_data  (&fun->arg[i]) 	   ?  (fun->arg[i].size > 8 ? fun->arg[i].size : 0 ) : 0;
-
-				size += ALIGN(s, 8);
+				size += argument_size(&fun->arg[i]);
 			}
 		}
         }
@@ -423,7 +569,7 @@ pfq_check_computation_descr(struct pfq_computation_descr const *descr)
 
 
 static void *
-resolve_user_symbol(struct list_head *cat, const char __user *symb, const char **signature, init_ptr_t *init, fini_ptr_t *fini)
+resolve_user_symbol(struct list_head *cat, const char __user *symb, const char **name, const char **signature, init_ptr_t *init, fini_ptr_t *fini)
 {
 	struct symtable_entry *entry;
         const char *symbol;
@@ -440,6 +586,7 @@ resolve_user_symbol(struct list_head *cat, const char __user *symb, const char *
                 return NULL;
         }
 
+        *name = entry->symbol;
         *signature = entry->signature;
 	*init = entry->init;
 	*fini = entry->fini;
@@ -455,6 +602,8 @@ pfq_computation_init(struct pfq_computation_tree *comp)
 	size_t n;
 	for (n = 0; n < comp->size; n++)
 	{
+		memcpy(comp->node[n].init_arg, comp->node[n].fun.arg, sizeof(comp->node[n].init_arg));
+
 		if (comp->node[n].init) {
 
                 	pr_devel("[PFQ] %zu: initializing computation %pF...\n", n, comp->node[n].init);
@@ -490,6 +639,139 @@ pfq_computation_fini(struct pfq_computation_tree *comp)
 }
 
 
+/*
+ * Runtime update of an argument: the new argument is copied from user space
+ * and the init function runs on a copy of the node arguments. The resulting
+ * state must differ from the running one in a single argument, which is then
+ * published with one store: packets are never processed with a partial update.
+ * The old state is released (fini) after a grace period by the caller.
+ */
+
+int
+pfq_computation_prepare_arg(struct pfq_computation_tree *comp, size_t index, int n,
+			    struct pfq_functional_arg_descr const *arg, struct pfq_arg_update *up)
+{
+	struct pfq_functional_node *node;
+	string_view_t sarg = make_string_view("");
+	void *context;
+	size_t size;
+	int i, slot = -1;
+
+	if (index >= comp->size || n < 0 || n >= 8)
+		return -EINVAL;
+
+	node = &comp->node[index];
+
+	if (node->init && !node->initialized)
+		return -EINVAL;
+
+	/* only the data arguments bound before the SkBuff can be updated */
+
+	for(i = 0; i <= n; i++)
+	{
+		sarg = pfq_signature_arg(make_string_view(node->signature), i);
+		if (string_view_empty(sarg) || string_view_compare(sarg, "SkBuff") == 0) {
+			printk(KERN_INFO "[PFQ] %zu: %s: no such argument (%d)!\n", index, node->symbol, n);
+			return -EINVAL;
+		}
+	}
+
+	if (pfq_signature_is_function(sarg) ||
+	    (arg->nelem > 65536 && arg->nelem != -1) ||
+	    check_argument_descr(arg, sarg) != 0) {
+		printk(KERN_INFO "[PFQ] %zu: %s: invalid argument %d, expected " SVIEW_FMT "!\n", index, node->symbol, n, SVIEW_ARG(sarg));
+		return -EINVAL;
+	}
+
+	size = argument_size(arg);
+	if (size) {
+		up->mem = kmalloc(size, GFP_KERNEL);
+		if (up->mem == NULL)
+			return -ENOMEM;
+	}
+	else
+		up->mem = NULL;
+
+	up->node = node;
+	up->arg  = n;
+	up->fun.ptr = node->fun.ptr;
+	memcpy(up->fun.arg, node->init_arg, sizeof(up->fun.arg));
+
+	context = up->mem;
+	if (link_argument(&up->fun.arg[n], arg, &context) < 0)
+		goto error;
+
+	up->init_arg = up->fun.arg[n];
+
+	/* a vector read by the function itself cannot change its length */
+
+	if (!node->init && up->fun.arg[n].nelem != node->fun.arg[n].nelem) {
+		printk(KERN_INFO "[PFQ] %zu: %s: the length of argument %d cannot change!\n", index, node->symbol, n);
+		goto error;
+	}
+
+	if (node->init && node->init(&up->fun) < 0) {
+		printk(KERN_INFO "[PFQ] %zu: %s: init error, argument %d not updated!\n", index, node->symbol, n);
+		goto error;
+	}
+
+	for(i = 0; i < sizeof(up->fun.arg)/sizeof(up->fun.arg[0]); i++)
+	{
+		if (up->fun.arg[i].value == node->fun.arg[i].value)
+			continue;
+
+		if (slot != -1) {
+			printk(KERN_INFO "[PFQ] %zu: %s: argument %d cannot be updated at runtime!\n", index, node->symbol, n);
+			if (node->fini)
+				node->fini(&up->fun);
+			goto error;
+		}
+
+		slot = i;
+	}
+
+	up->slot = slot != -1 ? slot : n;
+	return 0;
+
+error:
+	kfree(up->mem);
+	return -EPERM;
+}
+
+
+void
+pfq_computation_commit_arg(struct pfq_arg_update *up)
+{
+	struct pfq_functional_node *node = up->node;
+	struct pfq_functional_arg old = node->fun.arg[up->slot];
+	void *old_mem = node->arg_mem[up->arg];
+
+	smp_wmb();	/* the new state is visible before the argument that refers to it */
+
+	ACCESS_ONCE(node->fun.arg[up->slot].value) = up->fun.arg[up->slot].value;
+	node->fun.arg[up->slot].nelem = up->fun.arg[up->slot].nelem;
+
+	node->init_arg[up->arg] = up->init_arg;
+	node->arg_mem[up->arg]  = up->mem;
+	node->version++;
+
+	/* from now on the update holds the old state */
+
+	up->fun.arg[up->slot] = old;
+	up->mem = old_mem;
+}
+
+
+void
+pfq_computation_release_arg(struct pfq_arg_update *up)
+{
+	if (up->node->fini && up->node->initialized)
+		up->node->fini(&up->fun);
+
+	kfree(up->mem);
+}
+
+
 static struct pfq_functional_node *
 get_functional_by_index(struct pfq_computation_descr const *descr, struct pfq_computation_tree *comp, int index)
 {
@@ -501,6 +783,106 @@ get_functional_by_index(struct pfq_computation_descr const *descr, struct pfq_co
 }
 
 
+/*
+ * Copy a data argument from user space into the context memory.
+ */
+
+static int
+link_argument(struct pfq_functional_arg *out, struct pfq_functional_arg_descr const *arg, void **context)
+{
+	if (is_arg_string(arg)) {
+
+		char *str = pod_user(context, arg->addr, strlen_user(arg->addr));
+		if (str == NULL) {
+			printk(KERN_INFO "[PFQ] pod_user(1): internal error!\n");
+			return -EPERM;
+		}
+
+		out->value = (ptrdiff_t)str;
+		out->nelem = -1;
+	}
+	else if (is_arg_vector_str(arg)) {
+
+		char **base_ptr, **ptr;
+		char *str;
+		size_t j;
+
+		base_ptr = ptr = (char **)*context;
+
+		*context += sizeof(char *) * arg->nelem;
+
+		str = pod_user(context, arg->addr, strlen_user(arg->addr));
+		if (str == NULL) {
+			printk(KERN_INFO "[PFQ] pod_user(2): internal error!\n");
+			return -EPERM;
+		}
+
+		for(j = 0; j < arg->nelem; j++)
+		{
+			char *end;
+			*(ptr++) = str;
+			end = strchr(str, '\x1e');
+			if (end == NULL)
+				break;
+			*end = '\0';
+			str = end+1;
+		}
+
+		out->value = (ptrdiff_t)base_ptr;
+		out->nelem = arg->nelem;
+	}
+	else if (is_arg_data(arg)) {
+
+		if (arg->size > 8) {
+
+			char *ptr = pod_user(context, arg->addr, arg->size);
+			if (ptr == NULL) {
+				printk(KERN_INFO "[PFQ] pod_user(3): internal error!\n");
+				return -EPERM;
+			}
+
+			out->value = (ptrdiff_t)ptr;
+			out->nelem = -1;
+		}
+		else {
+			ptrdiff_t value = 0;
+
+			if (copy_from_user(&value, arg->addr, arg->size)) {
+				printk(KERN_INFO "[PFQ] copy_from_user: internal error!\n");
+				return -EPERM;
+			}
+
+			out->value = value;
+			out->nelem = -1;
+		}
+
+	}
+	else if (is_arg_vector(arg)) {
+
+		if (arg->nelem > 0) {
+
+			char *ptr = pod_user(context, arg->addr, arg->size * arg->nelem);
+			if (ptr == NULL) {
+				printk(KERN_INFO "[PFQ] pod_user(4): internal error!\n");
+				return -EPERM;
+			}
+
+			out->value = (ptrdiff_t)ptr;
+			out->nelem = arg->nelem;
+		}
+		else {  /* empty vector */
+
+			out->value = 0xdeadbeef;
+			out->nelem = 0;
+		}
+	}
+	else
+		return -EPERM;
+
+	return 0;
+}
+
+
 /*
  * Prerequisite: valid computation (check by means of pfq_validate_computation_descr)
  */
@@ -517,20 +899,21 @@ pfq_computation_rtlink(struct pfq_computation_descr const *descr, struct pfq_com
         /* entry point */
 
         comp->entry_point = &comp->node[descr->entry_point];
+        comp->orig_entry_point = comp->entry_point;
 
 	/* link functions */
 
         for(n = 0; n < descr->size; n++)
         {
         	struct pfq_functional_descr const *fun;
- 		const char *signature;
+ 		const char *symbol, *signature;
         	init_ptr_t init, fini;
 		void *addr;
                 size_t i;
 
                 fun = &descr->fun[n];
 
-		addr = resolve_user_symbol(&pfq_lang_functions, fun->symbol, &signature, &init, &fini);
+		addr = resolve_user_symbol(&pfq_lang_functions, fun->symbol, &symbol, &signature, &init, &fini);
 		if (addr == NULL) {
         		printk(KERN_INFO "[PFQ] %zu: rtlink: bad descriptor!\n", n);
         		return -EPERM;
@@ -540,6 +923,10 @@ pfq_computation_rtlink(struct pfq_computation_descr const *descr, struct pfq_com
         	comp->node[n].init    = init;
         	comp->node[n].fini    = fini;
 		comp->node[n].next    = get_functional_by_index(descr, comp, descr->fun[n].next);
+		comp->node[n].symbol  = symbol;
+		comp->node[n].signature = signature;
+		comp->node[n].orig_next = comp->node[n].next;
+		comp->node[n].opt     = 0;
 
 		comp->node[n].fun.arg[0].value = 0;
 		comp->node[n].fun.arg[1].value = 0;
@@ -553,106 +940,177 @@ pfq_computation_rtlink(struct pfq_computation_descr const *descr, struct pfq_com
 
         	for(i = 0; i < sizeof(fun->arg)/sizeof(fun->arg[0]); i++)
 		{
-			if (is_arg_string(&fun->arg[i])) {
+			if (is_arg_function(&fun->arg[i])) {
+
+				comp->node[n].fun.arg[i].value = (ptrdiff_t)get_functional_by_index(descr, comp, fun->arg[i].size);
+				comp->node[n].fun.arg[i].nelem = -1;
+			}
+			else if (!is_arg_null(&fun->arg[i])) {
 
-				char *str = pod_user(&context, fun->arg[i].addr, strlen_user(fun->arg[i].addr));
-				if (str == NULL) {
-					printk(KERN_INFO "[PFQ] %zu: pod_user(1): internal error!\n", n);
+				if (link_argument(&comp->node[n].fun.arg[i], &fun->arg[i], &context) < 0) {
+					printk(KERN_INFO "[PFQ] pfq_computation_rtlink: internal error@ function:%zu argument[%zu] => { %p, %zu, %zu }!\n", n, i, (void __user *)fun->arg[i].addr, fun->arg[i].size, fun->arg[i].nelem);
 					return -EPERM;
 				}
-
-				comp->node[n].fun.arg[i].value = (ptrdiff_t)str;
-				comp->node[n].fun.arg[i].nelem = -1;
 			}
-			else if (is_arg_vector_str(&fun->arg[i])) {
+		}
+	}
 
-				char **base_ptr, **ptr;
-				char *str;
-				size_t j;
+	return 0;
+}
 
-				base_ptr = ptr = (char **)context;
 
-				context += sizeof(char *) * fun->arg[i].nelem;
 
-				str = pod_user(&context, fun->arg[i].addr, strlen_user(fun->arg[i].addr));
-				if (str == NULL) {
-					printk(KERN_INFO "[PFQ] %zu: pod_user(2): internal error!\n", n);
-					return -EPERM;
-				}
+/*
+ * PFQ/lang optimizer: the linked tree is rewritten before the init functions
+ * run. Removed nodes are bypassed, never freed, so that any reference to them
+ * stays valid; the links written by the user are kept in orig_next.
+ *
+ *  - unit is removed from monadic chains;
+ *  - adjacent filters are fused when the second implies the first
+ *    (e.g. ip >-> udp is evaluated as udp);
+ *  - the cheaper operand of and/or is evaluated first.
+ */
 
-				for(j = 0; j < fun->arg[i].nelem; j++)
-				{
-					char *end;
-					*(ptr++) = str;
-					end = strchr(str, '\x1e');
-					if (end == NULL)
-						break;
-					*end = '\0';
-					str = end+1;
-				}
+static const struct
+{
+	const char *fun;
+	const char *implies;
 
-				comp->node[n].fun.arg[i].value = (ptrdiff_t)base_ptr;
-				comp->node[n].fun.arg[i].nelem = fun->arg[i].nelem;
-			}
-			else if (is_arg_data(&fun->arg[i])) {
+} filter_implies[] =
+{
+	{ "udp",   "ip"   },
+	{ "tcp",   "ip"   },
+	{ "icmp",  "ip"   },
+	{ "flow",  "ip"   },
+	{ "udp",   "flow" },
+	{ "tcp",   "flow" },
+	{ "udp6",  "ip6"  },
+	{ "tcp6",  "ip6"  },
+	{ "icmp6", "ip6"  },
+};
 
-				if (fun->arg[i].size > 8) {
 
-					char *ptr = pod_user(&context, fun->arg[i].addr, fun->arg[i].size);
-					if (ptr == NULL) {
-						printk(KERN_INFO "[PFQ] %zu: pod_user(3): internal error!\n", n);
-						return -EPERM;
-					}
+static bool
+opt_filter_implies(struct pfq_functional_node const *a, struct pfq_functional_node const *b)
+{
+	size_t n;
 
-					comp->node[n].fun.arg[i].value = (ptrdiff_t)ptr;
-					comp->node[n].fun.arg[i].nelem = -1;
-				}
-				else {
-					ptrdiff_t arg = 0;
+	for(n = 0; n < sizeof(filter_implies)/sizeof(filter_implies[0]); n++)
+	{
+		if (strcmp(filter_implies[n].implies, b->symbol) == 0 &&
+		    strcmp(filter_implies[n].fun, a->symbol) == 0)
+			return true;
+	}
 
-					if (copy_from_user(&arg, fun->arg[i].addr, fun->arg[i].size)) {
-						printk(KERN_INFO "[PFQ] %zu: copy_from_user: internal error!\n", n);
-						return -EPERM;
-					}
+	/* ip >-> ip and the like: only for filters without arguments */
 
-					comp->node[n].fun.arg[i].value = arg;
-					comp->node[n].fun.arg[i].nelem = -1;
-				}
+	return strcmp(a->symbol, b->symbol) == 0 &&
+		(strcmp(a->symbol, "ip") == 0 || strcmp(a->symbol, "ip6") == 0 ||
+		 strcmp(a->symbol, "flow") == 0 || strcmp(a->symbol, "vlan") == 0);
+}
 
-			}
-			else if (is_arg_vector(&fun->arg[i])) {
 
-				if (fun->arg[i].nelem > 0) {
+static struct pfq_functional_node *
+opt_skip(struct pfq_functional_node *node)
+{
+	while (node && (node->opt & Q_OPT_REMOVED))
+		node = node->next;
+	return node;
+}
 
-					char *ptr = pod_user(&context, fun->arg[i].addr, fun->arg[i].size * fun->arg[i].nelem);
-					if (ptr == NULL) {
-						printk(KERN_INFO "[PFQ] %zu: pod_user(4): internal error!\n", n);
-						return -EPERM;
-					}
 
-					comp->node[n].fun.arg[i].value = (ptrdiff_t)ptr;
-					comp->node[n].fun.arg[i].nelem = fun->arg[i].nelem;
-				}
-				else {  /* empty vector */
+/* static cost of a predicate: sub-expressions are included */
 
-					comp->node[n].fun.arg[i].value = 0xdeadbeef;
-					comp->node[n].fun.arg[i].nelem = 0;
-				}
-			}
-			else if (is_arg_function(&fun->arg[i])) {
+static int
+opt_cost(struct pfq_computation_descr const *descr, struct pfq_computation_tree const *comp, size_t n, int depth)
+{
+	struct pfq_functional_descr const *fun = &descr->fun[n];
+	size_t i, nargs = pfq_number_of_arguments(fun);
+	int cost;
 
-				comp->node[n].fun.arg[i].value = (ptrdiff_t)get_functional_by_index(descr, comp, fun->arg[i].size);
-				comp->node[n].fun.arg[i].nelem = -1;
-			}
-			else if (!is_arg_null(&fun->arg[i])) {
+	cost = strncmp(comp->node[n].symbol, "bloom", 5) == 0 ? 16 : nargs == 0 ? 1 : 2;
 
-				printk(KERN_INFO "[PFQ] pfq_computation_rtlink: internal error@ function:%zu argument[%zu] => { %p, %zu, %zu }!\n", n, i, (void __user *)fun->arg[i].addr, fun->arg[i].size, fun->arg[i].nelem);
-				return -EPERM;
+	if (depth > 8)
+		return cost;
+
+	for(i = 0; i < nargs; i++)
+	{
+		if (is_arg_function(&fun->arg[i]))
+			cost += opt_cost(descr, comp, fun->arg[i].size, depth + 1);
+	}
+
+	return cost;
+}
+
+
+void
+pfq_computation_optimize(struct pfq_computation_descr const *descr, struct pfq_computation_tree *comp)
+{
+	size_t n;
+
+	/* remove unit and the filters implied by the following one */
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_functional_node *node = &comp->node[n];
+
+		if (node->next && strcmp(node->symbol, "unit") == 0)
+			node->opt |= Q_OPT_REMOVED;
+	}
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_functional_node *node = &comp->node[n], *next;
+
+		if (node->opt & Q_OPT_REMOVED)
+			continue;
+
+		next = opt_skip(node->next);
+		if (next && opt_filter_implies(next, node))
+			node->opt |= Q_OPT_REMOVED;
+	}
+
+	/* relink: chain heads are never left empty */
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_functional_descr const *fun = &descr->fun[n];
+		struct pfq_functional_node *node = &comp->node[n];
+		size_t i;
+
+		node->next = opt_skip(node->next);
+
+        	for(i = 0; i < sizeof(fun->arg)/sizeof(fun->arg[0]); i++)
+		{
+			if (is_arg_function(&fun->arg[i])) {
+				struct pfq_functional_node *arg = opt_skip((struct pfq_functional_node *)node->fun.arg[i].value);
+				if (arg)
+					node->fun.arg[i].value = (ptrdiff_t)arg;
 			}
 		}
 	}
 
-	return 0;
-}
+	if (opt_skip(comp->entry_point))
+		comp->entry_point = opt_skip(comp->entry_point);
+
+	/* hoist the cheaper predicate of and/or */
+
+	for(n = 0; n < comp->size; n++)
+	{
+		struct pfq_functional_descr const *fun = &descr->fun[n];
+		struct pfq_functional_node *node = &comp->node[n];
+		ptrdiff_t tmp;
 
+		if (strcmp(node->symbol, "and") != 0 && strcmp(node->symbol, "or") != 0)
+			continue;
 
+		if (opt_cost(descr, comp, fun->arg[1].size, 0) >= opt_cost(descr, comp, fun->arg[0].size, 0))
+			continue;
+
+		tmp = node->fun.arg[0].value;
+		node->fun.arg[0].value = node->fun.arg[1].value;
+		node->fun.arg[1].value = tmp;
+
+		node->opt |= Q_OPT_SWAPPED;
+	}
+}
@@ -61,6 +61,19 @@ static inline bool is_arg_function(struct pfq_functional_arg_descr const *arg)
 }
 
 
+/* runtime update of an argument of a running function */
+
+struct pfq_arg_update
+{
+	struct pfq_functional_node *	node;
+	int				arg;		/* argument replaced by the user */
+	int				slot;		/* argument changed in the running node */
+	struct pfq_functional_arg	init_arg;	/* the new argument, as passed to init */
+	struct pfq_functional		fun;		/* arguments of the new (or, once committed, the old) state */
+	void *				mem;
+};
+
+
 extern int pfq_check_computation_descr(struct pfq_computation_descr const *descr);
 
 extern int pfq_computation_rtlink(struct pfq_computation_descr const *descr, struct pfq_computation_tree *comp, void *context);
@@ -68,6 +81,12 @@ extern int pfq_computation_init(struct pfq_computation_tree *comp);
 extern int pfq_computation_fini(struct pfq_computation_tree *comp);
 
 extern struct pfq_computation_tree * pfq_computation_alloc(struct pfq_computation_descr const *);
+extern void pfq_computation_free(struct pfq_computation_tree *comp);
+extern void pfq_computation_optimize(struct pfq_computation_descr const *descr, struct pfq_computation_tree *comp);
+extern int  pfq_computation_prepare_arg(struct pfq_computation_tree *comp, size_t index, int n, struct pfq_functional_arg_descr const *arg, struct pfq_arg_update *up);
+extern void pfq_computation_commit_arg(struct pfq_arg_update *up);
+extern void pfq_computation_release_arg(struct pfq_arg_update *up);
+extern void pfq_computation_stats(struct pfq_computation_tree const *comp, size_t index, struct pfq_lang_node_stats *ret);
 extern void * pfq_context_alloc(struct pfq_computation_descr const *);
 extern const char *pfq_signature_by_user_symbol(const char __user *symb);
 extern size_t pfq_number_of_arguments(struct pfq_functional_descr const *fun);
@@ -75,6 +94,7 @@ extern size_t pfq_number_of_arguments(struct pfq_functional_descr const *fun);
 extern char * strdup_user(const char __user *str);
 
 extern Action_SkBuff pfq_run(struct pfq_computation_tree *prg, SkBuff);
+extern void pfq_run_batch(struct pfq_computation_tree *prg, struct gc_queue_buff *buffs, unsigned long long *live);
 
 
 
@@ -0,0 +1,308 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/bottom_half.h>
+
+#include <pf_q-flow.h>
+#include <pf_q-parse.h>
+
+
+#define FLOW_EXPIRE_PERIOD	HZ
+
+
+static void
+pfq_flow_export(struct pfq_flow_track *ft, struct pfq_flow_record *rec, int reason)
+{
+        struct pfq_flow_ring *ring = ft->ring;
+        u64 prod;
+
+        spin_lock(&ft->ring_lock);
+
+        /* the ring is writable by user-space: only cons is read from it, and
+         * bounded by the private size (a bogus cons looks like a full ring) */
+
+        prod = ft->ring_prod;
+
+        if (prod - ACCESS_ONCE(ring->cons) >= ft->ring_size) {
+                ring->drop = ++ft->ring_drop;
+        }
+        else {
+                ring->record[prod & (ft->ring_size - 1)] = *rec;
+                ring->record[prod & (ft->ring_size - 1)].reason = reason;
+                smp_wmb();
+                ft->ring_prod = prod + 1;
+                ring->prod = ft->ring_prod;
+        }
+
+        spin_unlock(&ft->ring_lock);
+
+        rec->packets = 0;
+}
+
+
+static inline bool
+pfq_flow_expired(struct pfq_flow_track *ft, struct pfq_flow_record *rec, u64 now, int *reason)
+{
+        if (now - rec->last >= ft->idle_timeout) {
+                *reason = Q_FLOW_END_IDLE;
+                return true;
+        }
+        if (now - rec->first >= ft->active_timeout) {
+                *reason = Q_FLOW_END_ACTIVE;
+                return true;
+        }
+        return false;
+}
+
+
+static inline bool
+pfq_flow_match(struct pfq_flow_record const *a, struct pfq_flow_record const *b)
+{
+        return  a->saddr == b->saddr && a->daddr == b->daddr &&
+                a->sport == b->sport && a->dport == b->dport && a->proto == b->proto;
+}
+
+
+void
+pfq_flow_track_update(struct pfq_flow_track *ft, struct sk_buff *skb)
+{
+        struct pfq_flow_table *t = ft->table[smp_processor_id()];
+        struct pfq_flow_record key, *rec, *victim = NULL;
+        const struct iphdr *ip;
+        struct iphdr _iph;
+        uint8_t flags = 0;
+        size_t n, i;
+        int reason;
+        u64 now;
+
+        ip = pfq_ip_hdr(skb, &_iph);
+        if (ip == NULL)
+                return;
+
+        memset(&key, 0, sizeof(key));
+
+        key.saddr = ip->saddr;
+        key.daddr = ip->daddr;
+        key.proto = ip->protocol;
+
+        if (ip->protocol == IPPROTO_TCP) {
+                struct tcphdr _tcph;
+                const struct tcphdr *tcp = pfq_l4_hdr(skb, Q_HDR_IP, IPPROTO_TCP, &_tcph);
+                if (tcp) {
+                        key.sport = tcp->source;
+                        key.dport = tcp->dest;
+                        flags = tcp_flag_byte(tcp);
+                }
+        }
+        else if (ip->protocol == IPPROTO_UDP) {
+                struct udphdr _udph;
+                const struct udphdr *udp = pfq_l4_hdr(skb, Q_HDR_IP, IPPROTO_UDP, &_udph);
+                if (udp) {
+                        key.sport = udp->source;
+                        key.dport = udp->dest;
+                }
+        }
+
+        now = ktime_to_ns(skb_get_ktime(skb));
+        if (unlikely(now == 0))
+                now = ktime_to_ns(ktime_get_real());
+
+        i = jhash_3words(key.saddr, key.daddr, ((u32)key.sport << 16 | key.dport) ^ key.proto, 0) & (ft->size - 1);
+
+        for(n = 0; n < Q_FLOW_PROBE; n++, i = (i + 1) & (ft->size - 1))
+        {
+                rec = &t->entry[i];
+
+                if (rec->packets == 0)
+                        goto init;
+
+                if (pfq_flow_match(rec, &key)) {
+
+                        /* a stale record of the same flow: export it and start over */
+
+                        if (pfq_flow_expired(ft, rec, now, &reason)) {
+                                pfq_flow_export(ft, rec, reason);
+                                goto init;
+                        }
+
+                        goto update;
+                }
+
+                if (victim == NULL || rec->last < victim->last)
+                        victim = rec;
+        }
+
+        /* the probe sequence is full: evict the least recently seen flow */
+
+        rec = victim;
+        pfq_flow_export(ft, rec, Q_FLOW_END_EVICTED);
+init:
+        *rec = key;
+        rec->first = now;
+update:
+        rec->packets++;
+        rec->bytes += skb->len;
+        rec->tcp_flags |= flags;
+        rec->last = now;
+}
+
+
+static void
+pfq_flow_expire_work(struct work_struct *work)
+{
+        struct pfq_flow_table *t = container_of(to_delayed_work(work), struct pfq_flow_table, expire);
+        struct pfq_flow_track *ft = t->ft;
+        int reason;
+        size_t i;
+        u64 now;
+
+        /* the table is updated in softirq by its own cpu only: scan it there, with bh disabled */
+
+        local_bh_disable();
+
+        if (likely(smp_processor_id() == t->cpu)) {
+
+                now = ktime_to_ns(ktime_get_real());
+
+                for(i = 0; i < ft->size; i++)
+                {
+                        struct pfq_flow_record *rec = &t->entry[i];
+
+                        if (rec->packets && pfq_flow_expired(ft, rec, now, &reason))
+                                pfq_flow_export(ft, rec, reason);
+                }
+        }
+
+        local_bh_enable();
+
+        schedule_delayed_work_on(t->cpu, &t->expire, FLOW_EXPIRE_PERIOD);
+}
+
+
+struct pfq_flow_track *
+pfq_flow_track_alloc(size_t size, size_t ring, int idle_timeout, int active_timeout)
+{
+        struct pfq_flow_track *ft;
+        int cpu;
+
+        if (size == 0 || size > Q_MAX_FLOW_TABLE_SIZE)
+                return NULL;
+
+        if (ring == 0 || ring > Q_MAX_FLOW_RING_SIZE || !is_power_of_2(ring))
+                return NULL;
+
+        if (idle_timeout <= 0 || active_timeout <= 0)
+                return NULL;
+
+        size = max_t(size_t, roundup_pow_of_two(size), Q_FLOW_PROBE);
+
+        ft = kzalloc(sizeof(*ft) + nr_cpu_ids * sizeof(ft->table[0]), GFP_KERNEL);
+        if (!ft)
+                return NULL;
+
+        ft->size = size;
+        ft->idle_timeout = (u64)idle_timeout * NSEC_PER_SEC;
+        ft->active_timeout = (u64)active_timeout * NSEC_PER_SEC;
+
+        spin_lock_init(&ft->ring_lock);
+
+        ft->ring_mem = PAGE_ALIGN(Q_FLOW_RING_MEM(ring));
+        ft->ring = vmalloc_user(ft->ring_mem);
+        if (!ft->ring) {
+                kfree(ft);
+                return NULL;
+        }
+
+        ft->ring_size = ring;
+        ft->ring->size = ring;
+
+        for_each_possible_cpu(cpu)
+        {
+                struct pfq_flow_table *t;
+
+                t = vzalloc_node(sizeof(struct pfq_flow_table) + size * sizeof(struct pfq_flow_record), cpu_to_node(cpu));
+                if (!t) {
+                        pfq_flow_track_free(ft);
+                        return NULL;
+                }
+
+                t->ft = ft;
+                t->cpu = cpu;
+                INIT_DELAYED_WORK(&t->expire, pfq_flow_expire_work);
+
+                ft->table[cpu] = t;
+        }
+
+        for_each_online_cpu(cpu)
+                schedule_delayed_work_on(cpu, &ft->table[cpu]->expire, FLOW_EXPIRE_PERIOD);
+
+        return ft;
+}
+
+
+/* to be called once no reader can refer to the flow table (after a grace period) */
+
+void
+pfq_flow_track_free(struct pfq_flow_track *ft)
+{
+        size_t i;
+        int cpu;
+
+        if (!ft)
+                return;
+
+        for_each_possible_cpu(cpu)
+        {
+                if (ft->table[cpu])
+                        cancel_delayed_work_sync(&ft->table[cpu]->expire);
+        }
+
+        /* export the active flows: the ring outlives this table as long as it is mapped */
+
+        for_each_possible_cpu(cpu)
+        {
+                struct pfq_flow_table *t = ft->table[cpu];
+                if (!t)
+                        continue;
+
+                for(i = 0; i < ft->size; i++)
+                {
+                        if (t->entry[i].packets)
+                                pfq_flow_export(ft, &t->entry[i], Q_FLOW_END_FLUSH);
+                }
+
+                vfree(t);
+        }
+
+        vfree(ft->ring);
+        kfree(ft);
+}
@@ -0,0 +1,91 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#ifndef PF_Q_FLOW_H
+#define PF_Q_FLOW_H
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/skbuff.h>
+
+#include <linux/pf_q.h>
+
+
+/*
+ * Flow tracking (NetFlow-like accounting) of IPv4 packets.
+ *
+ * A flow table holds one open-addressing table of 5-tuples per cpu, updated
+ * by its own cpu only: packets, bytes, first/last timestamp and TCP flags.
+ * A record is exported to the ring when the flow exceeds the active timeout,
+ * when it is found idle (on a lookup or by the per-cpu expiry work, run every
+ * second on the cpu of the table with bottom halves disabled) or when it is
+ * evicted because its probe sequence is full.
+ *
+ * The ring is vmalloc'd and mapped by user-space (Q_FLOW_RING_PGOFF), which
+ * drains it by advancing cons; producers (the cpus) serialize on ring_lock.
+ * The kernel keeps its own size and prod: the mapping is writable, only cons
+ * is taken from it.
+ */
+
+#define Q_FLOW_PROBE		8
+
+
+struct pfq_flow_track;
+
+struct pfq_flow_table
+{
+        struct delayed_work     expire;
+        struct pfq_flow_track * ft;
+        int                     cpu;
+
+        struct pfq_flow_record  entry[];        /* packets == 0: empty */
+};
+
+
+struct pfq_flow_track
+{
+        size_t                  size;           /* flows per cpu, power of 2 */
+        u64                     idle_timeout;   /* nsec */
+        u64                     active_timeout; /* nsec */
+
+        spinlock_t              ring_lock;
+        struct pfq_flow_ring *  ring;           /* shared with user-space */
+        size_t                  ring_mem;
+        size_t                  ring_size;      /* records, power of 2 (private copy) */
+        u64                     ring_prod;      /* private copies of prod and drop */
+        u64                     ring_drop;
+
+        struct pfq_flow_table * table[];        /* nr_cpu_ids */
+};
+
+
+extern struct pfq_flow_track * pfq_flow_track_alloc(size_t size, size_t ring, int idle_timeout, int active_timeout);
+extern void pfq_flow_track_free(struct pfq_flow_track *ft);
+
+extern void pfq_flow_track_update(struct pfq_flow_track *ft, struct sk_buff *skb);
+
+
+#endif /* PF_Q_FLOW_H */
@@ -40,6 +40,13 @@ int cap_len      	= 1514;
 int max_len      	= 1514;
 
 int batch_len 		= 1;
+int batch_timeout 	= 1000;		/* max delay (usec) of a partial batch */
+int batch_adaptive 	= 0;
+int lang_batch 		= 0;		/* batch-at-a-time PFQ/lang evaluation */
+int steer_hash 		= 1;		/* steering hash: 0 = xor, 1 = symmetric jhash, 2 = NIC hash if available */
+int lang_hdr_cache 	= 1;		/* share parsed headers among PFQ/lang functions */
+int lang_profile 	= 0;		/* per-node PFQ/lang profiling counters */
+int lang_optimize 	= 1;		/* rewrite PFQ/lang computations at load time */
 int vl_untag     	= 0;
 
 int skb_pool_size 	= 1024;
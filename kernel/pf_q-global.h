@@ -42,6 +42,13 @@ extern int cap_len;
 extern int max_len;
 
 extern int batch_len;
+extern int batch_timeout;
+extern int batch_adaptive;
+extern int lang_batch;
+extern int steer_hash;
+extern int lang_hdr_cache;
+extern int lang_profile;
+extern int lang_optimize;
 
 extern int vl_untag;
 
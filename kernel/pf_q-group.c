@@ -27,11 +27,18 @@
 #include <linux/module.h>
 #include <linux/semaphore.h>
 #include <linux/sched.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
+#include <linux/vmalloc.h>
 
 #include <pf_q-group.h>
 #include <pf_q-devmap.h>
 #include <pf_q-bitops.h>
 #include <pf_q-engine.h>
+#include <pf_q-steering.h>
+#include <pf_q-state.h>
+#include <pf_q-flow.h>
+#include <pf_q-sketch.h>
 
 
 DEFINE_SEMAPHORE(group_sem);
@@ -82,13 +89,28 @@ __pfq_group_init(int gid)
 
         for(i = 0; i < Q_CLASS_MAX; i++)
         {
-                atomic_long_set(&g->sock_mask[i], 0);
+                size_t w;
+                for(w = 0; w < Q_MAX_ID_WORDS; w++)
+                        atomic_long_set(&g->sock_mask[i][w], 0);
         }
 
         atomic_long_set(&g->bp_filter,0L);
         atomic_long_set(&g->comp,     0L);
         atomic_long_set(&g->comp_ctx, 0L);
 
+        g->steering = Q_STEERING_FOLD;
+        atomic_long_set(&g->steering_table, 0L);
+
+        g->spill = Q_SPILL_NONE;
+        g->spill_threshold = Q_SPILL_THRESHOLD_DEFAULT;
+        atomic_long_set(&g->spill_flows, 0L);
+
+        for(i = 0; i < Q_MAX_STATE_MAPS; i++)
+                atomic_long_set(&g->state_map[i], 0L);
+
+        atomic_long_set(&g->flow_track, 0L);
+        atomic_long_set(&g->sketch, 0L);
+
 	pfq_group_stats_reset(&g->stats);
 
         for(i = 0; i < Q_MAX_COUNTERS; i++)
@@ -104,13 +126,122 @@ __pfq_group_init(int gid)
 }
 
 
+/* counters and stats of groups are allocated once, when the module is loaded */
+
+int pfq_groups_init(void)
+{
+        int n;
+
+        for(n = 0; n < Q_MAX_GROUP; n++)
+        {
+                struct pfq_group *g = &pfq_groups[n];
+
+                if (pfq_stats_alloc(&g->stats))
+                        goto err;
+
+                if (sparse_alloc_n(g->context.counter, Q_MAX_COUNTERS)) {
+                        pfq_stats_free(&g->stats);
+                        goto err;
+                }
+        }
+
+        return 0;
+err:
+        printk(KERN_INFO "[PFQ] groups: could not allocate counters!\n");
+
+        while (n--)
+        {
+                pfq_stats_free(&pfq_groups[n].stats);
+                sparse_free_n(pfq_groups[n].context.counter, Q_MAX_COUNTERS);
+        }
+        return -ENOMEM;
+}
+
+
+void pfq_groups_fini(void)
+{
+        int n;
+
+        for(n = 0; n < Q_MAX_GROUP; n++)
+        {
+                pfq_stats_free(&pfq_groups[n].stats);
+                sparse_free_n(pfq_groups[n].context.counter, Q_MAX_COUNTERS);
+        }
+}
+
+
+/* the state of a released group is freed once no reader can refer to it */
+
+struct pfq_group_release
+{
+        struct rcu_head                 rcu;
+        struct work_struct              work;
+
+        struct sk_filter *              filter;
+        struct pfq_computation_tree *   comp;
+        void *                          ctx;
+        struct pfq_steering_table *     table;
+        void *                          flows;
+        struct pfq_state_map *          maps[Q_MAX_STATE_MAPS];
+        struct pfq_flow_track *         flow_track;
+        struct pfq_sketch *             sketch;
+};
+
+
+static void
+__pfq_group_release(struct pfq_group_release *r)
+{
+        int n;
+
+	/* call fini on old computation */
+
+	if (r->comp)
+ 		pfq_computation_fini(r->comp);
+
+        pfq_computation_free(r->comp);
+        kfree(r->ctx);
+        kfree(r->table);
+        kfree(r->flows);
+
+        for(n = 0; n < Q_MAX_STATE_MAPS; n++)
+                pfq_state_map_free(r->maps[n]);
+
+        pfq_flow_track_free(r->flow_track);
+        pfq_sketch_free(r->sketch);
+
+	if (r->filter)
+        	pfq_free_sk_filter(r->filter);
+}
+
+
+static void
+pfq_group_release_work(struct work_struct *work)
+{
+        struct pfq_group_release *r = container_of(work, struct pfq_group_release, work);
+
+        __pfq_group_release(r);
+        kfree(r);
+}
+
+
+static void
+pfq_group_release_rcu(struct rcu_head *rcu)
+{
+        struct pfq_group_release *r = container_of(rcu, struct pfq_group_release, rcu);
+
+        /* fini functions may sleep: user-context */
+
+        INIT_WORK(&r->work, pfq_group_release_work);
+        schedule_work(&r->work);
+}
+
+
 static void
 __pfq_group_free(int gid)
 {
         struct pfq_group * g = pfq_get_group(gid);
-        struct sk_filter *filter;
-        struct pfq_computation_tree *old_comp;
-        void *old_ctx;
+        struct pfq_group_release tmp, *r;
+        int n;
 
         if (!g)
                 return;
@@ -123,28 +254,68 @@ __pfq_group_free(int gid)
         g->owner = -1;
         g->policy = Q_POLICY_GROUP_UNDEFINED;
 
-        filter   = (struct sk_filter *)atomic_long_xchg(&g->bp_filter, 0L);
-        old_comp = (struct pfq_computation_tree *)atomic_long_xchg(&g->comp, 0L);
-        old_ctx  = (void *)atomic_long_xchg(&g->comp_ctx, 0L);
+        r = kmalloc(sizeof(struct pfq_group_release), GFP_KERNEL);
+        if (r == NULL)
+                r = &tmp;
 
-        msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
+        r->filter = (struct sk_filter *)atomic_long_xchg(&g->bp_filter, 0L);
+        r->comp   = (struct pfq_computation_tree *)atomic_long_xchg(&g->comp, 0L);
+        r->ctx    = (void *)atomic_long_xchg(&g->comp_ctx, 0L);
+        r->table  = (struct pfq_steering_table *)atomic_long_xchg(&g->steering_table, 0L);
+        r->flows  = (void *)atomic_long_xchg(&g->spill_flows, 0L);
 
-	/* call fini on old computation */
+        for(n = 0; n < Q_MAX_STATE_MAPS; n++)
+                r->maps[n] = (struct pfq_state_map *)atomic_long_xchg(&g->state_map[n], 0L);
 
-	if (old_comp)
- 		pfq_computation_fini(old_comp);
+        r->flow_track = (struct pfq_flow_track *)atomic_long_xchg(&g->flow_track, 0L);
+        r->sketch = (struct pfq_sketch *)atomic_long_xchg(&g->sketch, 0L);
 
-        kfree(old_comp);
-        kfree(old_ctx);
+        g->steering = Q_STEERING_FOLD;
+        g->spill = Q_SPILL_NONE;
+
+        /* release the old state asynchronously: leaving a group does not wait */
 
-	if (filter)
-        	pfq_free_sk_filter(filter);
+        if (r != &tmp)
+                call_rcu(&r->rcu, pfq_group_release_rcu);
+        else {
+                synchronize_rcu();
+                __pfq_group_release(r);
+        }
 
         g->vlan_filt = false;
         pr_devel("[PFQ] group %d destroyed.\n", gid);
 }
 
 
+/* rebuild the consistent steering table of the group (with group_sem held) */
+
+static void
+__pfq_group_steering_update(int gid)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_steering_table *table = NULL, *old_table;
+        unsigned long mask[Q_MAX_ID_WORDS];
+
+        if (!g)
+                return;
+
+        if (g->steering == Q_STEERING_CONSISTENT) {
+
+                __pfq_get_all_groups_mask(gid, mask);
+
+                table = pfq_steering_table_build(mask);
+                if (!table && !pfq_bitmap_empty(mask, Q_MAX_ID_WORDS))
+                        printk(KERN_INFO "[PFQ] group %d: could not build the steering table (fold steering in use)!\n", gid);
+        }
+
+        old_table = (struct pfq_steering_table *)atomic_long_xchg(&g->steering_table, (long)table);
+        if (old_table) {
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
+                kfree(old_table);
+        }
+}
+
+
 static int
 __pfq_join_group(int gid, int id, unsigned long class_mask, int policy)
 {
@@ -168,9 +339,9 @@ __pfq_join_group(int gid, int id, unsigned long class_mask, int policy)
         pfq_bitwise_foreach(class_mask, bit,
         {
                  int class = pfq_ctz(bit);
-                 tmp = atomic_long_read(&g->sock_mask[class]);
-                 tmp |= 1L << id;
-                 atomic_long_set(&g->sock_mask[class], tmp);
+                 tmp = atomic_long_read(&g->sock_mask[class][BIT_WORD(id)]);
+                 tmp |= BIT_MASK(id);
+                 atomic_long_set(&g->sock_mask[class][BIT_WORD(id)], tmp);
         })
 
 	if (g->owner == -1) {
@@ -181,6 +352,9 @@ __pfq_join_group(int gid, int id, unsigned long class_mask, int policy)
 		g->policy = policy;
 	}
 
+        if (g->steering != Q_STEERING_FOLD)
+                __pfq_group_steering_update(gid);
+
         return 0;
 }
 
@@ -200,32 +374,35 @@ __pfq_leave_group(int gid, int id)
 
         for(i = 0; i < Q_CLASS_MAX; ++i)
         {
-                tmp = atomic_long_read(&g->sock_mask[i]);
-                tmp &= ~(1L << id);
-                atomic_long_set(&g->sock_mask[i], tmp);
+                tmp = atomic_long_read(&g->sock_mask[i][BIT_WORD(id)]);
+                tmp &= ~BIT_MASK(id);
+                atomic_long_set(&g->sock_mask[i][BIT_WORD(id)], tmp);
         }
 
         if (__pfq_group_is_empty(gid))
                 __pfq_group_free(gid);
+        else if (g->steering != Q_STEERING_FOLD)
+                __pfq_group_steering_update(gid);
 
         return 0;
 }
 
-unsigned long
-__pfq_get_all_groups_mask(int gid)
+void
+__pfq_get_all_groups_mask(int gid, unsigned long *mask)
 {
         struct pfq_group * g = pfq_get_group(gid);
-        unsigned long mask = 0;
-        int i;
+        size_t i, w;
+
+        pfq_bitmap_zero(mask, Q_MAX_ID_WORDS);
 
         if (!g)
-                return mask;
+                return;
 
         for(i = 0; i < Q_CLASS_MAX; ++i)
         {
-                mask |= atomic_long_read(&g->sock_mask[i]);
+                for(w = 0; w < Q_MAX_ID_WORDS; w++)
+                        mask[w] |= atomic_long_read(&g->sock_mask[i][w]);
         }
-        return mask;
 }
 
 
@@ -241,10 +418,10 @@ void __pfq_set_group_filter(int gid, struct sk_filter *filter)
 
         old_filter = (void *)atomic_long_xchg(&g->bp_filter, (long)filter);
 
-        msleep(Q_GRACE_PERIOD);
-
-	if (old_filter)
+	if (old_filter) {
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
         	pfq_free_sk_filter(old_filter);
+	}
 }
 
 
@@ -277,7 +454,10 @@ int pfq_set_group_prog(int gid, struct pfq_computation_tree *comp, void *ctx)
         old_comp = (struct pfq_computation_tree *)atomic_long_xchg(&g->comp, (long)comp);
         old_ctx  = (void *)atomic_long_xchg(&g->comp_ctx, (long)ctx);
 
-        msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
+        /* no wait is required when the group had no computation */
+
+        if (old_comp || old_ctx)
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
 
 	/* call fini on old computation */
 
@@ -286,7 +466,7 @@ int pfq_set_group_prog(int gid, struct pfq_computation_tree *comp, void *ctx)
 
         /* free the old computation/context */
 
-        kfree(old_comp);
+        pfq_computation_free(old_comp);
         kfree(old_ctx);
 
         up(&group_sem);
@@ -294,6 +474,285 @@ int pfq_set_group_prog(int gid, struct pfq_computation_tree *comp, void *ctx)
 }
 
 
+/* replace an argument of the running computation, without relinking the tree */
+
+int pfq_set_group_function_arg(int gid, size_t index, int n, struct pfq_functional_arg_descr const *arg)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_computation_tree *comp;
+        struct pfq_arg_update up;
+        int err;
+
+        if (!g)
+                return -EINVAL;
+
+        down(&group_sem);
+
+        comp = (struct pfq_computation_tree *)atomic_long_read(&g->comp);
+        if (comp == NULL) {
+                up(&group_sem);
+                return -EINVAL;
+        }
+
+        err = pfq_computation_prepare_arg(comp, index, n, arg, &up);
+        if (err == 0) {
+
+                pfq_computation_commit_arg(&up);
+
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
+
+                pfq_computation_release_arg(&up);
+        }
+
+        up(&group_sem);
+        return err;
+}
+
+
+int pfq_set_group_steering(int gid, int mode)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+
+        if (!g)
+                return -EINVAL;
+
+        if (mode != Q_STEERING_FOLD && mode != Q_STEERING_CONSISTENT)
+                return -EINVAL;
+
+        down(&group_sem);
+
+        g->steering = mode;
+        __pfq_group_steering_update(gid);
+
+        up(&group_sem);
+        return 0;
+}
+
+
+int pfq_set_group_spill(int gid, int policy, int threshold)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        void *flows = NULL, *old_flows;
+
+        if (!g)
+                return -EINVAL;
+
+        if (policy < Q_SPILL_NONE || policy > Q_SPILL_ALL || threshold < 1 || threshold > 100)
+                return -EINVAL;
+
+        /* the table of the recent flows is required by Q_SPILL_NEW_FLOWS only */
+
+        if (policy == Q_SPILL_NEW_FLOWS) {
+                flows = kzalloc(sizeof(u64) * Q_SPILL_FLOWS, GFP_KERNEL);
+                if (!flows)
+                        return -ENOMEM;
+        }
+
+        down(&group_sem);
+
+        g->spill = Q_SPILL_NONE;
+        g->spill_threshold = threshold;
+
+        old_flows = (void *)atomic_long_xchg(&g->spill_flows, (long)flows);
+
+        smp_wmb();
+
+        g->spill = policy;
+
+        if (old_flows) {
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
+                kfree(old_flows);
+        }
+
+        up(&group_sem);
+        return 0;
+}
+
+
+/* create, replace (the state is reset) or remove (size 0) a state map of the group */
+
+int pfq_set_group_state_map(int gid, int index, size_t size)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_state_map *map = NULL, *old_map;
+
+        if (!g)
+                return -EINVAL;
+
+        if (index < 0 || index >= Q_MAX_STATE_MAPS || size > Q_MAX_STATE_MAP_SIZE)
+                return -EINVAL;
+
+        if (size) {
+                map = pfq_state_map_alloc(size);
+                if (!map)
+                        return -ENOMEM;
+        }
+
+        down(&group_sem);
+
+        old_map = (struct pfq_state_map *)atomic_long_xchg(&g->state_map[index], (long)map);
+        if (old_map) {
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
+                pfq_state_map_free(old_map);
+        }
+
+        up(&group_sem);
+        return 0;
+}
+
+
+int pfq_get_group_state_map(int gid, struct pfq_group_state *state)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_state_map *map;
+        int err;
+
+        if (!g)
+                return -EINVAL;
+
+        if (state->index < 0 || state->index >= Q_MAX_STATE_MAPS)
+                return -EINVAL;
+
+        down(&group_sem);
+
+        map = (struct pfq_state_map *)atomic_long_read(&g->state_map[state->index]);
+        if (map)
+                err = pfq_state_map_read(map, state->aggregate != 0, state->entry, &state->size, &state->total, &state->miss);
+        else
+                err = -ENOENT;
+
+        up(&group_sem);
+        return err;
+}
+
+
+/* create, replace or remove (size 0) the flow table of the group */
+
+int pfq_set_group_flow_track(int gid, struct pfq_group_flow_track const *conf)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_flow_track *ft = NULL, *old_ft;
+
+        if (!g)
+                return -EINVAL;
+
+        if (conf->size) {
+                ft = pfq_flow_track_alloc(conf->size, conf->ring, conf->idle_timeout, conf->active_timeout);
+                if (!ft)
+                        return -EINVAL;
+        }
+
+        down(&group_sem);
+
+        old_ft = (struct pfq_flow_track *)atomic_long_xchg(&g->flow_track, (long)ft);
+        if (old_ft) {
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
+                pfq_flow_track_free(old_ft);
+        }
+
+        up(&group_sem);
+        return 0;
+}
+
+
+/* map the export ring of the flow table (it stays valid until unmapped) */
+
+int pfq_map_group_flow_ring(int gid, struct vm_area_struct *vma)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_flow_track *ft;
+        int err;
+
+        if (!g)
+                return -EINVAL;
+
+        down(&group_sem);
+
+        ft = (struct pfq_flow_track *)atomic_long_read(&g->flow_track);
+        if (!ft)
+                err = -ENOENT;
+        else if (vma->vm_end - vma->vm_start > ft->ring_mem)
+                err = -EINVAL;
+        else
+                err = remap_vmalloc_range(vma, ft->ring, 0);
+
+        up(&group_sem);
+        return err;
+}
+
+
+/* create, replace or remove (width 0) the count-min sketch of the group */
+
+int pfq_set_group_sketch(int gid, struct pfq_group_sketch const *conf)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_sketch *s = NULL, *old_s;
+
+        if (!g)
+                return -EINVAL;
+
+        if (conf->width) {
+                s = pfq_sketch_alloc(conf->depth, conf->width, conf->topk);
+                if (!s)
+                        return -EINVAL;
+        }
+
+        down(&group_sem);
+
+        old_s = (struct pfq_sketch *)atomic_long_xchg(&g->sketch, (long)s);
+        if (old_s) {
+                synchronize_rcu();        /* wait for the readers in pfq_process_batch */
+                pfq_sketch_free(old_s);
+        }
+
+        up(&group_sem);
+        return 0;
+}
+
+
+int pfq_get_group_topk(int gid, struct pfq_group_topk *topk)
+{
+        struct pfq_group * g = pfq_get_group(gid);
+        struct pfq_sketch *s;
+        int err;
+
+        if (!g)
+                return -EINVAL;
+
+        down(&group_sem);
+
+        s = (struct pfq_sketch *)atomic_long_read(&g->sketch);
+        if (s) {
+                err = pfq_sketch_read_topk(s, topk->entry, &topk->size);
+                if (!err && topk->reset)
+                        pfq_sketch_reset(s);
+        }
+        else
+                err = -ENOENT;
+
+        up(&group_sem);
+        return err;
+}
+
+
+/* rebuild the steering tables of the groups joined by the socket (e.g. its weight has changed) */
+
+void pfq_update_steering(int id)
+{
+        int n = 0;
+
+        down(&group_sem);
+        for(; n < Q_MAX_GROUP; n++)
+        {
+                struct pfq_group * g = pfq_get_group(n);
+
+                if (g->steering != Q_STEERING_FOLD && __pfq_has_joined_group(n, id))
+                        __pfq_group_steering_update(n);
+        }
+        up(&group_sem);
+}
+
+
 int
 pfq_join_group(int gid, int id, unsigned long class_mask, int policy)
 {
@@ -318,7 +777,7 @@ pfq_join_free_group(int id, unsigned long class_mask, int policy)
         int n = 0;
 
         down(&group_sem);
-        for(; n < Q_MAX_ID; n++)
+        for(; n < Q_MAX_GROUP; n++)
         {
                 if(!pfq_get_group(n)->pid) {
                         __pfq_join_group(n, id, class_mask, policy);
@@ -352,7 +811,7 @@ pfq_leave_all_groups(int id)
 {
         int n = 0;
         down(&group_sem);
-        for(; n < Q_MAX_ID; n++)
+        for(; n < Q_MAX_GROUP; n++)
         {
                 __pfq_leave_group(n, id);
         }
@@ -360,20 +819,22 @@ pfq_leave_all_groups(int id)
 }
 
 
-unsigned long
-pfq_get_groups(int id)
+void
+pfq_get_groups(int id, unsigned long *groups)
 {
-        unsigned long ret = 0;
+        unsigned long mask[Q_MAX_ID_WORDS];
         int n = 0;
+
+        pfq_bitmap_zero(groups, Q_MAX_GROUP_WORDS);
+
         down(&group_sem);
-        for(; n < Q_MAX_ID; n++)
+        for(; n < Q_MAX_GROUP; n++)
         {
-                unsigned long mask = __pfq_get_all_groups_mask(n);
-                if(mask & (1L << id))
-                        ret |= (1UL << n);
+                __pfq_get_all_groups_mask(n, mask);
+                if(mask[BIT_WORD(id)] & BIT_MASK(id))
+                        groups[BIT_WORD(n)] |= BIT_MASK(n);
         }
         up(&group_sem);
-        return ret;
 }
 
 
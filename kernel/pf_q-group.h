@@ -35,6 +35,7 @@
 #include <pf_q-sparse.h>
 #include <pf_q-stats.h>
 #include <pf_q-bpf.h>
+#include <pf_q-bitops.h>
 
 
 /* persistent state */
@@ -58,7 +59,7 @@ struct pfq_group
         int pid;	                                /* process id for restricted/private group */
 	int owner;					/* id of the owner */
 
-        atomic_long_t sock_mask[Q_CLASS_MAX];           /* for class: Q_CLASS_DEFAULT, Q_CLASS_USER_PLANE, Q_CLASS_CONTROL_PLANE etc... */
+        atomic_long_t sock_mask[Q_CLASS_MAX][Q_MAX_ID_WORDS];   /* for class: Q_CLASS_DEFAULT, Q_CLASS_USER_PLANE, Q_CLASS_CONTROL_PLANE etc... */
 
         atomic_long_t bp_filter; 			/* struct sk_filter pointer */
 
@@ -68,6 +69,17 @@ struct pfq_group
         atomic_long_t comp;                             /* struct pfq_computation_tree *  (new functional program) */
         atomic_long_t comp_ctx;                         /* void *: storage context (new functional program) */
 
+        int steering;                                   /* steering mode: Q_STEERING_FOLD, Q_STEERING_CONSISTENT */
+        atomic_long_t steering_table;                   /* struct pfq_steering_table * (consistent steering) */
+
+        int spill;                                      /* overflow policy: Q_SPILL_NONE, Q_SPILL_NEW_FLOWS, Q_SPILL_ALL */
+        int spill_threshold;                            /* fill level of a congested queue (percent) */
+        atomic_long_t spill_flows;                      /* u64 *: table of the recent flows (Q_SPILL_NEW_FLOWS) */
+
+        atomic_long_t state_map[Q_MAX_STATE_MAPS];      /* struct pfq_state_map *: key/value state of functions */
+        atomic_long_t flow_track;                       /* struct pfq_flow_track *: flow table and export ring (flow_track) */
+        atomic_long_t sketch;                           /* struct pfq_sketch *: count-min sketch and top-K (count_min) */
+
 	struct pfq_group_stats stats;
 
         struct pfq_group_persistent context;
@@ -77,18 +89,32 @@ struct pfq_group
 extern struct semaphore group_sem;
 
 struct pfq_computation_tree;
+struct vm_area_struct;
+
+extern int  pfq_groups_init(void);
+extern void pfq_groups_fini(void);
 
 extern int  pfq_join_free_group(int id, unsigned long class_mask, int policy);
 extern int  pfq_join_group(int gid, int id, unsigned long class_mask, int policy);
 extern int  pfq_leave_group(int gid, int id);
 extern void pfq_leave_all_groups(int id);
 extern int  pfq_set_group_prog(int gid, struct pfq_computation_tree *prog, void *ctx);
+extern int  pfq_set_group_function_arg(int gid, size_t index, int n, struct pfq_functional_arg_descr const *arg);
+extern int  pfq_set_group_steering(int gid, int mode);
+extern int  pfq_set_group_spill(int gid, int policy, int threshold);
+extern int  pfq_set_group_state_map(int gid, int index, size_t size);
+extern int  pfq_get_group_state_map(int gid, struct pfq_group_state *state);
+extern int  pfq_set_group_flow_track(int gid, struct pfq_group_flow_track const *conf);
+extern int  pfq_map_group_flow_ring(int gid, struct vm_area_struct *vma);
+extern int  pfq_set_group_sketch(int gid, struct pfq_group_sketch const *conf);
+extern int  pfq_get_group_topk(int gid, struct pfq_group_topk *topk);
+extern void pfq_update_steering(int id);
 
 extern int pfq_check_group(int id, int gid, const char *msg);
 extern int pfq_check_group_access(int id, int gid, const char *msg);
 
-extern unsigned long pfq_get_groups(int id);
-extern unsigned long __pfq_get_all_groups_mask(int gid);
+extern void pfq_get_groups(int id, unsigned long *groups);
+extern void __pfq_get_all_groups_mask(int gid, unsigned long *mask);
 
 extern bool __pfq_group_access(int gid, int id, int policy, bool join);
 
@@ -107,13 +133,28 @@ extern void __pfq_set_group_vlan_filter(int gid, bool value, int vid);
 static inline
 bool __pfq_group_is_empty(int gid)
 {
-        return __pfq_get_all_groups_mask(gid) == 0;
+        unsigned long mask[Q_MAX_ID_WORDS];
+        __pfq_get_all_groups_mask(gid, mask);
+        return pfq_bitmap_empty(mask, Q_MAX_ID_WORDS);
 }
 
 static inline
 bool __pfq_has_joined_group(int gid, int id)
 {
-        return __pfq_get_all_groups_mask(gid) & (1L << id);
+        unsigned long mask[Q_MAX_ID_WORDS];
+        __pfq_get_all_groups_mask(gid, mask);
+        return mask[BIT_WORD(id)] & BIT_MASK(id);
+}
+
+
+/* read the mask of sockets of a class */
+
+static inline
+void __pfq_group_sock_mask(struct pfq_group *g, int class, unsigned long *mask)
+{
+        size_t n;
+        for(n = 0; n < Q_MAX_ID_WORDS; n++)
+                mask[n] = atomic_long_read(&g->sock_mask[class][n]);
 }
 
 
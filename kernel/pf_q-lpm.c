@@ -0,0 +1,196 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifdef __KERNEL__
+
+#include <linux/kernel.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
+
+#define lpm_alloc(size)		vmalloc(size)
+#define lpm_free(ptr)		vfree(ptr)
+#define lpm_sort(base, n, cmp)	sort(base, n, sizeof(*(base)), cmp, NULL)
+
+#else
+
+#include <stdlib.h>
+
+#define lpm_alloc(size)		malloc(size)
+#define lpm_free(ptr)		free(ptr)
+#define lpm_sort(base, n, cmp)	qsort(base, n, sizeof(*(base)), cmp)
+
+#endif
+
+#include <pf_q-lpm.h>
+
+
+static struct pfq_lpm_key
+lpm_mask(int len)
+{
+	struct pfq_lpm_key m;
+
+	m.hi = len <= 0  ? 0 : len >= 64  ? ~0ULL : ~0ULL << (64 - len);
+	m.lo = len <= 64 ? 0 : len >= 128 ? ~0ULL : ~0ULL << (128 - len);
+	return m;
+}
+
+
+static struct pfq_lpm_key
+lpm_last(struct pfq_lpm_key start, int len)
+{
+	struct pfq_lpm_key m = lpm_mask(len);
+
+	start.hi |= ~m.hi;
+	start.lo |= ~m.lo;
+	return start;
+}
+
+
+static struct pfq_lpm_key
+lpm_next(struct pfq_lpm_key k)
+{
+	if (++k.lo == 0)
+		k.hi++;
+	return k;
+}
+
+
+static int
+lpm_prefix_cmp(const void *a_, const void *b_)
+{
+	struct pfq_lpm_prefix const *a = a_, *b = b_;
+	int c = pfq_lpm_key_cmp(a->addr, b->addr);
+
+	if (c != 0)
+		return c;
+
+	/* the shorter (enclosing) prefix first */
+
+	return a->len - b->len;
+}
+
+
+/* append a range, merging it with the last one when possible */
+
+static void
+lpm_emit(struct pfq_lpm_table *table, struct pfq_lpm_key start, uint32_t value)
+{
+	struct pfq_lpm_range *last = table->size ? &table->range[table->size-1] : NULL;
+
+	if (last && pfq_lpm_key_cmp(last->start, start) == 0) {
+		last->value = value;
+		if (table->size > 1 && last[-1].value == value)
+			table->size--;
+		return;
+	}
+
+	if (last && last->value == value)
+		return;
+
+	table->range[table->size].start = start;
+	table->range[table->size].value = value;
+	table->size++;
+}
+
+
+int
+pfq_lpm_build(struct pfq_lpm_table *table, struct pfq_lpm_prefix *prefix, size_t n)
+{
+	struct pfq_lpm_key zero = { 0, 0 };
+	struct pfq_lpm_prefix **stack;
+	size_t i, b, top = 0;
+
+	table->size  = 0;
+	table->range = lpm_alloc((2 * n + 1) * sizeof(struct pfq_lpm_range));
+	table->index = lpm_alloc(((1 << Q_LPM_INDEX_BITS) + 1) * sizeof(uint32_t));
+	stack        = lpm_alloc((n + 1) * sizeof(struct pfq_lpm_prefix *));
+
+	if (!table->range || !table->index || !stack) {
+		lpm_free(stack);
+		pfq_lpm_free(table);
+		return -1;
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		struct pfq_lpm_key m = lpm_mask(prefix[i].len);
+
+		prefix[i].addr.hi &= m.hi;
+		prefix[i].addr.lo &= m.lo;
+	}
+
+	lpm_sort(prefix, n, lpm_prefix_cmp);
+
+	/* sweep the prefixes, with the enclosing ones on the stack */
+
+	lpm_emit(table, zero, 0);
+
+	for(i = 0; i < n; i++)
+	{
+		while (top && pfq_lpm_key_cmp(lpm_last(stack[top-1]->addr, stack[top-1]->len), prefix[i].addr) < 0)
+		{
+			struct pfq_lpm_prefix *t = stack[--top];
+
+			lpm_emit(table, lpm_next(lpm_last(t->addr, t->len)), top ? stack[top-1]->value : 0);
+		}
+
+		lpm_emit(table, prefix[i].addr, prefix[i].value);
+		stack[top++] = &prefix[i];
+	}
+
+	while (top)
+	{
+		struct pfq_lpm_prefix *t = stack[--top];
+		struct pfq_lpm_key last = lpm_last(t->addr, t->len);
+
+		if (last.hi == ~0ULL && last.lo == ~0ULL)
+			break;
+
+		lpm_emit(table, lpm_next(last), top ? stack[top-1]->value : 0);
+	}
+
+	lpm_free(stack);
+
+	/* direct index on the first bits of the key */
+
+	for(b = 0, i = 0; b <= (1 << Q_LPM_INDEX_BITS); b++)
+	{
+		while (i < table->size && (table->range[i].start.hi >> (64 - Q_LPM_INDEX_BITS)) < b)
+			i++;
+		table->index[b] = i;
+	}
+
+	return 0;
+}
+
+
+void
+pfq_lpm_free(struct pfq_lpm_table *table)
+{
+	lpm_free(table->range);
+	lpm_free(table->index);
+
+	table->range = NULL;
+	table->index = NULL;
+	table->size  = 0;
+}
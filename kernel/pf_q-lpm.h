@@ -0,0 +1,137 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PF_Q_LPM_H
+#define PF_Q_LPM_H
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+
+/*
+ * Exact longest-prefix match over IPv4 and IPv6 prefixes.
+ *
+ * Nested prefixes are flattened into a sorted array of disjoint ranges, each
+ * holding the value of the longest prefix that covers it (0 when none does).
+ * A lookup selects the candidate ranges with a direct index on the first 16
+ * bits of the address and completes with a binary search: the table takes
+ * O(n) memory (at most 2n+1 ranges) and a lookup O(log n) in the worst case.
+ *
+ * Addresses are 128 bits keys in host order: IPv4 ones use the top 32 bits.
+ */
+
+#define Q_LPM_INDEX_BITS	16
+
+struct pfq_lpm_key
+{
+	uint64_t hi;
+	uint64_t lo;
+};
+
+
+struct pfq_lpm_prefix
+{
+	struct pfq_lpm_key addr;
+	int		   len;		/* 0..32 for IPv4, 0..128 for IPv6 */
+	uint32_t	   value;	/* non zero */
+};
+
+
+struct pfq_lpm_range
+{
+	struct pfq_lpm_key start;
+	uint32_t	   value;
+};
+
+
+struct pfq_lpm_table
+{
+	size_t		      size;
+	uint32_t 	     *index;	/* (1 << Q_LPM_INDEX_BITS) + 1 entries */
+	struct pfq_lpm_range *range;
+};
+
+
+extern int  pfq_lpm_build(struct pfq_lpm_table *table, struct pfq_lpm_prefix *prefix, size_t n);
+extern void pfq_lpm_free(struct pfq_lpm_table *table);
+
+
+static inline struct pfq_lpm_key
+pfq_lpm_key_from_bytes(const uint8_t *addr, size_t len)
+{
+	struct pfq_lpm_key key = { 0, 0 };
+	size_t n;
+
+	for(n = 0; n < len && n < 8; n++)
+		key.hi |= (uint64_t)addr[n] << (56 - 8 * n);
+	for(; n < len && n < 16; n++)
+		key.lo |= (uint64_t)addr[n] << (120 - 8 * n);
+
+	return key;
+}
+
+
+static inline int
+pfq_lpm_key_cmp(struct pfq_lpm_key a, struct pfq_lpm_key b)
+{
+	if (a.hi != b.hi)
+		return a.hi < b.hi ? -1 : 1;
+	if (a.lo != b.lo)
+		return a.lo < b.lo ? -1 : 1;
+	return 0;
+}
+
+
+/* return the value of the longest prefix matching the key, 0 if none */
+
+static inline uint32_t
+pfq_lpm_lookup(struct pfq_lpm_table const *table, struct pfq_lpm_key key)
+{
+	size_t b = key.hi >> (64 - Q_LPM_INDEX_BITS), lo, hi;
+
+	if (table->size == 0)
+		return 0;
+
+	lo = table->index[b] ? table->index[b] - 1 : 0;
+	hi = table->index[b+1];
+
+	while (hi - lo > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+
+		if (pfq_lpm_key_cmp(table->range[mid].start, key) <= 0)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return table->range[lo].value;
+}
+
+
+#endif /* PF_Q_LPM_H */
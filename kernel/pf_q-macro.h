@@ -24,9 +24,19 @@
 #ifndef PF_Q_MACRO_H
 #define PF_Q_MACRO_H
 
-#define Q_MAX_ID                (sizeof(long)<<3)
-#define Q_MAX_GROUP             (sizeof(long)<<3)
-#define Q_SKBUFF_SHORT_BATCH	(sizeof(long)<<3)
+/* max number of sockets and groups (PFQ_MAX_ID can be set at build time) */
+
+#ifndef PFQ_MAX_ID
+#define PFQ_MAX_ID              64
+#endif
+
+#define Q_MAX_ID                PFQ_MAX_ID
+#define Q_MAX_GROUP             PFQ_MAX_ID
+
+#define Q_MAX_ID_WORDS          ((Q_MAX_ID + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define Q_MAX_GROUP_WORDS       ((Q_MAX_GROUP + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+#define Q_SKBUFF_SHORT_BATCH	(sizeof(unsigned long long)<<3)
 #define Q_SKBUFF_LONG_BATCH	128
 
 #define Q_GC_LOG_QUEUE_LEN	16
@@ -38,8 +48,6 @@
 #define Q_MAX_HW_QUEUE          256
 #define Q_MAX_HW_QUEUE_MASK     (Q_MAX_HW_QUEUE-1)
 
-#define Q_GRACE_PERIOD 		100 /* msec */
-
 #define Q_TX_RING_SIZE          (8192)
 #define Q_TX_RING_MASK          (PFQ_TX_RING_SIZE-1)
 
@@ -49,9 +57,6 @@
 #define Q_PERSISTENT_MEM 	64
 
 
-#define Q_MAX_CPU               256
-#define Q_MAX_CPU_MASK          (Q_MAX_CPU-1)
-
 #define Q_MAX_PERSISTENT 	1024
 
 #endif /* PF_Q_MACRO_H */
@@ -39,6 +39,7 @@
 #include <pf_q-sparse.h>
 #include <pf_q-monad.h>
 #include <pf_q-GC.h>
+#include <pf_q-parse.h>
 
 /**** macros ****/
 
@@ -170,13 +171,30 @@ struct pfq_functional_node
 	bool 		      initialized;
 
 	struct pfq_functional_node *next;
+
+	const char *	      symbol;		/* symtable name, used by the optimizer */
+	struct pfq_functional_node *orig_next;	/* link as written by the user */
+	unsigned int	      opt;		/* Q_OPT_ flags */
+
+	const char *	      signature;
+	struct pfq_functional_arg init_arg[8];	/* arguments as passed to init */
+	void *		      arg_mem[8];	/* arguments replaced at runtime */
+	unsigned int	      version;		/* number of runtime updates */
 };
 
 
+/* optimizer rewrites (a removed node is bypassed, never freed) */
+
+#define Q_OPT_REMOVED		0x01
+#define Q_OPT_SWAPPED		0x02
+
+
 struct pfq_computation_tree
 {
         size_t size;
         struct pfq_functional_node *entry_point;
+        struct pfq_functional_node *orig_entry_point;
+        struct pfq_lang_node_stats __percpu *stats;	/* size counters, per cpu */
         struct pfq_functional_node node[];
 };
 
@@ -225,6 +243,8 @@ bool fwd_to_kernel(struct sk_buff *skb)
 extern struct pfq_function_descr  filter_functions[];
 extern struct pfq_function_descr  bloom_functions[];
 extern struct pfq_function_descr  vlan_functions[];
+extern struct pfq_function_descr  lpm_functions[];
+extern struct pfq_function_descr  ebpf_functions[];
 extern struct pfq_function_descr  forward_functions[];
 extern struct pfq_function_descr  steering_functions[];
 extern struct pfq_function_descr  predicate_functions[];
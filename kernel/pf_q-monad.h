@@ -29,6 +29,9 @@
 #include <pf_q-macro.h>
 #include <pf_q-GC.h>
 #include <pf_q-sparse.h>
+#include <pf_q-state.h>
+#include <pf_q-flow.h>
+#include <pf_q-sketch.h>
 
 /* The Action monad */
 
@@ -175,6 +178,36 @@ sparse_counter_t * get_counter(SkBuff b, int n)
 }
 
 
+/* utility function: state map (NULL if the map has not been created) */
+
+static inline
+struct pfq_state_map * get_state_map(SkBuff b, int n)
+{
+        if (n < 0 || n >= Q_MAX_STATE_MAPS)
+                return NULL;
+
+        return (struct pfq_state_map *)atomic_long_read(&PFQ_CB(b.skb)->monad->group->state_map[n]);
+}
+
+
+/* utility function: flow table of the group (NULL if not enabled) */
+
+static inline
+struct pfq_flow_track * get_flow_track(SkBuff b)
+{
+        return (struct pfq_flow_track *)atomic_long_read(&PFQ_CB(b.skb)->monad->group->flow_track);
+}
+
+
+/* utility function: count-min sketch of the group (NULL if not enabled) */
+
+static inline
+struct pfq_sketch * get_sketch(SkBuff b)
+{
+        return (struct pfq_sketch *)atomic_long_read(&PFQ_CB(b.skb)->monad->group->sketch);
+}
+
+
 /* utility function: mark, volatile state, persistent state */
 
 
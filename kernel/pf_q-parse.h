@@ -0,0 +1,159 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PF_Q_PARSE_H
+#define PF_Q_PARSE_H
+
+#include <linux/skbuff.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/udp.h>
+#include <linux/tcp.h>
+#include <linux/icmp.h>
+#include <linux/pf_q.h>
+
+#include <pf_q-skbuff.h>
+#include <pf_q-global.h>
+
+
+/* flags of the per-packet header cache (exported as they are in the extended packet header) */
+
+#define Q_HDR_PARSED	0x01
+#define Q_HDR_IP	Q_PKTHDR_EXT_IP
+#define Q_HDR_IP6	Q_PKTHDR_EXT_IP6
+#define Q_HDR_L4	Q_PKTHDR_EXT_L4		/* the whole l4 header is in the packet */
+#define Q_HDR_HASH	Q_PKTHDR_EXT_HASH	/* the steering hash in pfq_cb is valid */
+
+
+static inline size_t
+pfq_l4_hdr_len(uint8_t proto)
+{
+	switch(proto)
+	{
+	case IPPROTO_UDP:	return sizeof(struct udphdr);
+	case IPPROTO_TCP:	return sizeof(struct tcphdr);
+	case IPPROTO_ICMP:	return sizeof(struct icmphdr);
+	case IPPROTO_ICMPV6:	return 32 >> 3;	/* the icmpv6 header is 32 bits long */
+	}
+	return 0;
+}
+
+
+static inline void
+__pfq_parse(struct sk_buff *skb, struct pfq_hdr_cache *hc)
+{
+	size_t len;
+
+	hc->flags    = Q_HDR_PARSED | (hc->flags & Q_HDR_HASH);
+	hc->l4_proto = 0;
+	hc->l4_off   = 0;
+
+	switch(eth_hdr(skb)->h_proto)
+	{
+	case __constant_htons(ETH_P_IP): {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = skb_header_pointer(skb, skb->mac_len, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return;
+
+		hc->flags   |= Q_HDR_IP;
+		hc->l4_proto = ip->protocol;
+		hc->l4_off   = skb->mac_len + (ip->ihl<<2);
+	} break;
+
+	case __constant_htons(ETH_P_IPV6): {
+		struct ipv6hdr _iph6;
+		const struct ipv6hdr *ip6;
+
+		ip6 = skb_header_pointer(skb, skb->mac_len, sizeof(_iph6), &_iph6);
+		if (ip6 == NULL)
+			return;
+
+		hc->flags   |= Q_HDR_IP6;
+		hc->l4_proto = ip6->nexthdr;
+		hc->l4_off   = skb->mac_len + sizeof(struct ipv6hdr);
+	} break;
+
+	default:
+		return;
+	}
+
+	len = pfq_l4_hdr_len(hc->l4_proto);
+	if (len && (hc->l4_off + len) <= skb->len)
+		hc->flags |= Q_HDR_L4;
+}
+
+
+/* parse the packet headers, unless already done for this packet in the current batch */
+
+static inline struct pfq_hdr_cache *
+pfq_parse(struct sk_buff *skb)
+{
+	struct pfq_hdr_cache *hc = &PFQ_CB(skb)->hdr;
+
+	if (!(hc->flags & Q_HDR_PARSED) || unlikely(!lang_hdr_cache))
+		__pfq_parse(skb, hc);
+
+	return hc;
+}
+
+
+static inline const struct iphdr *
+pfq_ip_hdr(struct sk_buff *skb, struct iphdr *buf)
+{
+	if (!(pfq_parse(skb)->flags & Q_HDR_IP))
+		return NULL;
+
+	return skb_header_pointer(skb, skb->mac_len, sizeof(struct iphdr), buf);
+}
+
+
+static inline const struct ipv6hdr *
+pfq_ip6_hdr(struct sk_buff *skb, struct ipv6hdr *buf)
+{
+	if (!(pfq_parse(skb)->flags & Q_HDR_IP6))
+		return NULL;
+
+	return skb_header_pointer(skb, skb->mac_len, sizeof(struct ipv6hdr), buf);
+}
+
+
+/* l4 header of the given protocol carried over IPv4 or IPv6 (l3 = Q_HDR_IP, Q_HDR_IP6 or both)
+ * buf must be large enough for pfq_l4_hdr_len(proto) bytes. */
+
+static inline const void *
+pfq_l4_hdr(struct sk_buff *skb, int l3, uint8_t proto, void *buf)
+{
+	struct pfq_hdr_cache *hc = pfq_parse(skb);
+
+	if (!(hc->flags & l3) || !(hc->flags & Q_HDR_L4) || hc->l4_proto != proto)
+		return NULL;
+
+	return skb_header_pointer(skb, hc->l4_off, pfq_l4_hdr_len(proto), buf);
+}
+
+
+#endif /* PF_Q_PARSE_H */
@@ -29,9 +29,35 @@
 #include <pf_q-global.h>
 #include <pf_q-memory.h>
 #include <pf_q-module.h>
+#include <pf_q-percpu.h>
 #include <pf_q-GC.h>
 
 
+static enum hrtimer_restart
+pfq_flush_timer_handler(struct hrtimer *timer)
+{
+	struct local_data *local = container_of(timer, struct local_data, flush_timer);
+
+	/* the batch is processed in softirq context, as in pfq_receive */
+
+	if (!ACCESS_ONCE(local->flush_stop))
+		tasklet_schedule(&local->flush_tasklet);
+	return HRTIMER_NORESTART;
+}
+
+
+static void
+pfq_flush_work(struct work_struct *work)
+{
+	struct local_data *local = container_of(work, struct local_data, flush_work);
+
+	/* running on the owner cpu: the tasklet is scheduled there */
+
+	if (!ACCESS_ONCE(local->flush_stop))
+		tasklet_schedule(&local->flush_tasklet);
+}
+
+
 int pfq_percpu_init(void)
 {
 	int cpu;
@@ -49,12 +75,45 @@ int pfq_percpu_init(void)
                 struct local_data *local = per_cpu_ptr(cpu_data, cpu);
 
 		gc_data_init(&local->gc);
+
+		local->batch_len = batch_len;
+
+		hrtimer_init(&local->flush_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+		local->flush_timer.function = pfq_flush_timer_handler;
+
+		tasklet_init(&local->flush_tasklet, pfq_receive_flush, (unsigned long)cpu);
+		INIT_WORK(&local->flush_work, pfq_flush_work);
+		local->flush_stop = 0;
 	}
 
 	return 0;
 }
 
 
+void pfq_percpu_fini(void)
+{
+	int cpu;
+
+	/* stop flush timers, works and tasklets (of each cpu): they schedule
+	 * each other, the stop flag prevents them from being armed again */
+
+        for_each_possible_cpu(cpu)
+		ACCESS_ONCE(per_cpu_ptr(cpu_data, cpu)->flush_stop) = 1;
+
+	smp_mb();
+
+        for_each_possible_cpu(cpu) {
+
+                struct local_data *local = per_cpu_ptr(cpu_data, cpu);
+
+		tasklet_kill(&local->flush_tasklet);
+		hrtimer_cancel(&local->flush_timer);
+		cancel_work_sync(&local->flush_work);
+		tasklet_kill(&local->flush_tasklet);
+	}
+}
+
+
 int pfq_percpu_flush(void)
 {
         int cpu;
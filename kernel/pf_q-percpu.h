@@ -26,26 +26,51 @@
 
 #include <linux/percpu.h>
 #include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/workqueue.h>
 
 #include <pf_q-skbuff-list.h>
 #include <pf_q-macro.h>
 #include <pf_q-GC.h>
+#include <pf_q-monad.h>
+#include <pf_q-steering.h>
 
 int pfq_percpu_init(void);
 int pfq_percpu_flush(void);
+void pfq_percpu_fini(void);
+
+/* flush a stale batch (defined in pf_q.c)... */
+
+void pfq_receive_flush(unsigned long cpu);
 
 /* per-cpu data... */
 
 struct local_data
 {
-        unsigned long           eligible_mask;
-        unsigned long           sock_mask [Q_MAX_ID];
+        unsigned long           eligible_mask [Q_MAX_ID_WORDS];
+        int                     sock_id [Q_MAX_ID];
 
         int                     sock_cnt;
 
+        struct pfq_spill_cache  spill;      /* least loaded socket, per group batch */
+
+        unsigned long long      group_queue [Q_MAX_GROUP];  /* packets of the batch, per group */
+        unsigned long long      sock_queue [Q_MAX_ID];      /* packets of the batch, per socket */
+
 	struct gc_data 		gc;		/* garbage collector */
 	ktime_t 		last_ts;	/* timestamp of the last packet */
 
+	ktime_t 		batch_ts;	/* arrival time of the first packet of the batch */
+	int 			batch_len;	/* current (adaptive) batch length */
+
+	struct hrtimer 		flush_timer;	/* flush partial batches... */
+	struct tasklet_struct 	flush_tasklet;	/* ...in softirq context */
+	struct work_struct 	flush_work;	/* ...scheduled on the owner cpu */
+	int 			flush_stop;	/* set on exit: do not re-arm */
+
+	struct pfq_monad 	monad[Q_SKBUFF_SHORT_BATCH]; /* per-packet monads (batch evaluation) */
+
         atomic_t                enable_skb_pool;
 
         struct pfq_sk_buff_list tx_pool;
@@ -25,6 +25,7 @@
 #include <linux/module.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/math64.h>
 #include <linux/pf_q.h>
 
 #include <net/net_namespace.h>
@@ -38,6 +39,7 @@
 #include <pf_q-proc.h>
 #include <pf_q-memory.h>
 #include <pf_q-printk.h>
+#include <pf_q-engine.h>
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,10,0)
 #define PDE_DATA(a) PDE(a)->data
@@ -55,19 +57,34 @@ static const char proc_memory[]       = "memory";
 
 
 static void
-seq_printf_functional_node(struct seq_file *m, struct pfq_functional_node const *node, size_t index)
+seq_printf_functional_node(struct seq_file *m, struct pfq_computation_tree const *tree, size_t index)
 {
+	struct pfq_lang_node_stats stats;
 	char buffer[256];
 
- 	snprintf_functional_node(buffer, sizeof(buffer), node, index);
+ 	snprintf_functional_node(buffer, sizeof(buffer), &tree->node[index], index);
 
-	seq_printf(m, "%s\n", buffer);
+	seq_printf(m, "%s%s%s", buffer,
+		   tree->node[index].opt & Q_OPT_REMOVED ? " (removed)" : "",
+		   tree->node[index].opt & Q_OPT_SWAPPED ? " (operands swapped)" : "");
+
+	if (tree->node[index].version)
+		seq_printf(m, " (arguments updated %u times)", tree->node[index].version);
+
+	seq_printf(m, "\n");
+
+	pfq_computation_stats(tree, index, &stats);
+
+	seq_printf(m, "        run=%llu drop=%llu steer=%llu cycles=%llu (%llu/run)\n",
+		   stats.run, stats.drop, stats.steer, stats.cycles,
+		   stats.run ? div64_u64(stats.cycles, stats.run) : 0ULL);
 }
 
 
 static void
 seq_printf_computation_tree(struct seq_file *m, struct pfq_computation_tree const *tree)
 {
+        struct pfq_functional_node const *node;
         size_t n;
 
 	if (tree == NULL) {
@@ -78,8 +95,16 @@ seq_printf_computation_tree(struct seq_file *m, struct pfq_computation_tree cons
         seq_printf(m, "computation size=%zu entry_point=%p\n", tree->size, tree->entry_point);
         for(n = 0; n < tree->size; n++)
         {
-                seq_printf_functional_node(m, &tree->node[n], n);
+                seq_printf_functional_node(m, tree, n);
         }
+
+        seq_printf(m, "    original: ");
+        for(node = tree->orig_entry_point; node; node = node->orig_next)
+        	seq_printf(m, "%s%s", node->symbol, node->orig_next ? " >-> " : "\n");
+
+        seq_printf(m, "    rewritten: ");
+        for(node = tree->entry_point; node; node = node->next)
+        	seq_printf(m, "%s%s", node->symbol, node->next ? " >-> " : "\n");
 }
 
 
@@ -112,7 +137,7 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 {
 	size_t n;
 
-	seq_printf(m, "group: recv      drop      forward   kernel    disc      quit      pol pid   def.    uplane   cplane    ctrl\n");
+	seq_printf(m, "group: recv      drop      forward   kernel    disc      quit      spill     pol pid   def.    uplane   cplane    ctrl\n");
 
 	down(&group_sem);
 
@@ -122,19 +147,22 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 		if (!this_group->policy)
 			continue;
 
-        	seq_printf(m, "%5zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu", n, sparse_read(&this_group->stats.recv),
+        	seq_printf(m, "%5zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu", n, sparse_read(&this_group->stats.recv),
 				   	                           	      sparse_read(&this_group->stats.drop),
 					                           	      sparse_read(&this_group->stats.frwd),
 					                           	      sparse_read(&this_group->stats.kern),
 					                           	      sparse_read(&this_group->stats.disc),
-					                           	      sparse_read(&this_group->stats.quit));
+					                           	      sparse_read(&this_group->stats.quit),
+					                           	      sparse_read(&this_group->stats.spill));
 
         	seq_printf(m, "%3d %3d ", this_group->policy, this_group->pid);
 
-        	seq_printf(m, "%08lx %08lx %08lx %08lx \n", atomic_long_read(&this_group->sock_mask[pfq_ctz(Q_CLASS_DEFAULT)]),
-        				                    atomic_long_read(&this_group->sock_mask[pfq_ctz(Q_CLASS_USER_PLANE)]),
-        				                    atomic_long_read(&this_group->sock_mask[pfq_ctz(Q_CLASS_CONTROL_PLANE)]),
-        				                    atomic_long_read(&this_group->sock_mask[63]));
+        	/* masks of the first BITS_PER_LONG sockets */
+
+        	seq_printf(m, "%08lx %08lx %08lx %08lx \n", atomic_long_read(&this_group->sock_mask[pfq_ctz(Q_CLASS_DEFAULT)][0]),
+        				                    atomic_long_read(&this_group->sock_mask[pfq_ctz(Q_CLASS_USER_PLANE)][0]),
+        				                    atomic_long_read(&this_group->sock_mask[pfq_ctz(Q_CLASS_CONTROL_PLANE)][0]),
+        				                    atomic_long_read(&this_group->sock_mask[63][0]));
 
 	}
 
@@ -144,6 +172,8 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 
 static int pfq_proc_stats(struct seq_file *m, void *v)
 {
+	long flush = sparse_read(&global_stats.flush);
+
 	seq_printf(m, "INPUT:\n");
 	seq_printf(m, "received  : %ld\n", sparse_read(&global_stats.recv));
 	seq_printf(m, "lost      : %ld\n", sparse_read(&global_stats.lost));
@@ -158,6 +188,9 @@ static int pfq_proc_stats(struct seq_file *m, void *v)
 	seq_printf(m, "poll      : %ld\n", sparse_read(&global_stats.poll));
 	seq_printf(m, "wakeup    : %ld\n", sparse_read(&global_stats.wake));
 #endif
+	seq_printf(m, "BATCH:\n");
+	seq_printf(m, "flush     : %ld\n", flush);
+	seq_printf(m, "flush lat : %ld usec (avg)\n", flush ? sparse_read(&global_stats.flush_lat)/(flush * 1000) : 0);
 	return 0;
 }
 
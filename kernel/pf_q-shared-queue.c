@@ -29,6 +29,9 @@
 #include <linux/printk.h>
 #include <linux/kthread.h>
 #include <linux/mm.h>
+#include <linux/hrtimer.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
 #include <linux/pf_q.h>
 
 #include <pf_q-shared-queue.h>
@@ -42,10 +45,12 @@
 #include <pf_q-GC.h>
 
 
+/* room: bytes available at destination, the copy never goes past them */
+
 static inline
-void *pfq_skb_copy_from_linear_data(const struct sk_buff *skb, void *to, size_t len)
+void *pfq_skb_copy_from_linear_data(const struct sk_buff *skb, void *to, size_t len, size_t room)
 {
-	if (len < 64 && (len + skb_tailroom(skb) >= 64))
+	if (len < 64 && room >= 64 && (len + skb_tailroom(skb) >= 64))
 		return memcpy(to, skb->data, 64);
 	return memcpy(to, skb->data, len);
 }
@@ -54,7 +59,338 @@ void *pfq_skb_copy_from_linear_data(const struct sk_buff *skb, void *to, size_t
 static inline
 char *mpsc_slot_ptr(struct pfq_rx_opt *ro, struct pfq_rx_queue *qd, size_t qindex, size_t slot)
 {
-	return (char *)(ro->base_addr) + ( (qindex&1) ? ro->queue_size : 0 + slot) * ro->slot_size;
+	return (char *)(ro->base_addr) + ( ((qindex&1) ? ro->queue_size : 0) + slot) * ro->slot_size;
+}
+
+
+static inline
+void pfq_wakeup_reader(struct pfq_rx_opt *ro)
+{
+	/* pairs with the barrier in pfq_poll, not to miss a reader going to sleep */
+
+	smp_mb();
+
+	if (waitqueue_active(&ro->waitqueue)) {
+#ifdef PFQ_USE_EXTENDED_PROC
+		sparse_inc(&global_stats.wake);
+#endif
+		wake_up_interruptible(&ro->waitqueue);
+	}
+}
+
+
+/* wakeup coalescing: a sleeping reader is woken up after ro->wakeup packets,
+ * or after ro->wakeup_delay usec from the first packet, whichever comes first.
+ * Packets are counted per cpu and added to the shared counter in batches */
+
+static inline
+void pfq_rx_wakeup(struct pfq_rx_opt *ro, size_t sent)
+{
+	local_t *local;
+	long n;
+
+	if (!sent)
+		return;
+
+	smp_mb();
+
+	if (!waitqueue_active(&ro->waitqueue))
+		return;
+
+	local = this_cpu_ptr(ro->wakeup_local.value);
+
+	n = local_add_return(sent, local);
+	if (n < ACCESS_ONCE(ro->wakeup_batch)) {
+		if (ro->wakeup_delay && !test_bit(0, &ro->wakeup_armed) && !test_and_set_bit(0, &ro->wakeup_armed))
+			hrtimer_start(&ro->wakeup_timer, ns_to_ktime(ro->wakeup_delay * 1000ULL), HRTIMER_MODE_REL);
+		return;
+	}
+
+	local_set(local, 0);
+
+	if (atomic_add_return(n, &ro->wakeup_pending) >= ACCESS_ONCE(ro->wakeup)) {
+		atomic_set(&ro->wakeup_pending, 0);
+#ifdef PFQ_USE_EXTENDED_PROC
+		sparse_inc(&global_stats.wake);
+#endif
+		wake_up_interruptible(&ro->waitqueue);
+		return;
+	}
+
+	if (ro->wakeup_delay && !test_bit(0, &ro->wakeup_armed) && !test_and_set_bit(0, &ro->wakeup_armed))
+		hrtimer_start(&ro->wakeup_timer, ns_to_ktime(ro->wakeup_delay * 1000ULL), HRTIMER_MODE_REL);
+}
+
+
+static
+enum hrtimer_restart pfq_wakeup_timer_handler(struct hrtimer *timer)
+{
+	struct pfq_rx_opt *ro = container_of(timer, struct pfq_rx_opt, wakeup_timer);
+
+	clear_bit(0, &ro->wakeup_armed);
+
+	pfq_wakeup_reader(ro);
+
+	return HRTIMER_NORESTART;
+}
+
+
+/* setup the header of the slot and copy the packet (the commit is left to the caller) */
+
+static inline
+void pfq_copy_hdr_ext(volatile struct pfq_pkthdr_ext *ext, struct sk_buff *skb)
+{
+	struct pfq_hdr_cache *hc = pfq_parse(skb);
+
+	ext->hash     = (hc->flags & Q_HDR_HASH) ? PFQ_CB(skb)->hash : 0;
+	ext->l3_off   = skb->mac_len;
+	ext->l4_off   = hc->l4_off;
+	ext->l4_proto = hc->l4_proto;
+	ext->flags    = hc->flags & (Q_HDR_IP | Q_HDR_IP6 | Q_HDR_L4 | Q_HDR_HASH);
+}
+
+
+static inline
+int pfq_copy_to_slot(struct pfq_rx_opt *ro, volatile struct pfq_pkthdr *hdr, struct sk_buff *skb, int gid)
+{
+	char *pkt = (char *)(hdr+1);
+	size_t bytes;
+
+	bytes = min_t(size_t, skb->len, ro->caplen);
+
+	/* copy mark from pfq_cb (annotation) */
+
+	hdr->data = PFQ_CB(skb)->mark;
+
+	/* setup the header */
+
+	if (ro->tstamp != 0) {
+		struct timespec ts;
+		skb_get_timestampns(skb, &ts);
+		hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
+		hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
+	}
+
+	hdr->if_index    = skb->dev->ifindex & 0xff;
+	hdr->gid         = gid;
+
+	hdr->len         = (uint16_t)min_t(unsigned int, skb->len, 0xffff);
+	hdr->caplen 	 = (uint16_t)bytes;
+	hdr->un.vlan_tci = skb->vlan_tci & ~VLAN_TAG_PRESENT;
+	hdr->hw_queue    = (uint8_t)(skb_get_rx_queue(skb) & 0xff);
+
+	/* extended header, past the packet bytes */
+
+	if (ro->ext) {
+		volatile struct pfq_pkthdr_ext *ext = (struct pfq_pkthdr_ext *)((char *)hdr +
+			(ro->packed ? Q_RX_PACKED_SLOT_SIZE(bytes) : ro->slot_size - sizeof(struct pfq_pkthdr_ext)));
+
+		pfq_copy_hdr_ext(ext, skb);
+	}
+
+	/* copy bytes of packet */
+
+#ifdef PFQ_USE_SKB_LINEARIZE
+	if (unlikely(skb_is_nonlinear(skb)))
+#else
+	if (skb_is_nonlinear(skb))
+#endif
+	{
+		if (skb_copy_bits(skb, 0, pkt, bytes) != 0) {
+			printk(KERN_WARNING "[PFQ] BUG! skb_copy_bits failed (bytes=%zu, skb_len=%d mac_len=%d)!\n",
+					    bytes, skb->len, skb->mac_len);
+			return -1;
+		}
+	}
+	else {
+		/* packed slots end with the record; fixed slots may end with the ring */
+
+		size_t room = ro->packed ? bytes : ro->slot_size - sizeof(struct pfq_pkthdr) - Q_RX_HDR_EXT_SIZE(ro->ext);
+
+		pfq_skb_copy_from_linear_data(skb, pkt, bytes, room);
+	}
+
+	return 0;
+}
+
+
+/* size of the slot (record) that holds the given packet */
+
+static inline
+size_t pfq_rx_record_size(struct pfq_rx_opt *ro, struct sk_buff *skb)
+{
+	if (ro->packed)
+		return Q_RX_PACKED_SLOT_SIZE(min_t(size_t, skb->len, ro->caplen)) + Q_RX_HDR_EXT_SIZE(ro->ext);
+	return ro->slot_size;
+}
+
+
+/* position of a record of rec bytes, past the end of the ring if it does not fit */
+
+static inline
+uint64_t pfq_ring_record_pos(uint64_t prod, size_t rec, size_t ring_bytes)
+{
+	size_t room = ring_bytes - prod % ring_bytes;
+	return rec > room ? prod + room : prod;
+}
+
+
+/* packed slots: mark the end of the ring, if there is room for a header */
+
+static inline
+void pfq_ring_wrap(char *base, uint64_t prod, size_t ring_bytes)
+{
+	size_t room = ring_bytes - prod % ring_bytes;
+
+	if (room >= sizeof(struct pfq_pkthdr)) {
+		volatile struct pfq_pkthdr *hdr = (struct pfq_pkthdr *)(base + prod % ring_bytes);
+
+		hdr->len    = 0;
+		hdr->caplen = 0;
+
+		smp_wmb();
+
+		hdr->commit = Q_RX_RING_COMMIT(prod, ring_bytes);
+	}
+}
+
+
+/* per-cpu ring: this cpu is the only producer, no atomic operation is required */
+
+static
+size_t pfq_ring_enqueue_batch(struct pfq_rx_opt *ro,
+			      struct pfq_skbuff_batch *skbs,
+			      unsigned long long mask,
+			      int gid,
+			      int cpu)
+{
+	struct pfq_rx_ring *ring = pfq_get_rx_ring(ro, cpu);
+	size_t ring_bytes = pfq_rx_ring_bytes(ro);
+	char *base = pfq_rx_ring_base(ro, cpu);
+	uint64_t prod, cons;
+	struct sk_buff *skb;
+	size_t n, sent = 0;
+
+	if (unlikely((size_t)cpu >= ro->rings))
+		return 0;
+
+	prod = ring->prod;
+	cons = ACCESS_ONCE(ring->cons);
+
+	for_each_skbuff_bitmask(skbs, mask, skb, n)
+	{
+		volatile struct pfq_pkthdr *hdr;
+		size_t rec = pfq_rx_record_size(ro, skb);
+		uint64_t pos = pfq_ring_record_pos(prod, rec, ring_bytes);
+
+		if (pos + rec - cons > ring_bytes) {
+			pfq_wakeup_reader(ro);
+			break;
+		}
+
+		hdr = (struct pfq_pkthdr *)(base + pos % ring_bytes);
+
+		if (pfq_copy_to_slot(ro, hdr, skb, gid) < 0)
+			break;
+
+		if (pos != prod)
+			pfq_ring_wrap(base, prod, ring_bytes);
+
+		hdr->commit = Q_RX_RING_COMMIT(pos, ring_bytes);
+
+		prod = pos + rec;
+		sent++;
+	}
+
+	/* publish the slots (release semantic) */
+
+	smp_wmb();
+
+	ring->prod = prod;
+
+	pfq_rx_wakeup(ro, sent);
+
+	return sent;
+}
+
+
+/* multi-producer ring: slots are reserved with a cmpxchg on prod and committed one by one */
+
+static
+size_t pfq_mpsc_ring_enqueue_batch(struct pfq_rx_opt *ro,
+			           struct pfq_skbuff_batch *skbs,
+			           unsigned long long mask,
+			           int gid)
+{
+	struct pfq_rx_ring *ring = pfq_get_rx_ring(ro, 0);
+	size_t ring_bytes = pfq_rx_ring_bytes(ro);
+	char *base = pfq_rx_ring_base(ro, 0);
+	uint64_t prod, cons, end;
+	struct sk_buff *skb;
+	size_t n, slots, sent = 0;
+
+	/* reserve the slots */
+
+	do {
+		unsigned long long m = mask;
+
+		prod = end = ACCESS_ONCE(ring->prod);
+		cons = ACCESS_ONCE(ring->cons);
+		slots = 0;
+
+		for_each_skbuff_bitmask(skbs, m, skb, n)
+		{
+			size_t rec = pfq_rx_record_size(ro, skb);
+			uint64_t pos = pfq_ring_record_pos(end, rec, ring_bytes);
+
+			if (pos + rec - cons > ring_bytes)
+				break;
+
+			end = pos + rec;
+			slots++;
+		}
+
+		if (slots == 0) {
+			pfq_wakeup_reader(ro);
+			return 0;
+		}
+	}
+	while (cmpxchg64(&ring->prod, prod, end) != prod);
+
+	end = prod;
+
+	for_each_skbuff_bitmask(skbs, mask, skb, n)
+	{
+		volatile struct pfq_pkthdr *hdr;
+		size_t rec = pfq_rx_record_size(ro, skb);
+		uint64_t pos = pfq_ring_record_pos(end, rec, ring_bytes);
+
+		if (sent == slots)
+			break;
+
+		if (pos != end)
+			pfq_ring_wrap(base, end, ring_bytes);
+
+		hdr = (struct pfq_pkthdr *)(base + pos % ring_bytes);
+
+		/* a reserved slot is committed in any case, not to stall the reader */
+
+		if (pfq_copy_to_slot(ro, hdr, skb, gid) < 0)
+			hdr->caplen = 0;
+
+		/* commit the slot (release semantic) */
+
+		smp_wmb();
+
+		hdr->commit = Q_RX_RING_COMMIT(pos, ring_bytes);
+
+		end = pos + rec;
+		sent++;
+	}
+
+	pfq_rx_wakeup(ro, sent);
+
+	return sent;
 }
 
 
@@ -62,7 +398,8 @@ size_t pfq_mpsc_enqueue_batch(struct pfq_rx_opt *ro,
 		              struct pfq_skbuff_batch *skbs,
 		              unsigned long long mask,
 		              int burst_len,
-		              int gid)
+		              int gid,
+		              int cpu)
 {
 	struct pfq_rx_queue *rx_queue = pfq_get_rx_queue(ro);
 	int data, qlen, qindex;
@@ -74,6 +411,12 @@ size_t pfq_mpsc_enqueue_batch(struct pfq_rx_opt *ro,
 	if (unlikely(rx_queue == NULL))
 		return 0;
 
+	if (ro->mode == Q_RX_MODE_PERCPU_RINGS)
+		return pfq_ring_enqueue_batch(ro, skbs, mask, gid, cpu);
+
+	if (ro->mode == Q_RX_MODE_RING)
+		return pfq_mpsc_ring_enqueue_batch(ro, skbs, mask, gid);
+
 	data = atomic_read((atomic_t *)&rx_queue->data);
 
         if (Q_SHARED_QUEUE_LEN(data) > ro->queue_size)
@@ -88,65 +431,19 @@ size_t pfq_mpsc_enqueue_batch(struct pfq_rx_opt *ro,
 	for_each_skbuff_bitmask(skbs, mask, skb, n)
 	{
 		volatile struct pfq_pkthdr *hdr;
-		size_t bytes, slot_index;
-		char *pkt;
+		size_t slot_index;
 
-		bytes = min_t(size_t, skb->len, ro->caplen);
 		slot_index = qlen + sent;
 
 		hdr = (struct pfq_pkthdr *)this_slot;
-		pkt = (char *)(hdr+1);
 
 		if (slot_index > ro->queue_size) {
-
-			if (waitqueue_active(&ro->waitqueue)) {
-#ifdef PFQ_USE_EXTENDED_PROC
- 				sparse_inc(&global_stats.wake);
-#endif
-				wake_up_interruptible(&ro->waitqueue);
-			}
-
+			pfq_wakeup_reader(ro);
 			return sent;
 		}
 
-		/* copy bytes of packet */
-
-#ifdef PFQ_USE_SKB_LINEARIZE
-		if (unlikely(skb_is_nonlinear(skb)))
-#else
-		if (skb_is_nonlinear(skb))
-#endif
-		{
-			if (skb_copy_bits(skb, 0, pkt, bytes) != 0) {
-				printk(KERN_WARNING "[PFQ] BUG! skb_copy_bits failed (bytes=%zu, skb_len=%d mac_len=%d)!\n",
-							    bytes, skb->len, skb->mac_len);
-				return 0;
-			}
-		}
-		else {
-			pfq_skb_copy_from_linear_data(skb, pkt, bytes);
-		}
-
-                /* copy mark from pfq_cb (annotation) */
-
-                hdr->data = PFQ_CB(skb)->mark;
-
-		/* setup the header */
-
-		if (ro->tstamp != 0) {
-			struct timespec ts;
-			skb_get_timestampns(skb, &ts);
-			hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
-			hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
-		}
-
-		hdr->if_index    = skb->dev->ifindex & 0xff;
-		hdr->gid         = gid;
-
-		hdr->len         = (uint16_t)skb->len;
-		hdr->caplen 	 = (uint16_t)bytes;
-		hdr->un.vlan_tci = skb->vlan_tci & ~VLAN_TAG_PRESENT;
-		hdr->hw_queue    = (uint8_t)(skb_get_rx_queue(skb) & 0xff);
+		if (pfq_copy_to_slot(ro, hdr, skb, gid) < 0)
+			return 0;
 
 		/* commit the slot (release semantic) */
 
@@ -154,19 +451,13 @@ size_t pfq_mpsc_enqueue_batch(struct pfq_rx_opt *ro,
 
 		hdr->commit = (uint8_t)qindex;
 
-		if ((slot_index & 8191) == 0 &&
-				waitqueue_active(&ro->waitqueue)) {
-#ifdef PFQ_USE_EXTENDED_PROC
- 			sparse_inc(&global_stats.wake);
-#endif
-		        wake_up_interruptible(&ro->waitqueue);
-		}
-
 		sent++;
 
 		this_slot += ro->slot_size;
 	}
 
+	pfq_rx_wakeup(ro, sent);
+
 	return sent;
 }
 
@@ -174,6 +465,9 @@ size_t pfq_mpsc_enqueue_batch(struct pfq_rx_opt *ro,
 int
 pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr)
 {
+	if (pfq_shared_queue_releasing(so))
+		return -EBUSY;
+
 	if (!so->shmem.addr) {
 
 		struct pfq_shared_queue * queue;
@@ -201,6 +495,8 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr)
 		queue->rx.data      = (1L << 24);
 		queue->rx.size      = so->rx_opt.queue_size;
 		queue->rx.slot_size = so->rx_opt.slot_size;
+		queue->rx.mode      = so->rx_opt.mode | (so->rx_opt.packed ? Q_RX_MODE_PACKED : 0);
+		queue->rx.rings     = so->rx_opt.rings;
 
 		for(n = 0; n < Q_MAX_TX_QUEUES; n++)
 		{
@@ -218,6 +514,19 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr)
 
 		so->rx_opt.base_addr = so->shmem.addr + sizeof(struct pfq_shared_queue);
 
+		/* reset the wakeup timer (initialized with the socket) */
+
+		so->rx_opt.wakeup_armed = 0;
+
+		/* initialize rx rings */
+
+		for(n = 0; n < so->rx_opt.rings; n++)
+		{
+			struct pfq_rx_ring *ring = pfq_get_rx_ring(&so->rx_opt, n);
+			ring->prod = 0;
+			ring->cons = 0;
+		}
+
 		/* commit both the queues */
 
 		smp_wmb();
@@ -229,10 +538,13 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr)
 			atomic_long_set(&so->tx_opt.queue[n].queue_hdr, (long)&queue->tx[n]);
 		}
 
-		pr_devel("[PFQ|%d] Rx queue: len=%zu slot_size=%zu caplen=%zu, mem=%zu bytes\n", so->id,
+		pr_devel("[PFQ|%d] Rx queue: len=%zu slot_size=%zu caplen=%zu mode=%d packed=%d rings=%zu, mem=%zu bytes\n", so->id,
 				so->rx_opt.queue_size,
 				so->rx_opt.slot_size,
 				so->rx_opt.caplen,
+				so->rx_opt.mode,
+				so->rx_opt.packed,
+				so->rx_opt.rings,
 				pfq_queue_mpsc_mem(so));
 
 		pr_devel("[PFQ|%d] Tx queue: len=%zu slot_size=%zu maxlen=%d, mem=%zu bytes (%d queues)\n", so->id,
@@ -246,6 +558,62 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr)
 }
 
 
+void
+pfq_shared_queue_init(struct pfq_sock *so)
+{
+	hrtimer_init(&so->rx_opt.wakeup_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	so->rx_opt.wakeup_timer.function = pfq_wakeup_timer_handler;
+	so->rx_opt.wakeup_armed = 0;
+	atomic_set(&so->shmem_release, 0);
+}
+
+
+/*
+ * The memory of a disabled queue is released asynchronously, once no
+ * producer can refer to it (the Rx path runs under rcu_read_lock). The
+ * socket is held until then: close() and disable() do not wait.
+ */
+
+struct pfq_shmem_release
+{
+	struct rcu_head		rcu;
+	struct work_struct	work;
+	struct pfq_shmem_descr	shmem;
+	struct pfq_sock *	so;
+};
+
+
+static void
+pfq_shmem_release_work(struct work_struct *work)
+{
+	struct pfq_shmem_release *r = container_of(work, struct pfq_shmem_release, work);
+
+	pfq_shared_memory_free(&r->shmem);
+
+	pr_devel("[PFQ|%d] Tx/Rx queues memory released.\n", r->so->id);
+
+	/* the socket can be reconfigured and enabled again */
+
+	smp_mb__before_atomic();
+	atomic_set(&r->so->shmem_release, 0);
+
+	sock_put(&r->so->sk);
+	kfree(r);
+}
+
+
+static void
+pfq_shmem_release_rcu(struct rcu_head *rcu)
+{
+	struct pfq_shmem_release *r = container_of(rcu, struct pfq_shmem_release, rcu);
+
+	/* sleeping is required to release the memory: user-context */
+
+	INIT_WORK(&r->work, pfq_shmem_release_work);
+	schedule_work(&r->work);
+}
+
+
 int
 pfq_shared_queue_disable(struct pfq_sock *so)
 {
@@ -253,6 +621,8 @@ pfq_shared_queue_disable(struct pfq_sock *so)
 
 	if (so->shmem.addr) {
 
+		struct pfq_shmem_release *r;
+
 		atomic_long_set(&so->rx_opt.queue_hdr, 0);
 
 		for(n = 0; n < Q_MAX_TX_QUEUES; n++)
@@ -260,12 +630,31 @@ pfq_shared_queue_disable(struct pfq_sock *so)
 			atomic_long_set(&so->tx_opt.queue[n].queue_hdr, 0);
 		}
 
-		msleep(Q_GRACE_PERIOD);
+		hrtimer_cancel(&so->rx_opt.wakeup_timer);
+
+		r = kmalloc(sizeof(struct pfq_shmem_release), GFP_KERNEL);
+		if (r) {
+			r->shmem = so->shmem;
+			r->so = so;
+
+			/* geometry and re-enable are frozen until the release: producers
+			 * still in the grace period read them from rx_opt */
+
+			atomic_set(&so->shmem_release, 1);
 
-		pfq_shared_memory_free(&so->shmem);
+			sock_hold(&so->sk);
+			call_rcu(&r->rcu, pfq_shmem_release_rcu);
+		}
+		else {
+			synchronize_rcu();
+			hrtimer_cancel(&so->rx_opt.wakeup_timer);
+			pfq_shared_memory_free(&so->shmem);
+		}
 
 		so->shmem.addr = NULL;
 		so->shmem.size = 0;
+		so->shmem.hugepages = NULL;
+		so->shmem.npages = 0;
 
 		pr_devel("[PFQ|%d] Tx/Rx queues disabled.\n", so->id);
 	}
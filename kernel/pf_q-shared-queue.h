@@ -34,6 +34,7 @@
 #include <pf_q-GC.h>
 
 
+void pfq_shared_queue_init(struct pfq_sock *so);
 int pfq_shared_queue_enable(struct pfq_sock *so, unsigned long addr);
 int pfq_shared_queue_disable(struct pfq_sock *so);
 
@@ -41,11 +42,27 @@ extern size_t pfq_mpsc_enqueue_batch(struct pfq_rx_opt *ro,
 		                     struct pfq_skbuff_batch *skbs,
 		                     unsigned long long skbs_mask,
 		                     int burst_len,
-		                     int gid);
+		                     int gid,
+		                     int cpu);
+
+
+static inline bool pfq_shared_queue_releasing(struct pfq_sock *so)
+{
+	return atomic_read(&so->shmem_release) != 0;
+}
+
+
+static inline size_t pfq_rx_ring_bytes(struct pfq_rx_opt *ro)
+{
+	return ro->queue_size * ro->slot_size;
+}
 
 
 static inline size_t pfq_queue_mpsc_mem(struct pfq_sock *so)
 {
+	if (so->rx_opt.mode != Q_RX_MODE_DOUBLE_BUFFER)
+		return so->rx_opt.rings * (sizeof(struct pfq_rx_ring) + pfq_rx_ring_bytes(&so->rx_opt));
+
         return so->rx_opt.queue_size * so->rx_opt.slot_size * 2;
 }
 
@@ -55,12 +72,41 @@ static inline size_t pfq_queue_spsc_mem(struct pfq_sock *so)
 }
 
 
+static inline
+struct pfq_rx_ring *
+pfq_get_rx_ring(struct pfq_rx_opt *ro, int n)
+{
+	return (struct pfq_rx_ring *)ro->base_addr + n;
+}
+
+
+static inline
+char *pfq_rx_ring_base(struct pfq_rx_opt *ro, int n)
+{
+	return (char *)ro->base_addr + ro->rings * sizeof(struct pfq_rx_ring) + n * pfq_rx_ring_bytes(ro);
+}
+
+
 static inline
 size_t pfq_mpsc_queue_len(struct pfq_sock *p)
 {
 	struct pfq_shared_queue *q = pfq_get_shared_queue(p);
+	size_t n, len = 0;
+
 	if (!q)
 		return 0;
+
+	if (p->rx_opt.mode != Q_RX_MODE_DOUBLE_BUFFER) {
+
+		for(n = 0; n < p->rx_opt.rings; n++)
+		{
+			struct pfq_rx_ring *ring = pfq_get_rx_ring(&p->rx_opt, n);
+			len += DIV_ROUND_UP((size_t)(ACCESS_ONCE(ring->prod) - ACCESS_ONCE(ring->cons)), p->rx_opt.slot_size);
+		}
+
+		return len;
+	}
+
         return Q_SHARED_QUEUE_LEN(q->rx.data);
 }
 
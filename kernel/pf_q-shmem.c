@@ -29,6 +29,7 @@
 
 #include <pf_q-shmem.h>
 #include <pf_q-shared-queue.h>
+#include <pf_q-group.h>
 
 
 static int
@@ -74,6 +75,20 @@ pfq_mmap(struct file *file, struct socket *sock, struct vm_area_struct *vma)
                 return -EINVAL;
         }
 
+        /* export ring of the flow table of a group */
+
+        if (vma->vm_pgoff) {
+
+                int gid = (int)vma->vm_pgoff - 1;
+
+                if (gid >= Q_MAX_GROUP || !__pfq_has_joined_group(gid, so->id)) {
+                        printk(KERN_WARNING "[PFQ|%d] pfq_mmap: flow ring of gid=%d: permission denied!\n", so->id, gid);
+                        return -EACCES;
+                }
+
+                return pfq_map_group_flow_ring(gid, vma);
+        }
+
         if(size > so->shmem.size) {
                 printk(KERN_WARNING "[PFQ] pfq_mmap: area too large!\n");
                 return -EINVAL;
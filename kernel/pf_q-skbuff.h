@@ -30,13 +30,24 @@ struct pfq_monad;
 struct gc_log;
 
 
+/* headers parsed once per packet and shared by PFQ/lang functions */
+
+struct pfq_hdr_cache
+{
+	uint16_t	 l4_off;
+	uint8_t		 l4_proto;
+	uint8_t		 flags;
+};
+
+
 struct pfq_cb
 {
 	unsigned long 	 mark;
-        unsigned long 	 group_mask;
 	struct gc_log 	 *log;
 	struct pfq_monad *monad;
 	int 		 direct;
+	struct pfq_hdr_cache hdr;
+	uint32_t 	 hash;		/* steering hash of the current group (Q_HDR_HASH) */
 };
 
 /* wrapper used in garbage collector */
@@ -0,0 +1,291 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/random.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+
+#include <pf_q-sketch.h>
+
+
+struct pfq_sketch *
+pfq_sketch_alloc(int depth, size_t width, size_t topk)
+{
+        struct pfq_sketch *s;
+        int cpu;
+
+        if (depth <= 0 || depth > Q_MAX_SKETCH_DEPTH)
+                return NULL;
+
+        if (width == 0 || width > Q_MAX_SKETCH_WIDTH || topk == 0 || topk > Q_MAX_TOPK)
+                return NULL;
+
+        s = kzalloc(sizeof(*s) + nr_cpu_ids * sizeof(s->table[0]), GFP_KERNEL);
+        if (!s)
+                return NULL;
+
+        s->depth = depth;
+        s->width = roundup_pow_of_two(width);
+        s->topk  = topk;
+
+        get_random_bytes(s->seed, sizeof(s->seed));
+
+        for_each_possible_cpu(cpu)
+        {
+                size_t counters = sizeof(uint32_t) * depth * s->width;
+                struct pfq_sketch_table *t;
+
+                t = vzalloc_node(sizeof(struct pfq_sketch_table) + counters + topk * sizeof(struct pfq_heavy_hitter),
+                                 cpu_to_node(cpu));
+                if (!t) {
+                        pfq_sketch_free(s);
+                        return NULL;
+                }
+
+                t->heap = (struct pfq_heavy_hitter *)((char *)t->counter + counters);
+                s->table[cpu] = t;
+        }
+
+        return s;
+}
+
+
+void
+pfq_sketch_free(struct pfq_sketch *s)
+{
+        int cpu;
+
+        if (!s)
+                return;
+
+        for_each_possible_cpu(cpu)
+                vfree(s->table[cpu]);
+
+        kfree(s);
+}
+
+
+/* called by the owner cpu, on the first update of a new window */
+
+void
+__pfq_sketch_table_clear(struct pfq_sketch *s, struct pfq_sketch_table *t)
+{
+        memset(t->counter, 0, sizeof(uint32_t) * s->depth * s->width);
+        t->used = 0;
+        smp_wmb();
+        t->epoch = ACCESS_ONCE(s->epoch);
+}
+
+
+static void
+__pfq_heap_sift_down(struct pfq_heavy_hitter *heap, size_t n, size_t i)
+{
+        for(;;)
+        {
+                size_t l = 2 * i + 1, r = l + 1, min = i;
+                struct pfq_heavy_hitter tmp;
+
+                if (l < n && heap[l].count < heap[min].count)
+                        min = l;
+                if (r < n && heap[r].count < heap[min].count)
+                        min = r;
+                if (min == i)
+                        return;
+
+                tmp = heap[i]; heap[i] = heap[min]; heap[min] = tmp;
+                i = min;
+        }
+}
+
+
+static void
+__pfq_heap_sift_up(struct pfq_heavy_hitter *heap, size_t i)
+{
+        while (i > 0)
+        {
+                size_t p = (i - 1) / 2;
+                struct pfq_heavy_hitter tmp;
+
+                if (heap[p].count <= heap[i].count)
+                        return;
+
+                tmp = heap[i]; heap[i] = heap[p]; heap[p] = tmp;
+                i = p;
+        }
+}
+
+
+/* the estimate of key has grown (or the key is new): update the heap of this cpu */
+
+void
+__pfq_sketch_topk_update(struct pfq_sketch *s, struct pfq_sketch_table *t, uint64_t key, uint64_t count)
+{
+        size_t i;
+
+        for(i = 0; i < t->used; i++)
+        {
+                if (t->heap[i].key == key) {
+                        t->heap[i].count = count;
+                        __pfq_heap_sift_down(t->heap, t->used, i);
+                        return;
+                }
+        }
+
+        if (t->used < s->topk) {
+                t->heap[t->used].key = key;
+                t->heap[t->used].count = count;
+                __pfq_heap_sift_up(t->heap, t->used);
+                smp_wmb();
+                ACCESS_ONCE(t->used) = t->used + 1;
+                return;
+        }
+
+        /* replace the minimum */
+
+        t->heap[0].key = key;
+        t->heap[0].count = count;
+        __pfq_heap_sift_down(t->heap, t->used, 0);
+}
+
+
+static int
+__pfq_key_cmp(const void *a, const void *b)
+{
+        const struct pfq_heavy_hitter *x = a, *y = b;
+
+        return x->key < y->key ? -1 : x->key > y->key;
+}
+
+
+static int
+__pfq_count_cmp(const void *a, const void *b)
+{
+        const struct pfq_heavy_hitter *x = a, *y = b;
+
+        return x->count > y->count ? -1 : x->count < y->count;
+}
+
+
+/* estimate of the key summing the counters of all the cpus (in the current window) */
+
+static uint64_t
+__pfq_sketch_global_estimate(struct pfq_sketch *s, uint64_t key)
+{
+        uint64_t est = (uint64_t)-1;
+        int d, cpu;
+
+        for(d = 0; d < s->depth; d++)
+        {
+                size_t i = __pfq_sketch_index(s, key, d);
+                uint64_t sum = 0;
+
+                for_each_possible_cpu(cpu)
+                {
+                        struct pfq_sketch_table *t = s->table[cpu];
+
+                        if (ACCESS_ONCE(t->epoch) == s->epoch)
+                                sum += ACCESS_ONCE(t->counter[i]);
+                }
+
+                if (sum < est)
+                        est = sum;
+        }
+
+        return est;
+}
+
+
+/*
+ * Copy the merged top-K to user-space, up to *size entries (sorted by count).
+ * The candidates are the keys of the per-cpu heaps, their counts are
+ * estimated on the sum of the per-cpu sketches. On return *size holds the
+ * entries copied. The sketch must not be released meanwhile (group_sem held).
+ */
+
+int
+pfq_sketch_read_topk(struct pfq_sketch *s, struct pfq_heavy_hitter __user *entry, size_t *size)
+{
+        struct pfq_heavy_hitter *cand;
+        size_t n = 0, u = 0, i;
+        int cpu, err = 0;
+
+        cand = vmalloc(nr_cpu_ids * s->topk * sizeof(*cand));
+        if (!cand)
+                return -ENOMEM;
+
+        for_each_possible_cpu(cpu)
+        {
+                struct pfq_sketch_table *t = s->table[cpu];
+                size_t used;
+
+                if (ACCESS_ONCE(t->epoch) != s->epoch)
+                        continue;
+
+                used = min_t(size_t, ACCESS_ONCE(t->used), s->topk);
+                smp_rmb();
+
+                for(i = 0; i < used; i++)
+                        cand[n++].key = ACCESS_ONCE(t->heap[i].key);
+        }
+
+        /* remove the duplicates and estimate the counts */
+
+        sort(cand, n, sizeof(*cand), __pfq_key_cmp, NULL);
+
+        for(i = 0; i < n; i++)
+        {
+                if (u && cand[u-1].key == cand[i].key)
+                        continue;
+
+                cand[u].key = cand[i].key;
+                cand[u].count = __pfq_sketch_global_estimate(s, cand[i].key);
+                u++;
+        }
+
+        sort(cand, u, sizeof(*cand), __pfq_count_cmp, NULL);
+
+        *size = min3(*size, u, s->topk);
+
+        if (*size && copy_to_user(entry, cand, *size * sizeof(*cand)))
+                err = -EFAULT;
+
+        vfree(cand);
+        return err;
+}
+
+
+/* start a new measurement window: the tables are cleared lazily by their cpu */
+
+void
+pfq_sketch_reset(struct pfq_sketch *s)
+{
+        smp_wmb();
+        ACCESS_ONCE(s->epoch) = s->epoch + 1;
+}
@@ -0,0 +1,143 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#ifndef PF_Q_SKETCH_H
+#define PF_Q_SKETCH_H
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/smp.h>
+#include <linux/jhash.h>
+
+#include <linux/pf_q.h>
+
+
+/*
+ * Heavy hitters: count-min sketch and top-K.
+ *
+ * A sketch holds, per cpu, depth rows of width 32-bit counters and a small
+ * min-heap of the keys with the highest estimates, written by their own cpu
+ * only (in softirq), so that updates take no locks. The estimate of a key
+ * is the minimum of its counters (never lower than the true count).
+ *
+ * Measurement windows are handled with an epoch: a reader starting a new
+ * window bumps the epoch of the sketch and each cpu clears its table upon
+ * the next update; tables of a previous epoch are ignored.
+ *
+ * The heaps are read by other cpus without synchronization: a key can be
+ * missed or reported twice while the heap is being reordered, its count is
+ * recomputed from the counters anyway.
+ */
+
+struct pfq_sketch_table
+{
+        unsigned long           epoch;
+        size_t                  used;           /* keys in the heap */
+
+        struct pfq_heavy_hitter *heap;          /* topk, min-heap by count */
+        uint32_t                counter[];      /* depth * width */
+};
+
+
+struct pfq_sketch
+{
+        int                     depth;
+        size_t                  width;          /* power of 2 */
+        size_t                  topk;
+        unsigned long           epoch;
+        uint32_t                seed[Q_MAX_SKETCH_DEPTH];
+
+        struct pfq_sketch_table *table[];       /* nr_cpu_ids */
+};
+
+
+extern struct pfq_sketch * pfq_sketch_alloc(int depth, size_t width, size_t topk);
+extern void pfq_sketch_free(struct pfq_sketch *s);
+
+extern int pfq_sketch_read_topk(struct pfq_sketch *s, struct pfq_heavy_hitter __user *entry, size_t *size);
+extern void pfq_sketch_reset(struct pfq_sketch *s);
+
+extern void __pfq_sketch_table_clear(struct pfq_sketch *s, struct pfq_sketch_table *t);
+extern void __pfq_sketch_topk_update(struct pfq_sketch *s, struct pfq_sketch_table *t, uint64_t key, uint64_t count);
+
+
+static inline size_t
+__pfq_sketch_index(struct pfq_sketch const *s, uint64_t key, int row)
+{
+        return row * s->width + (jhash_2words((u32)key, (u32)(key >> 32), s->seed[row]) & (s->width - 1));
+}
+
+
+/* count the key in the sketch of this cpu and return its estimate */
+
+static inline uint64_t
+pfq_sketch_update(struct pfq_sketch *s, uint64_t key)
+{
+        struct pfq_sketch_table *t = s->table[smp_processor_id()];
+        uint32_t est = (uint32_t)-1;
+        int d;
+
+        if (unlikely(t->epoch != ACCESS_ONCE(s->epoch)))
+                __pfq_sketch_table_clear(s, t);
+
+        for(d = 0; d < s->depth; d++)
+        {
+                uint32_t c = ++t->counter[__pfq_sketch_index(s, key, d)];
+                if (c < est)
+                        est = c;
+        }
+
+        /* keys below the minimum of a full heap cannot enter it */
+
+        if (t->used < s->topk || est > t->heap[0].count)
+                __pfq_sketch_topk_update(s, t, key, est);
+
+        return est;
+}
+
+
+/* estimate of the key in the sketch of this cpu (in the current window) */
+
+static inline uint64_t
+pfq_sketch_estimate(struct pfq_sketch *s, uint64_t key)
+{
+        struct pfq_sketch_table *t = s->table[smp_processor_id()];
+        uint32_t est = (uint32_t)-1;
+        int d;
+
+        if (t->epoch != ACCESS_ONCE(s->epoch))
+                return 0;
+
+        for(d = 0; d < s->depth; d++)
+        {
+                uint32_t c = t->counter[__pfq_sketch_index(s, key, d)];
+                if (c < est)
+                        est = c;
+        }
+
+        return est;
+}
+
+
+#endif /* PF_Q_SKETCH_H */
@@ -26,6 +26,7 @@
 
 #include <linux/kernel.h>
 #include <linux/poll.h>
+#include <linux/hrtimer.h>
 #include <linux/pf_q.h>
 
 #include <net/sock.h>
@@ -50,8 +51,21 @@ struct pfq_rx_opt
 	size_t 			queue_size;
 	size_t 			slot_size;
 
+	int 			mode;		/* Q_RX_MODE_... */
+	size_t 			rings;		/* number of rings (ring modes) */
+	int 			packed;		/* variable-length slots (ring modes) */
+	int 			ext;		/* slots end with a pfq_pkthdr_ext */
+
 	wait_queue_head_t 	waitqueue;
 
+	int 			wakeup;		/* packets enqueued before waking up a sleeping reader */
+	int 			wakeup_delay;	/* max wakeup delay, in usec (0 = disabled) */
+	int 			wakeup_batch;	/* packets counted per cpu before adding them to wakeup_pending */
+	sparse_counter_t	wakeup_local;
+	atomic_t 		wakeup_pending;
+	unsigned long 		wakeup_armed;
+	struct hrtimer 		wakeup_timer;
+
         struct pfq_socket_rx_stats stats;
 
 } ____cacheline_aligned_in_smp;
@@ -65,6 +79,16 @@ pfq_get_rx_queue(struct pfq_rx_opt *that)
 }
 
 
+/* each cpu holds back at most wakeup/ncpus packets: a reader without
+ * wakeup delay may wait for up to twice the wakeup packets */
+
+static inline
+int pfq_rx_wakeup_batch(int wakeup)
+{
+	return max_t(int, wakeup / num_online_cpus(), 1);
+}
+
+
 static inline
 void pfq_rx_opt_init(struct pfq_rx_opt *that, size_t caplen)
 {
@@ -84,10 +108,29 @@ void pfq_rx_opt_init(struct pfq_rx_opt *that, size_t caplen)
         that->queue_size = 0;
         that->slot_size = 0;
 
+        /* double buffer queue by default */
+
+        that->mode  = Q_RX_MODE_DOUBLE_BUFFER;
+        that->rings = 0;
+        that->packed = 0;
+
+        /* standard packet header by default */
+
+        that->ext = 0;
+
         /* initialize waitqueue */
 
         init_waitqueue_head(&that->waitqueue);
 
+        /* wakeup coalescing (the timer is set up when the socket is enabled) */
+
+        that->wakeup = Q_RX_WAKEUP_DEFAULT;
+        that->wakeup_batch = pfq_rx_wakeup_batch(that->wakeup);
+        that->wakeup_delay = 0;
+        sparse_set(&that->wakeup_local, 0);
+        atomic_set(&that->wakeup_pending, 0);
+        that->wakeup_armed = 0;
+
         /* reset stats */
         sparse_set(&that->stats.recv, 0);
         sparse_set(&that->stats.lost, 0);
@@ -170,7 +213,10 @@ struct pfq_sock
         int 		    	egress_index;
         int 		    	egress_queue;
 
+	int 			weight;		/* steering weight (consistent steering) */
+
 	struct pfq_shmem_descr  shmem;
+	atomic_t		shmem_release;	/* disabled queue memory not yet released */
 
         struct pfq_rx_opt   	rx_opt;
         struct pfq_tx_opt   	tx_opt;
@@ -132,6 +132,7 @@ int pfq_getsockopt(struct socket *sock,
 
 		stat.frwd = 0;
 		stat.kern = 0;
+		stat.spill = 0;
 
                 stat.sent = sparse_read(&so->tx_opt.stats.sent);
                 stat.disc = sparse_read(&so->tx_opt.stats.disc);
@@ -175,6 +176,48 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_RX_MODE:
+        {
+                int mode = so->rx_opt.mode | (so->rx_opt.packed ? Q_RX_MODE_PACKED : 0);
+
+                if (len != sizeof(mode))
+                        return -EINVAL;
+                if (copy_to_user(optval, &mode, sizeof(mode)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_RX_WAKEUP:
+        {
+                if (len != sizeof(so->rx_opt.wakeup))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->rx_opt.wakeup, sizeof(so->rx_opt.wakeup)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_RX_WAKEUP_DELAY:
+        {
+                if (len != sizeof(so->rx_opt.wakeup_delay))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->rx_opt.wakeup_delay, sizeof(so->rx_opt.wakeup_delay)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_RX_HDR_EXT:
+        {
+                if (len != sizeof(so->rx_opt.ext))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->rx_opt.ext, sizeof(so->rx_opt.ext)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_WEIGHT:
+        {
+                if (len != sizeof(so->weight))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->weight, sizeof(so->weight)))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_RX_SLOTS:
         {
                 if (len != sizeof(so->rx_opt.queue_size))
@@ -193,11 +236,17 @@ int pfq_getsockopt(struct socket *sock,
 
         case Q_SO_GET_GROUPS:
         {
-                unsigned long grps;
-                if(len != sizeof(unsigned long))
+                /* one or more words: the mask exceeding Q_MAX_GROUP is zero-filled */
+
+                unsigned long grps[Q_MAX_GROUP_WORDS];
+                size_t bytes = min_t(size_t, len, sizeof(grps));
+
+                if(len <= 0 || (len % sizeof(unsigned long)) != 0)
                         return -EINVAL;
-                grps = pfq_get_groups(so->id);
-                if (copy_to_user(optval, &grps, sizeof(grps)))
+                pfq_get_groups(so->id, grps);
+                if (copy_to_user(optval, grps, bytes))
+                        return -EFAULT;
+                if ((size_t)len > bytes && clear_user(optval + bytes, len - bytes))
                         return -EFAULT;
         } break;
 
@@ -236,6 +285,7 @@ int pfq_getsockopt(struct socket *sock,
                 stat.drop = sparse_read(&g->stats.drop);
                 stat.frwd = sparse_read(&g->stats.frwd);
                 stat.kern = sparse_read(&g->stats.kern);
+                stat.spill = sparse_read(&g->stats.spill);
 
                 stat.lost = 0;
                 stat.sent = 0;
@@ -285,6 +335,121 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_GROUP_STATE_MAP:
+        {
+                struct pfq_group_state state;
+                int err;
+
+                if (len != sizeof(state))
+                        return -EINVAL;
+
+                if (copy_from_user(&state, optval, sizeof(state)))
+                        return -EFAULT;
+
+                err = pfq_check_group(so->id, state.gid, "group state map");
+                if (err != 0)
+                	return err;
+
+                if (!__pfq_group_access(state.gid, so->id, Q_POLICY_GROUP_UNDEFINED, false)) {
+                        printk(KERN_INFO "[PFQ|%d] group state map error: permission denied (gid=%d)!\n", so->id, state.gid);
+                        return -EACCES;
+                }
+
+                err = pfq_get_group_state_map(state.gid, &state);
+                if (err != 0)
+                        return err;
+
+                pr_devel("[PFQ|%d] state map: gid=%d index=%d entries=%zu/%zu\n", so->id, state.gid, state.index, state.size, state.total);
+
+                if (copy_to_user(optval, &state, sizeof(state)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_GROUP_TOPK:
+        {
+                struct pfq_group_topk topk;
+                int err;
+
+                if (len != sizeof(topk))
+                        return -EINVAL;
+
+                if (copy_from_user(&topk, optval, sizeof(topk)))
+                        return -EFAULT;
+
+                err = pfq_check_group(so->id, topk.gid, "group top-k");
+                if (err != 0)
+                	return err;
+
+                if (!__pfq_group_access(topk.gid, so->id, Q_POLICY_GROUP_UNDEFINED, false)) {
+                        printk(KERN_INFO "[PFQ|%d] group top-k error: permission denied (gid=%d)!\n", so->id, topk.gid);
+                        return -EACCES;
+                }
+
+                err = pfq_get_group_topk(topk.gid, &topk);
+                if (err != 0)
+                        return err;
+
+                pr_devel("[PFQ|%d] top-k: gid=%d entries=%zu\n", so->id, topk.gid, topk.size);
+
+                if (copy_to_user(optval, &topk, sizeof(topk)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_GROUP_LANG_STATS:
+        {
+                struct pfq_computation_tree *comp;
+                struct pfq_lang_stats *ls;
+                int n, err, gid;
+
+                if (len != sizeof(*ls))
+                        return -EINVAL;
+
+                ls = kmalloc(sizeof(*ls), GFP_KERNEL);
+                if (ls == NULL)
+                        return -ENOMEM;
+
+                if (copy_from_user(ls, optval, sizeof(*ls))) {
+                        kfree(ls);
+                        return -EFAULT;
+                }
+
+                gid = ls->gid;
+
+                err = pfq_check_group(so->id, gid, "group lang stats");
+                if (err != 0) {
+                        kfree(ls);
+                	return err;
+                }
+
+                if (!__pfq_group_access(gid, so->id, Q_POLICY_GROUP_UNDEFINED, false)) {
+                        printk(KERN_INFO "[PFQ|%d] group lang stats error: permission denied (gid=%d)!\n", so->id, gid);
+                        kfree(ls);
+                        return -EACCES;
+                }
+
+                memset(ls->node, 0, sizeof(ls->node));
+
+                down(&group_sem);
+
+                comp = (struct pfq_computation_tree *)atomic_long_read(&pfq_get_group(gid)->comp);
+
+                ls->size = comp ? (int)min_t(size_t, comp->size, Q_MAX_LANG_STATS_NODES) : 0;
+
+                for(n = 0; n < ls->size; n++)
+                {
+                        pfq_computation_stats(comp, n, &ls->node[n]);
+                }
+
+                up(&group_sem);
+
+                pr_devel("[PFQ|%d] group lang stats: gid=%d nodes=%d\n", so->id, gid, ls->size);
+
+                err = copy_to_user(optval, ls, sizeof(*ls)) ? -EFAULT : 0;
+                kfree(ls);
+                if (err)
+                        return err;
+        } break;
+
         default:
                 return -EFAULT;
         }
@@ -471,13 +636,18 @@ int pfq_setsockopt(struct socket *sock,
                 if (copy_from_user(&caplen, optval, optlen))
                         return -EFAULT;
 
+                if (pfq_shared_queue_releasing(so)) {
+                        printk(KERN_INFO "[PFQ|%d] Rx caplen: queue memory release pending!\n", so->id);
+                        return -EBUSY;
+                }
+
                 if (caplen > (size_t)cap_len) {
                         printk(KERN_INFO "[PFQ|%d] invalid caplen=%zu (max %d)\n", so->id, caplen, cap_len);
                         return -EPERM;
                 }
 
                 so->rx_opt.caplen = caplen;
-                so->rx_opt.slot_size = Q_MPDB_QUEUE_SLOT_SIZE(so->rx_opt.caplen);
+                so->rx_opt.slot_size = Q_MPDB_QUEUE_SLOT_SIZE(so->rx_opt.caplen) + Q_RX_HDR_EXT_SIZE(so->rx_opt.ext);
 
                 pr_devel("[PFQ|%d] caplen=%zu, slot_size=%zu\n",
                                 so->id, so->rx_opt.caplen, so->rx_opt.slot_size);
@@ -493,6 +663,11 @@ int pfq_setsockopt(struct socket *sock,
                 if (copy_from_user(&slots, optval, optlen))
                         return -EFAULT;
 
+                if (pfq_shared_queue_releasing(so)) {
+                        printk(KERN_INFO "[PFQ|%d] Rx slots: queue memory release pending!\n", so->id);
+                        return -EBUSY;
+                }
+
                 if (slots > (size_t)max_queue_slots) {
                         printk(KERN_INFO "[PFQ|%d] invalid Rx slots=%zu (max %d)\n", so->id, slots, max_queue_slots);
                         return -EPERM;
@@ -503,6 +678,223 @@ int pfq_setsockopt(struct socket *sock,
                 pr_devel("[PFQ|%d] rx_queue slots=%zu\n", so->id, so->rx_opt.queue_size);
         } break;
 
+        case Q_SO_SET_RX_MODE:
+        {
+                typeof(so->rx_opt.mode) mode;
+                int packed;
+
+                if (optlen != sizeof(mode))
+                        return -EINVAL;
+                if (copy_from_user(&mode, optval, optlen))
+                        return -EFAULT;
+
+                if (pfq_shared_queue_releasing(so)) {
+                        printk(KERN_INFO "[PFQ|%d] Rx mode: queue memory release pending!\n", so->id);
+                        return -EBUSY;
+                }
+
+                if (so->shmem.addr) {
+                        printk(KERN_INFO "[PFQ|%d] Rx mode: socket already enabled!\n", so->id);
+                        return -EPERM;
+                }
+
+                packed = (mode & Q_RX_MODE_PACKED) != 0;
+                mode  &= ~Q_RX_MODE_PACKED;
+
+                switch(mode)
+                {
+                case Q_RX_MODE_DOUBLE_BUFFER:
+                        if (packed) {
+                                printk(KERN_INFO "[PFQ|%d] Rx mode: packed slots require a ring mode!\n", so->id);
+                                return -EINVAL;
+                        }
+                        so->rx_opt.rings = 0;
+                        break;
+                case Q_RX_MODE_PERCPU_RINGS:
+                        so->rx_opt.rings = nr_cpu_ids;
+                        break;
+                case Q_RX_MODE_RING:
+                        /* records are committed out of order: a header of packed slots
+                         * could land on stale payload that looks committed */
+                        if (packed) {
+                                printk(KERN_INFO "[PFQ|%d] Rx mode: packed slots are not supported by the multi-producer ring!\n", so->id);
+                                return -EINVAL;
+                        }
+                        so->rx_opt.rings = 1;
+                        break;
+                default:
+                        printk(KERN_INFO "[PFQ|%d] invalid Rx mode=%d\n", so->id, mode);
+                        return -EINVAL;
+                }
+
+                so->rx_opt.mode   = mode;
+                so->rx_opt.packed = packed;
+
+                pr_devel("[PFQ|%d] rx_queue mode=%d packed=%d rings=%zu\n", so->id, so->rx_opt.mode, so->rx_opt.packed, so->rx_opt.rings);
+        } break;
+
+        case Q_SO_SET_RX_HDR_EXT:
+        {
+                typeof(so->rx_opt.ext) ext;
+
+                if (optlen != sizeof(ext))
+                        return -EINVAL;
+                if (copy_from_user(&ext, optval, optlen))
+                        return -EFAULT;
+
+                if (pfq_shared_queue_releasing(so)) {
+                        printk(KERN_INFO "[PFQ|%d] Rx extended header: queue memory release pending!\n", so->id);
+                        return -EBUSY;
+                }
+
+                if (so->shmem.addr) {
+                        printk(KERN_INFO "[PFQ|%d] Rx extended header: socket already enabled!\n", so->id);
+                        return -EPERM;
+                }
+
+                so->rx_opt.ext = ext ? 1 : 0;
+                so->rx_opt.slot_size = Q_MPDB_QUEUE_SLOT_SIZE(so->rx_opt.caplen) + Q_RX_HDR_EXT_SIZE(so->rx_opt.ext);
+
+                pr_devel("[PFQ|%d] Rx extended header=%d, slot_size=%zu\n", so->id, so->rx_opt.ext, so->rx_opt.slot_size);
+        } break;
+
+        case Q_SO_SET_RX_WAKEUP:
+        {
+                typeof(so->rx_opt.wakeup) wakeup;
+
+                if (optlen != sizeof(wakeup))
+                        return -EINVAL;
+                if (copy_from_user(&wakeup, optval, optlen))
+                        return -EFAULT;
+
+                if (wakeup < 1) {
+                        printk(KERN_INFO "[PFQ|%d] invalid Rx wakeup=%d\n", so->id, wakeup);
+                        return -EINVAL;
+                }
+
+                so->rx_opt.wakeup = wakeup;
+                so->rx_opt.wakeup_batch = pfq_rx_wakeup_batch(wakeup);
+
+                pr_devel("[PFQ|%d] rx_queue wakeup=%d packets\n", so->id, so->rx_opt.wakeup);
+        } break;
+
+        case Q_SO_SET_RX_WAKEUP_DELAY:
+        {
+                typeof(so->rx_opt.wakeup_delay) delay;
+
+                if (optlen != sizeof(delay))
+                        return -EINVAL;
+                if (copy_from_user(&delay, optval, optlen))
+                        return -EFAULT;
+
+                if (delay < 0) {
+                        printk(KERN_INFO "[PFQ|%d] invalid Rx wakeup delay=%d\n", so->id, delay);
+                        return -EINVAL;
+                }
+
+                so->rx_opt.wakeup_delay = delay;
+
+                pr_devel("[PFQ|%d] rx_queue wakeup delay=%d usec\n", so->id, so->rx_opt.wakeup_delay);
+        } break;
+
+        case Q_SO_SET_WEIGHT:
+        {
+                typeof(so->weight) weight;
+
+                if (optlen != sizeof(weight))
+                        return -EINVAL;
+                if (copy_from_user(&weight, optval, optlen))
+                        return -EFAULT;
+
+                if (weight < 1 || weight > Q_MAX_STEERING_WEIGHT) {
+                        printk(KERN_INFO "[PFQ|%d] invalid steering weight=%d (max %d)\n", so->id, weight, Q_MAX_STEERING_WEIGHT);
+                        return -EINVAL;
+                }
+
+                so->weight = weight;
+
+                /* rebuild the steering tables of the joined groups */
+
+                pfq_update_steering(so->id);
+
+                pr_devel("[PFQ|%d] steering weight=%d\n", so->id, so->weight);
+        } break;
+
+        case Q_SO_GROUP_STEERING:
+        {
+                struct pfq_group_steering steer;
+                int err;
+
+                if (optlen != sizeof(steer))
+                        return -EINVAL;
+
+                if (copy_from_user(&steer, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_check_group_access(so->id, steer.gid, "group steering");
+                if (err != 0)
+                	return err;
+
+                err = pfq_set_group_steering(steer.gid, steer.mode);
+                if (err != 0) {
+                        printk(KERN_INFO "[PFQ|%d] group steering error: invalid mode=%d for gid=%d!\n", so->id, steer.mode, steer.gid);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] steering mode=%d for gid=%d\n", so->id, steer.mode, steer.gid);
+        } break;
+
+        case Q_SO_GROUP_SPILL:
+        {
+                struct pfq_group_spill spill;
+                int err;
+
+                if (optlen != sizeof(spill))
+                        return -EINVAL;
+
+                if (copy_from_user(&spill, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_check_group_access(so->id, spill.gid, "group spill");
+                if (err != 0)
+                	return err;
+
+                err = pfq_set_group_spill(spill.gid, spill.policy, spill.threshold);
+                if (err != 0) {
+                        printk(KERN_INFO "[PFQ|%d] group spill error: policy=%d threshold=%d for gid=%d (%d)!\n", so->id, spill.policy, spill.threshold, spill.gid, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] spill policy=%d threshold=%d%% for gid=%d\n", so->id, spill.policy, spill.threshold, spill.gid);
+        } break;
+
+        case Q_SO_GROUP_FUNCTION_ARG:
+        {
+                struct pfq_group_function_arg tmp;
+                int err;
+
+                if (optlen != sizeof(tmp))
+                        return -EINVAL;
+
+                if (copy_from_user(&tmp, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_check_group_access(so->id, tmp.gid, "group function argument");
+                if (err != 0)
+                	return err;
+
+                if (tmp.index < 0)
+                        return -EINVAL;
+
+                err = pfq_set_group_function_arg(tmp.gid, tmp.index, tmp.arg, &tmp.value);
+                if (err != 0) {
+                        printk(KERN_INFO "[PFQ|%d] group function argument error: function=%d arg=%d for gid=%d (%d)!\n", so->id, tmp.index, tmp.arg, tmp.gid, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] function=%d arg=%d updated for gid=%d\n", so->id, tmp.index, tmp.arg, tmp.gid);
+        } break;
+
         case Q_SO_SET_TX_SLOTS:
         {
                 typeof (so->tx_opt.queue_size) slots;
@@ -512,6 +904,11 @@ int pfq_setsockopt(struct socket *sock,
                 if (copy_from_user(&slots, optval, optlen))
                         return -EFAULT;
 
+                if (pfq_shared_queue_releasing(so)) {
+                        printk(KERN_INFO "[PFQ|%d] Tx slots: queue memory release pending!\n", so->id);
+                        return -EBUSY;
+                }
+
                 if (slots > (size_t)max_queue_slots) {
                         printk(KERN_INFO "[PFQ|%d] invalid Tx slots=%zu (max %d)\n", so->id, slots, max_queue_slots);
                         return -EPERM;
@@ -584,6 +981,114 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_GROUP_EBPF:
+        {
+                struct pfq_group_ebpf ebpf;
+                struct sk_filter *filter = NULL;
+                int err;
+
+                if (optlen != sizeof(ebpf))
+                        return -EINVAL;
+
+                if (copy_from_user(&ebpf, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_check_group_access(so->id, ebpf.gid, "group ebpf");
+                if (err != 0)
+                	return err;
+
+                if (ebpf.fd >= 0) {
+
+                        filter = pfq_alloc_sk_filter_fd(ebpf.fd);
+                        if (filter == NULL) {
+                                printk(KERN_INFO "[PFQ|%d] ebpf error: fd=%d is not a socket filter program (gid=%d)\n", so->id, ebpf.fd, ebpf.gid);
+                                return -EINVAL;
+                        }
+                }
+
+                __pfq_set_group_filter(ebpf.gid, filter);
+
+                pr_devel("[PFQ|%d] ebpf: gid=%d fd=%d\n", so->id, ebpf.gid, ebpf.fd);
+
+        } break;
+
+        case Q_SO_GROUP_FLOW_TRACK:
+        {
+                struct pfq_group_flow_track tmp;
+                int err;
+
+                if (optlen != sizeof(tmp))
+                        return -EINVAL;
+
+                if (copy_from_user(&tmp, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_check_group_access(so->id, tmp.gid, "group flow track");
+                if (err != 0)
+                	return err;
+
+                err = pfq_set_group_flow_track(tmp.gid, &tmp);
+                if (err != 0) {
+                        printk(KERN_INFO "[PFQ|%d] group flow track error: size=%zu ring=%zu timeouts=%d/%d for gid=%d (%d)!\n",
+                               so->id, tmp.size, tmp.ring, tmp.idle_timeout, tmp.active_timeout, tmp.gid, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] flow track: gid=%d size=%zu ring=%zu\n", so->id, tmp.gid, tmp.size, tmp.ring);
+
+        } break;
+
+        case Q_SO_GROUP_SKETCH:
+        {
+                struct pfq_group_sketch tmp;
+                int err;
+
+                if (optlen != sizeof(tmp))
+                        return -EINVAL;
+
+                if (copy_from_user(&tmp, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_check_group_access(so->id, tmp.gid, "group sketch");
+                if (err != 0)
+                	return err;
+
+                err = pfq_set_group_sketch(tmp.gid, &tmp);
+                if (err != 0) {
+                        printk(KERN_INFO "[PFQ|%d] group sketch error: depth=%d width=%zu topk=%zu for gid=%d (%d)!\n",
+                               so->id, tmp.depth, tmp.width, tmp.topk, tmp.gid, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] sketch: gid=%d depth=%d width=%zu topk=%zu\n", so->id, tmp.gid, tmp.depth, tmp.width, tmp.topk);
+
+        } break;
+
+        case Q_SO_GROUP_STATE_MAP:
+        {
+                struct pfq_group_state_map tmp;
+                int err;
+
+                if (optlen != sizeof(tmp))
+                        return -EINVAL;
+
+                if (copy_from_user(&tmp, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_check_group_access(so->id, tmp.gid, "group state map");
+                if (err != 0)
+                	return err;
+
+                err = pfq_set_group_state_map(tmp.gid, tmp.index, tmp.size);
+                if (err != 0) {
+                        printk(KERN_INFO "[PFQ|%d] group state map error: index=%d size=%zu for gid=%d (%d)!\n", so->id, tmp.index, tmp.size, tmp.gid, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] state map: gid=%d index=%d size=%zu\n", so->id, tmp.gid, tmp.index, tmp.size);
+
+        } break;
+
         case Q_SO_GROUP_VLAN_FILT_TOGGLE:
         {
                 struct pfq_vlan_toggle vlan;
@@ -910,6 +1415,11 @@ int pfq_setsockopt(struct socket *sock,
                         goto error;
                 }
 
+		/* rewrite the tree before the init functions run */
+
+		if (lang_optimize)
+			pfq_computation_optimize(descr, comp);
+
 		/* print executable tree data structure */
 
 		pr_devel_computation_tree(comp);
@@ -934,7 +1444,7 @@ int pfq_setsockopt(struct socket *sock,
 		kfree(descr);
                 return 0;
 
-	error:  kfree(comp);
+	error:  pfq_computation_free(comp);
 		kfree(context);
 		kfree(descr);
 		return err;
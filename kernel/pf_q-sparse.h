@@ -26,39 +26,80 @@
 #define PF_Q_SPARSE_H
 
 #include <linux/smp.h>  /* get_cpu */
+#include <linux/percpu.h>
 #include <asm/local.h>
 
 #include <pf_q-macro.h>
 
 
-typedef struct { local_t value; } ____cacheline_aligned counter_t;
+/* a sparse counter is a per-cpu local_t: sparse_alloc must be called before use */
 
+typedef struct { local_t __percpu *value; } sparse_counter_t;
 
-typedef struct { counter_t ctx[Q_MAX_CPU]; } sparse_counter_t;
+
+static inline
+int sparse_alloc(sparse_counter_t *sc)
+{
+        sc->value = alloc_percpu(local_t);
+        return sc->value ? 0 : -ENOMEM;
+}
+
+static inline
+void sparse_free(sparse_counter_t *sc)
+{
+        free_percpu(sc->value);
+        sc->value = NULL;
+}
+
+
+/* allocate/free an array of n counters (all or none) */
+
+static inline
+int sparse_alloc_n(sparse_counter_t *sc, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++)
+        {
+                if (sparse_alloc(&sc[i])) {
+                        while (i--)
+                                sparse_free(&sc[i]);
+                        return -ENOMEM;
+                }
+        }
+        return 0;
+}
+
+static inline
+void sparse_free_n(sparse_counter_t *sc, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++)
+                sparse_free(&sc[i]);
+}
 
 
 static inline
 void __sparse_inc(sparse_counter_t *sc, int cpu)
 {
-        local_inc(&sc->ctx[cpu & Q_MAX_CPU_MASK].value);
+        local_inc(per_cpu_ptr(sc->value, cpu));
 }
 
 static inline
 void __sparse_dec(sparse_counter_t *sc, int cpu)
 {
-        local_dec(&sc->ctx[cpu & Q_MAX_CPU_MASK].value);
+        local_dec(per_cpu_ptr(sc->value, cpu));
 }
 
 static inline
 void __sparse_add(sparse_counter_t *sc, long n, int cpu)
 {
-        local_add(n, &sc->ctx[cpu & Q_MAX_CPU_MASK].value);
+        local_add(n, per_cpu_ptr(sc->value, cpu));
 }
 
 static inline
 void __sparse_sub(sparse_counter_t *sc, long n, int cpu)
 {
-        local_sub(n, &sc->ctx[cpu & Q_MAX_CPU_MASK].value);
+        local_sub(n, per_cpu_ptr(sc->value, cpu));
 }
 
 
@@ -96,8 +137,8 @@ static inline
 void sparse_set(sparse_counter_t *sc, long n)
 {
         unsigned int i, me = get_cpu();
-        for(i = 0; i < Q_MAX_CPU; i++)
-                local_set(&sc->ctx[i].value, i == me ? n : 0);
+        for_each_possible_cpu(i)
+                local_set(per_cpu_ptr(sc->value, i), i == me ? n : 0);
         put_cpu();
 }
 
@@ -105,8 +146,8 @@ static inline
 long sparse_read(sparse_counter_t *sc)
 {
         long ret = 0; int i;
-        for(i=0; i < Q_MAX_CPU; i++)
-                ret += local_read(&sc->ctx[i].value);
+        for_each_possible_cpu(i)
+                ret += local_read(per_cpu_ptr(sc->value, i));
 
         return ret;
 }
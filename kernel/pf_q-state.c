@@ -0,0 +1,180 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/uaccess.h>
+
+#include <pf_q-state.h>
+
+
+struct pfq_state_map *
+pfq_state_map_alloc(size_t size)
+{
+        struct pfq_state_map *map;
+        int cpu;
+
+        if (size == 0 || size > Q_MAX_STATE_MAP_SIZE)
+                return NULL;
+
+        size = max_t(size_t, roundup_pow_of_two(size), Q_STATE_MAP_PROBE);
+
+        map = kzalloc(sizeof(*map) + nr_cpu_ids * sizeof(map->table[0]), GFP_KERNEL);
+        if (!map)
+                return NULL;
+
+        map->size = size;
+        map->bits = ilog2(size);
+
+        for_each_possible_cpu(cpu)
+        {
+                map->table[cpu] = vzalloc_node(sizeof(struct pfq_state_table) + size * sizeof(struct pfq_state_entry),
+                                               cpu_to_node(cpu));
+                if (!map->table[cpu]) {
+                        pfq_state_map_free(map);
+                        return NULL;
+                }
+        }
+
+        return map;
+}
+
+
+void
+pfq_state_map_free(struct pfq_state_map *map)
+{
+        int cpu;
+
+        if (!map)
+                return;
+
+        for_each_possible_cpu(cpu)
+                vfree(map->table[cpu]);
+
+        kfree(map);
+}
+
+
+/* find the entry of a (stored) key in the table of a remote cpu */
+
+static struct pfq_state_entry *
+__pfq_state_table_find(struct pfq_state_map *map, struct pfq_state_table *t, uint64_t stored)
+{
+        size_t n, i;
+
+        for(n = 0, i = hash_64(stored - 1, map->bits); n < Q_STATE_MAP_PROBE; n++, i = (i + 1) & (map->size - 1))
+        {
+                uint64_t key = ACCESS_ONCE(t->entry[i].key);
+
+                if (key == stored)
+                        return &t->entry[i];
+                if (key == 0)
+                        return NULL;
+        }
+
+        return NULL;
+}
+
+
+/*
+ * Copy the entries of the map to user-space, up to *size of them. With
+ * aggregate the values of a key are summed across the cpus and each key is
+ * reported once. On return *size holds the entries copied, *total those in
+ * the map. The map must not be released meanwhile (group_sem held).
+ */
+
+int
+pfq_state_map_read(struct pfq_state_map *map, bool aggregate, struct pfq_state_entry __user *entry,
+                   size_t *size, size_t *total, uint64_t *miss)
+{
+        size_t room = *size, i;
+        int cpu, other;
+
+        *size = 0;
+        *total = 0;
+        *miss = 0;
+
+        for_each_possible_cpu(cpu)
+        {
+                struct pfq_state_table *t = map->table[cpu];
+
+                *miss += ACCESS_ONCE(t->miss);
+
+                for(i = 0; i < map->size; i++)
+                {
+                        struct pfq_state_entry e;
+                        bool seen = false;
+
+                        e.key = ACCESS_ONCE(t->entry[i].key);
+                        if (e.key == 0)
+                                continue;
+
+                        smp_rmb();
+                        e.value = ACCESS_ONCE(t->entry[i].value);
+
+                        if (aggregate) {
+
+                                for_each_possible_cpu(other)
+                                {
+                                        struct pfq_state_entry *oe;
+
+                                        if (other == cpu)
+                                                continue;
+
+                                        oe = __pfq_state_table_find(map, map->table[other], e.key);
+                                        if (!oe)
+                                                continue;
+
+                                        /* already reported with a previous cpu */
+
+                                        if (other < cpu) {
+                                                seen = true;
+                                                break;
+                                        }
+
+                                        smp_rmb();
+                                        e.value += ACCESS_ONCE(oe->value);
+                                }
+
+                                if (seen)
+                                        continue;
+                        }
+
+                        (*total)++;
+
+                        if (*size < room) {
+                                e.key--;
+                                if (copy_to_user(&entry[*size], &e, sizeof(e)))
+                                        return -EFAULT;
+                                (*size)++;
+                        }
+                }
+        }
+
+        return 0;
+}
@@ -0,0 +1,115 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#ifndef PF_Q_STATE_H
+#define PF_Q_STATE_H
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/smp.h>
+#include <linux/hash.h>
+
+#include <linux/pf_q.h>
+
+
+/*
+ * State maps: bounded key/value tables for stateful functions.
+ *
+ * A map holds one open-addressing table per cpu, written by its own cpu
+ * only (in softirq), so that lookups and updates take no locks. Entries
+ * are never removed: once the probe sequence of a key is full the lookup
+ * fails and it is accounted as a miss. Readers on other cpus (user-space,
+ * through getsockopt) see an entry once its key is published.
+ *
+ * Keys are stored incremented by one (0 marks an empty entry), therefore
+ * Q_STATE_KEY_INVALID cannot be stored.
+ */
+
+#define Q_STATE_MAP_PROBE	16
+
+
+struct pfq_state_table
+{
+        size_t                  used;
+        uint64_t                miss;
+
+        struct pfq_state_entry  entry[];
+};
+
+
+struct pfq_state_map
+{
+        size_t                  size;           /* entries per cpu, power of 2 */
+        unsigned int            bits;
+
+        struct pfq_state_table *table[];        /* nr_cpu_ids */
+};
+
+
+extern struct pfq_state_map * pfq_state_map_alloc(size_t size);
+extern void pfq_state_map_free(struct pfq_state_map *map);
+
+extern int pfq_state_map_read(struct pfq_state_map *map, bool aggregate, struct pfq_state_entry __user *entry,
+                              size_t *size, size_t *total, uint64_t *miss);
+
+
+/* lookup the value of key in the table of this cpu, optionally inserting it (with value 0) */
+
+static inline uint64_t *
+pfq_state_map_lookup(struct pfq_state_map *map, uint64_t key, bool insert)
+{
+        struct pfq_state_table *t = map->table[smp_processor_id()];
+        uint64_t stored = key + 1;
+        size_t n, i;
+
+        if (unlikely(key == Q_STATE_KEY_INVALID))
+                return NULL;
+
+        for(n = 0, i = hash_64(key, map->bits); n < Q_STATE_MAP_PROBE; n++, i = (i + 1) & (map->size - 1))
+        {
+                struct pfq_state_entry *e = &t->entry[i];
+
+                if (e->key == stored)
+                        return &e->value;
+
+                if (e->key == 0) {
+
+                        if (!insert)
+                                return NULL;
+
+                        e->value = 0;
+                        smp_wmb();
+                        ACCESS_ONCE(e->key) = stored;
+                        t->used++;
+                        return &e->value;
+                }
+        }
+
+        if (insert)
+                t->miss++;
+        return NULL;
+}
+
+
+#endif /* PF_Q_STATE_H */
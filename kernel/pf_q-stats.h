@@ -30,7 +30,11 @@
 #include <pf_q-sparse.h>
 
 
-/* sparse_counter_t stats */
+/* sparse_counter_t stats: the structures below are made of sparse counters only */
+
+
+#define pfq_stats_alloc(stats)  sparse_alloc_n((sparse_counter_t *)(stats), sizeof(*(stats))/sizeof(sparse_counter_t))
+#define pfq_stats_free(stats)   sparse_free_n((sparse_counter_t *)(stats), sizeof(*(stats))/sizeof(sparse_counter_t))
 
 
 struct pfq_socket_rx_stats
@@ -56,6 +60,7 @@ struct pfq_group_stats
         sparse_counter_t kern;          /* passed to kernel */
         sparse_counter_t disc;          /* discarded due to driver congestion */
         sparse_counter_t quit;          /* quit due to PFQ problem */
+        sparse_counter_t spill;         /* steered to another socket, due to queue congestion */
 };
 
 static inline
@@ -67,6 +72,7 @@ void pfq_group_stats_reset(struct pfq_group_stats *stats)
         sparse_set(&stats->kern, 0);
         sparse_set(&stats->disc, 0);
         sparse_set(&stats->quit, 0);
+        sparse_set(&stats->spill, 0);
 }
 
 struct pfq_global_stats
@@ -81,6 +87,9 @@ struct pfq_global_stats
 
         sparse_counter_t poll; 		/* number of poll */
         sparse_counter_t wake; 		/* number of wakeup */
+
+        sparse_counter_t flush; 	/* partial batches flushed by timer */
+        sparse_counter_t flush_lat; 	/* total latency of timer flushes (nsec) */
 };
 
 static inline
@@ -96,6 +105,9 @@ void pfq_global_stats_reset(struct pfq_global_stats *stats)
 
 	sparse_set(&stats->poll, 0);
 	sparse_set(&stats->wake, 0);
+
+	sparse_set(&stats->flush, 0);
+	sparse_set(&stats->flush_lat, 0);
 }
 
 
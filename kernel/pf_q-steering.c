@@ -0,0 +1,228 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *             Andrea Di Pietro <andrea.dipietro@for.unipi.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+
+#include <pf_q-steering.h>
+#include <pf_q-bitops.h>
+#include <pf_q-sock.h>
+#include <pf_q-group.h>
+#include <pf_q-shared-queue.h>
+
+
+struct steering_perm
+{
+        int     id;
+        int     weight;
+        u32     offset;
+        u32     skip;
+        u32     next;
+};
+
+
+/*
+ * Build the lookup table for the sockets in mask, as in Maglev: each socket
+ * walks its own permutation of the table and, round after round, takes as
+ * many free entries as its weight. A change of membership moves about 1/N of
+ * the entries.
+ */
+
+struct pfq_steering_table *
+pfq_steering_table_build(unsigned long const *mask)
+{
+        struct pfq_steering_table *tab;
+        struct steering_perm *perm;
+        size_t filled = 0, c;
+        int n = 0, i, k, id;
+
+        perm = kmalloc(sizeof(struct steering_perm) * Q_MAX_ID, GFP_KERNEL);
+        if (!perm)
+                return NULL;
+
+        pfq_bitmap_foreach(mask, Q_MAX_ID_WORDS, id,
+        {
+                struct pfq_sock *so = pfq_get_sock_by_id(id);
+
+                perm[n].id     = id;
+                perm[n].weight = so ? so->weight : 1;
+                perm[n].offset = jhash_1word(id, 0x9e3779b9) % Q_STEERING_TABLE_SIZE;
+                perm[n].skip   = jhash_1word(id, 0x7f4a7c15) % (Q_STEERING_TABLE_SIZE - 1) + 1;
+                perm[n].next   = 0;
+                n++;
+        })
+
+        if (n == 0) {
+                kfree(perm);
+                return NULL;
+        }
+
+        tab = kmalloc(sizeof(struct pfq_steering_table), GFP_KERNEL);
+        if (!tab) {
+                kfree(perm);
+                return NULL;
+        }
+
+        for(c = 0; c < Q_STEERING_TABLE_SIZE; c++)
+                tab->entry[c] = (u16)~0;
+
+        for(;;)
+        {
+                for(i = 0; i < n; i++)
+                {
+                        for(k = 0; k < perm[i].weight; k++)
+                        {
+                                do {
+                                        c = (perm[i].offset + (u64)perm[i].next * perm[i].skip) % Q_STEERING_TABLE_SIZE;
+                                        perm[i].next++;
+                                }
+                                while (tab->entry[c] != (u16)~0);
+
+                                tab->entry[c] = perm[i].id;
+
+                                if (++filled == Q_STEERING_TABLE_SIZE)
+                                        goto done;
+                        }
+                }
+        }
+done:
+        kfree(perm);
+        return tab;
+}
+
+
+/* fill level of the Rx queue of a socket, in percent (above 100 if not enabled) */
+
+static inline
+size_t pfq_sock_load(int id)
+{
+        struct pfq_sock *so = pfq_get_sock_by_id(id);
+        size_t size;
+
+        if (!so || !pfq_get_rx_queue(&so->rx_opt))
+                return 101;
+
+        size = so->rx_opt.queue_size * (so->rx_opt.mode != Q_RX_MODE_DOUBLE_BUFFER ? so->rx_opt.rings : 1);
+        if (!size)
+                return 101;
+
+        return pfq_mpsc_queue_len(so) * 100 / size;
+}
+
+
+static int
+pfq_least_loaded_sock(unsigned long const *eligible, int threshold, struct pfq_spill_cache *cache)
+{
+        size_t load, min_load = threshold;
+        int id, ret = -1;
+
+        if (cache->valid && pfq_bitmap_equal(eligible, cache->eligible, Q_MAX_ID_WORDS))
+                return cache->id;
+
+        pfq_bitmap_foreach(eligible, Q_MAX_ID_WORDS, id,
+        {
+                load = pfq_sock_load(id);
+                if (load < min_load) {
+                        min_load = load;
+                        ret = id;
+                }
+        })
+
+        memcpy(cache->eligible, eligible, sizeof(cache->eligible));
+        cache->id = ret;
+        cache->valid = true;
+
+        return ret;
+}
+
+
+/*
+ * With Q_SPILL_NEW_FLOWS the table of the recent flows holds, for each
+ * entry, the hash of the flow, the socket and whether the flow was spilled:
+ * the packets of a known flow are never moved (unless it was spilled, in
+ * which case they follow it). The table is lossy: a flow evicted by a
+ * collision is considered new again.
+ */
+
+#define SPILL_FLOW(hash, id, spilled)   (((u64)(hash) << 32) | ((u64)(id) << 1) | (spilled))
+#define SPILL_FLOW_HASH(v)              ((u32)((v) >> 32))
+#define SPILL_FLOW_ID(v)                ((int)(((v) >> 1) & 0x7fffffff))
+#define SPILL_FLOW_SPILLED(v)           ((v) & 1)
+
+
+int pfq_steering_spill(struct pfq_group *g, uint32_t hash, int id, unsigned long const *eligible,
+                       struct pfq_spill_cache *cache, int cpu)
+{
+        int threshold = ACCESS_ONCE(g->spill_threshold);
+        u64 *flows = NULL, *entry = NULL;
+        int spill_id;
+
+        if (g->spill == Q_SPILL_NEW_FLOWS) {
+
+                u64 v;
+
+                flows = (u64 *)atomic_long_read(&g->spill_flows);
+                if (unlikely(!flows))
+                        return id;
+
+                entry = &flows[hash & (Q_SPILL_FLOWS-1)];
+                v = ACCESS_ONCE(*entry);
+
+                if (SPILL_FLOW_HASH(v) == hash) {
+
+                        /* a known flow: it sticks to its socket */
+
+                        if (SPILL_FLOW_SPILLED(v)) {
+                                spill_id = SPILL_FLOW_ID(v);
+                                if (eligible[BIT_WORD(spill_id)] & BIT_MASK(spill_id))
+                                        return spill_id;
+                        }
+
+                        return id;
+                }
+        }
+
+        if (likely(pfq_sock_load(id) < (size_t)threshold)) {
+                if (entry)
+                        ACCESS_ONCE(*entry) = SPILL_FLOW(hash, id, 0);
+                return id;
+        }
+
+        /* the socket is congested: move to the least loaded one, if any */
+
+        spill_id = pfq_least_loaded_sock(eligible, threshold, cache);
+        if (spill_id < 0) {
+                if (entry)
+                        ACCESS_ONCE(*entry) = SPILL_FLOW(hash, id, 0);
+                return id;
+        }
+
+        if (entry)
+                ACCESS_ONCE(*entry) = SPILL_FLOW(hash, spill_id, 1);
+
+        __sparse_inc(&g->stats.spill, cpu);
+        return spill_id;
+}
@@ -0,0 +1,89 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *             Andrea Di Pietro <andrea.dipietro@for.unipi.it>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PF_Q_STEERING_H
+#define PF_Q_STEERING_H
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/hash.h>
+
+#include <pf_q-macro.h>
+
+
+/* consistent steering (Maglev): a table of socket ids, with a prime number of entries */
+
+#define Q_STEERING_TABLE_SIZE   16381
+
+struct pfq_steering_table
+{
+        u16     entry[Q_STEERING_TABLE_SIZE];
+};
+
+
+/* spill: number of entries of the table of the recent flows (a power of 2) */
+
+#define Q_SPILL_FLOWS           4096
+
+
+/* the least loaded socket among the eligible ones, computed once per batch:
+ * the queues are not filled until the batch is delivered */
+
+struct pfq_spill_cache
+{
+        unsigned long   eligible[Q_MAX_ID_WORDS];
+        int             id;             /* -1: none below the threshold */
+        bool            valid;
+};
+
+
+static inline
+void pfq_spill_cache_reset(struct pfq_spill_cache *c)
+{
+        c->valid = false;
+}
+
+
+struct pfq_group;
+
+/* called from u-context */
+
+extern struct pfq_steering_table * pfq_steering_table_build(unsigned long const *mask);
+
+/* called from the fast path: the socket a steered packet is sent to (spill policy of the group) */
+
+extern int pfq_steering_spill(struct pfq_group *g, uint32_t hash, int id, unsigned long const *eligible,
+                              struct pfq_spill_cache *cache, int cpu);
+
+
+static inline
+int pfq_steering_lookup(struct pfq_steering_table const *tab, uint32_t hash)
+{
+        /* mix the hash (the steering functions may leave the high bits unused) and scale it to the table size */
+
+        return tab->entry[((u64)hash_32(hash, 32) * Q_STEERING_TABLE_SIZE) >> 32];
+}
+
+
+#endif /* PF_Q_STEERING_H */
@@ -28,6 +28,8 @@
 #include <linux/string.h>
 #include <linux/semaphore.h>
 #include <linux/rwsem.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
 
 #include <pf_q-module.h>
 #include <pf_q-group.h>
@@ -141,6 +143,12 @@ int
 pfq_symtable_unregister_functions(const char *module, struct list_head *category, struct pfq_function_descr *fun)
 {
 	int i = 0;
+
+	/* the fini functions of the groups released asynchronously must run first */
+
+	rcu_barrier();
+	flush_scheduled_work();
+
 	for(; fun[i].symbol != NULL; i++)
 	{
 		pfq_symtable_unregister_function(module, category, fun[i].symbol);
@@ -199,6 +207,8 @@ pfq_symtable_init(void)
         pfq_symtable_register_functions(NULL, &pfq_lang_functions, (struct pfq_function_descr *)high_order_functions);
         pfq_symtable_register_functions(NULL, &pfq_lang_functions, (struct pfq_function_descr *)bloom_functions);
         pfq_symtable_register_functions(NULL, &pfq_lang_functions, (struct pfq_function_descr *)vlan_functions);
+        pfq_symtable_register_functions(NULL, &pfq_lang_functions, (struct pfq_function_descr *)lpm_functions);
+        pfq_symtable_register_functions(NULL, &pfq_lang_functions, (struct pfq_function_descr *)ebpf_functions);
         pfq_symtable_register_functions(NULL, &pfq_lang_functions, (struct pfq_function_descr *)misc_functions);
         pfq_symtable_register_functions(NULL, &pfq_lang_functions, (struct pfq_function_descr *)dummy_functions);
 
@@ -40,6 +40,7 @@
 #include <linux/kthread.h>
 #include <linux/vmalloc.h>
 #include <linux/percpu.h>
+#include <linux/rcupdate.h>
 #include <linux/bug.h>
 
 #include <net/sock.h>
@@ -71,6 +72,7 @@
 #include <pf_q-transmit.h>
 #include <pf_q-percpu.h>
 #include <pf_q-GC.h>
+#include <pf_q-steering.h>
 
 static struct net_proto_family  pfq_family_ops;
 static struct packet_type       pfq_prot_hook;
@@ -94,6 +96,13 @@ module_param(max_len,         int, 0644);
 module_param(max_queue_slots, int, 0644);
 
 module_param(batch_len,       int, 0644);
+module_param(batch_timeout,   int, 0644);
+module_param(batch_adaptive,  int, 0644);
+module_param(lang_batch,      int, 0644);
+module_param(steer_hash,      int, 0644);
+module_param(lang_hdr_cache,  int, 0644);
+module_param(lang_profile,    int, 0644);
+module_param(lang_optimize,   int, 0644);
 
 module_param(skb_pool_size,   int, 0644);
 module_param(vl_untag,        int, 0644);
@@ -109,6 +118,13 @@ MODULE_PARM_DESC(max_len, " Maximum transmission length (default=1514 bytes)");
 MODULE_PARM_DESC(max_queue_slots, " Max Queue slots (default=226144)");
 
 MODULE_PARM_DESC(batch_len, 	" Batch queue length");
+MODULE_PARM_DESC(batch_timeout, " Max delay of a partial batch (default=1000 usec)");
+MODULE_PARM_DESC(batch_adaptive," Adaptive batch length, up to batch_len (default=0)");
+MODULE_PARM_DESC(lang_batch,    " Batch-at-a-time PFQ/lang evaluation (default=0)");
+MODULE_PARM_DESC(steer_hash,    " Steering hash: 0 = xor, 1 = symmetric jhash, 2 = NIC hash if available (default=1)");
+MODULE_PARM_DESC(lang_hdr_cache," Share parsed packet headers among PFQ/lang functions (default=1)");
+MODULE_PARM_DESC(lang_profile,  " Per-node PFQ/lang profiling counters, see /proc/pfq/computations (default=0)");
+MODULE_PARM_DESC(lang_optimize, " Optimize PFQ/lang computations when loaded (default=1)");
 MODULE_PARM_DESC(tx_max_retry,  " Transmission max retry (default=1024)");
 
 MODULE_PARM_DESC(vl_untag,  " Enable vlan untagging (default=0)");
@@ -134,13 +150,12 @@ static DEFINE_SEMAPHORE(sock_sem);
 /* send this packet to selected sockets */
 
 static inline
-void mask_to_sock_queue(unsigned long n, unsigned long mask, unsigned long long *sock_queue)
+void mask_to_sock_queue(unsigned long n, unsigned long const *mask, unsigned long long *sock_queue)
 {
-	unsigned long bit;
-       	pfq_bitwise_foreach(mask, bit,
+	int index;
+	pfq_bitmap_foreach(mask, Q_MAX_ID_WORDS, index,
 	{
-	        int index = pfq_ctz(bit);
-                sock_queue[index] |= 1UL << n;
+                sock_queue[index] |= 1ULL << n;
         })
 }
 
@@ -199,101 +214,273 @@ void send_to_kernel(struct sk_buff *skb)
 }
 
 
-static int
-pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int direct)
+static inline
+void pfq_batch_adapt(struct local_data *local, bool full)
 {
- 	unsigned long long sock_queue[Q_SKBUFF_SHORT_BATCH];
-        unsigned long group_mask, socket_mask;
+	/* grow the batch under load, shrink it when the traffic is light */
 
-	struct local_data * local;
-        struct gc_data *gcollector;
+	if (!batch_adaptive)
+		return;
 
- 	struct gc_fwd_targets targets;
+	if (full) {
+		if (local->batch_len < batch_len)
+			local->batch_len = min(local->batch_len << 1, batch_len);
+	}
+	else {
+		if (local->batch_len > 1)
+			local->batch_len >>= 1;
+	}
+}
 
-        long unsigned n, bit, lb;
-        struct pfq_monad monad;
+
+static inline
+void pfq_monad_init(struct pfq_monad *monad, struct pfq_group *group)
+{
+	monad->fanout.class_mask = Q_CLASS_DEFAULT;
+	monad->fanout.type       = fanout_copy;
+	monad->state  		 = 0;
+	monad->group 		 = group;
+}
+
+
+static inline
+bool pfq_group_filters(struct pfq_group *this_group, int gid, struct sk_buff *skb, bool vlan_filter_enabled)
+{
+	/* check vlan filter (the BPF filter runs ahead, over the whole batch) */
+
+	if (vlan_filter_enabled) {
+
+		if (!__pfq_check_group_vlan_filter(gid, skb->vlan_tci & ~VLAN_TAG_PRESENT))
+			return false;
+	}
+
+	return true;
+}
+
+
+/* run the BPF filter of the group over the batch, while the packets are hot in cache */
+
+static inline
+void pfq_group_bpf_batch(struct local_data *local, struct pfq_group *this_group, int gid, size_t this_batch_len, int cpu)
+{
+	struct sk_filter *bpf = (struct sk_filter *)atomic_long_read(&this_group->bp_filter);
 	struct gc_buff buff;
-	size_t this_batch_len;
-        int cpu;
+	size_t n;
 
-#ifdef PFQ_RX_PROFILE
-	cycles_t start, stop;
-#endif
+	if (!bpf)
+		return;
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0))
-	BUILD_BUG_ON_MSG(Q_SKBUFF_SHORT_BATCH > (sizeof(sock_queue[0]) << 3), "skbuff batch overflow");
-#endif
+	for_each_gcbuff(&local->gc.pool, buff, n)
+	{
+		if (n == this_batch_len)
+			break;
 
+		if ((local->group_queue[gid] & (1ULL << n)) == 0)
+			continue;
 
-	/* if no socket is open drop the packet */
+		if (!pfq_sk_filter_run(bpf, buff.skb)) {
+			local->group_queue[gid] &= ~(1ULL << n);
+			__sparse_inc(&this_group->stats.recv, cpu);
+			__sparse_inc(&this_group->stats.drop, cpu);
+		}
+	}
+}
 
-        if (pfq_get_sock_count() == 0) {
-        	kfree_skb(skb);
-               	return 0;
+
+/* save the steering hash of the packet for the group, exported by the extended header */
+
+static inline
+void pfq_save_steering_hash(struct sk_buff *skb, fanout_t const *fanout)
+{
+	struct pfq_cb *cb = PFQ_CB(skb);
+
+	if (fanout && is_steering(*fanout)) {
+		cb->hash = fanout->hash;
+		cb->hdr.flags |= Q_HDR_HASH;
 	}
+	else
+		cb->hdr.flags &= ~Q_HDR_HASH;
+}
 
-	/* if required, timestamp the packet now */
 
-        if (skb->tstamp.tv64 == 0)
-                __net_timestamp(skb);
+/* compute the mask of sockets eligible for a packet, given its fanout */
 
-        /* if vlan header is present, remove it */
+static inline
+void pfq_fanout_sock_mask(struct local_data *local, struct pfq_group *this_group, fanout_t const *fanout, unsigned long *sock_mask, int cpu)
+{
+	unsigned long cbit, class_mask[Q_MAX_ID_WORDS];
 
-        if (vl_untag && skb->protocol == cpu_to_be16(ETH_P_8021Q)) {
-                skb = pfq_vlan_untag(skb);
-                if (unlikely(!skb)) {
-			sparse_inc(&global_stats.lost);
-                        return -1;
+	pfq_bitmap_zero(sock_mask, Q_MAX_ID_WORDS);
+
+	pfq_bitwise_foreach(fanout->class_mask, cbit,
+	{
+		int class = pfq_ctz(cbit);
+		__pfq_group_sock_mask(this_group, class, class_mask);
+		pfq_bitmap_or(sock_mask, class_mask, Q_MAX_ID_WORDS);
+	})
+
+	if (is_steering(*fanout)) {
+
+		struct pfq_steering_table *table = (struct pfq_steering_table *)atomic_long_read(&this_group->steering_table);
+		int id = -1;
+
+		/* consistent steering: the socket from the table, if eligible for the classes of the packet */
+
+		if (table) {
+			id = pfq_steering_lookup(table, fanout->hash);
+			if (unlikely((sock_mask[BIT_WORD(id)] & BIT_MASK(id)) == 0))
+				id = -1;
 		}
-        }
 
-        skb_reset_mac_len(skb);
+		if (id < 0) {
 
-        /* push the mac header: reset skb->data to the beginning of the packet */
+			/* cache the ids of the sockets in the mask */
 
-        if (likely(skb->pkt_type != PACKET_OUTGOING)) {
-            skb_push(skb, skb->mac_len);
-        }
+			if (!pfq_bitmap_equal(sock_mask, local->eligible_mask, Q_MAX_ID_WORDS)) {
 
-	/* get garbage collector */
+				int n;
 
-	cpu = get_cpu();
-	local = per_cpu_ptr(cpu_data, cpu);
+				memcpy(local->eligible_mask, sock_mask, sizeof(local->eligible_mask));
+				local->sock_cnt = 0;
 
-	gcollector = &local->gc;
+				pfq_bitmap_foreach(sock_mask, Q_MAX_ID_WORDS, n,
+				{
+					local->sock_id[local->sock_cnt++] = n;
+				})
+			}
 
-	/* set the ownership of this skb to the garbage collector */
+			if (likely(local->sock_cnt)) {
+				unsigned int h = fanout->hash ^ (fanout->hash >> 8) ^ (fanout->hash >> 16);
+				id = local->sock_id[pfq_fold(h, local->sock_cnt)];
+			}
+		}
 
-	buff = gc_make_buff(gcollector, skb);
-	if (buff.skb == NULL) {
-		if (printk_ratelimit())
-			printk(KERN_INFO "[PFQ] GC: memory exhausted!\n");
-		__sparse_inc(&global_stats.lost, cpu);
-		pfq_kfree_skb_pool(skb, &local->rx_pool);
-        	put_cpu();
-		return 0;
+		/* move the packet away from a congested socket, according to the spill policy */
+
+		if (id >= 0 && this_group->spill != Q_SPILL_NONE)
+			id = pfq_steering_spill(this_group, fanout->hash, id, sock_mask, &local->spill, cpu);
+
+		pfq_bitmap_zero(sock_mask, Q_MAX_ID_WORDS);
+
+		if (id >= 0)
+			sock_mask[BIT_WORD(id)] = BIT_MASK(id);
 	}
 
-        PFQ_CB(buff.skb)->direct = direct;
+	/* clone or continue ... */
+}
 
-        if ((gc_size(gcollector) < batch_len) &&
-             (ktime_to_ns(ktime_sub(skb_get_ktime(buff.skb), local->last_ts)) < 1000000) )
-        {
-        	put_cpu();
-                return 0;
+
+/* process a batch of packets for a group, running the computation batch-at-a-time */
+
+static void
+pfq_process_group_batch(struct local_data *local, struct pfq_group *this_group, int gid, struct pfq_computation_tree *prg,
+			struct gc_queue_buff *refs, size_t this_batch_len, bool vlan_filter_enabled,
+			int cpu, unsigned long *socket_mask)
+{
+	struct gc_queue_buff *pool = &local->gc.pool;
+	unsigned long long live = 0, mask;
+	long to_kernel = 0, num_fwd = 0;
+	struct gc_buff buff;
+	size_t n;
+
+	/* packets are referred by their position in the GC */
+
+	refs->len = this_batch_len;
+
+	for_each_gcbuff(pool, buff, n)
+	{
+		if (n == this_batch_len)
+			break;
+
+		refs->queue[n] = buff;
+
+		if ((local->group_queue[gid] & (1ULL << n)) == 0)
+			continue;
+
+		__sparse_inc(&this_group->stats.recv, cpu);
+
+		if (!pfq_group_filters(this_group, gid, buff.skb, vlan_filter_enabled)) {
+			__sparse_inc(&this_group->stats.drop, cpu);
+			continue;
+		}
+
+		pfq_monad_init(PFQ_CB(buff.skb)->monad, this_group);
+
+		to_kernel -= PFQ_CB(buff.skb)->log->to_kernel;
+		num_fwd   -= PFQ_CB(buff.skb)->log->num_devs;
+
+		live |= 1ULL << n;
 	}
 
-	this_batch_len = gc_size(gcollector);
+	/* run the functional program over the live packets */
 
-	__sparse_add(&global_stats.recv, this_batch_len, cpu);
+	mask = live;
 
-	local->last_ts = skb_get_ktime(buff.skb);
+	pfq_run_batch(prg, refs, &live);
+
+	/* dispatch the surviving packets */
+
+	for_each_gcbuff_bitmask(pool, mask, buff, n)
+	{
+		unsigned long sock_mask[Q_MAX_ID_WORDS];
+
+		/* the log of a packet is owned by the GC */
+
+		to_kernel += PFQ_CB(buff.skb)->log->to_kernel;
+		num_fwd   += PFQ_CB(buff.skb)->log->num_devs;
+
+		buff = refs->queue[n];
+
+		if (buff.skb == NULL || (live & (1ULL << n)) == 0) {
+			__sparse_inc(&this_group->stats.drop, cpu);
+			continue;
+		}
 
-	/* cleanup sock_queue... */
+		pfq_fanout_sock_mask(local, this_group, &PFQ_CB(buff.skb)->monad->fanout, sock_mask, cpu);
+		pfq_save_steering_hash(buff.skb, &PFQ_CB(buff.skb)->monad->fanout);
 
-        memset(sock_queue, 0, sizeof(sock_queue));
+		mask_to_sock_queue(n, sock_mask, local->sock_queue);
 
- 	group_mask = 0;
+		pfq_bitmap_or(socket_mask, sock_mask, Q_MAX_ID_WORDS);
+	}
+
+	__sparse_add(&this_group->stats.frwd, num_fwd, cpu);
+	__sparse_add(&this_group->stats.kern, to_kernel, cpu);
+}
+
+
+static void
+pfq_process_batch(struct local_data *local, int cpu)
+{
+        unsigned long group_mask[Q_MAX_GROUP_WORDS], socket_mask[Q_MAX_ID_WORDS];
+
+        struct gc_data *gcollector = &local->gc;
+
+ 	struct gc_fwd_targets targets;
+
+        long unsigned n, bit;
+	int gid, i;
+        struct pfq_monad monad;
+	struct sk_buff *skb;
+	struct gc_buff buff;
+	size_t this_batch_len;
+	bool vector = lang_batch;
+
+#ifdef PFQ_RX_PROFILE
+	cycles_t start, stop;
+#endif
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0))
+	BUILD_BUG_ON_MSG(Q_SKBUFF_SHORT_BATCH > (sizeof(local->sock_queue[0]) << 3), "skbuff batch overflow");
+#endif
+
+	this_batch_len = gc_size(gcollector);
+
+	__sparse_add(&global_stats.recv, this_batch_len, cpu);
+
+	/* sock_queue and group_queue are left clean by the previous batch */
+
+	pfq_bitmap_zero(group_mask, Q_MAX_GROUP_WORDS);
 
 #ifdef PFQ_RX_PROFILE
 	start = get_cycles();
@@ -303,32 +490,59 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int direct)
 
 	for_each_skbuff(SKBUFF_BATCH_ADDR(gcollector->pool), skb, n)
         {
-		unsigned long local_group_mask = __pfq_devmap_get_groups(skb->dev->ifindex, skb_get_rx_queue(skb));
+		int ifindex = skb->dev->ifindex, rxq = skb_get_rx_queue(skb);
+		size_t w;
 
-		group_mask |= local_group_mask;
+		for(w = 0; w < Q_MAX_GROUP_WORDS; w++)
+		{
+			unsigned long local_group_mask = __pfq_devmap_get_groups(ifindex, rxq, w);
 
-		PFQ_CB(skb)->group_mask = local_group_mask;
-		PFQ_CB(skb)->monad      = &monad;
+			group_mask[w] |= local_group_mask;
+
+			pfq_bitwise_foreach(local_group_mask, bit,
+			{
+				local->group_queue[w * BITS_PER_LONG + pfq_ctz(bit)] |= 1ULL << n;
+			})
+		}
+
+		PFQ_CB(skb)->monad = vector ? &local->monad[n] : &monad;
+		PFQ_CB(skb)->hdr.flags = 0;
 	}
 
-        /* process all groups enabled for this batch of packets */
+        /* process all groups enabled for this batch of packets:
+         * computations, filters and steering tables are released by RCU */
 
-	pfq_bitwise_foreach(group_mask, bit,
-	{
-		int gid = pfq_ctz(bit);
+	rcu_read_lock();
 
+	pfq_bitmap_foreach(group_mask, Q_MAX_GROUP_WORDS, gid,
+	{
 		struct pfq_group * this_group = pfq_get_group(gid);
 
-		bool bf_filter_enabled = atomic_long_read(&this_group->bp_filter);
 		bool vlan_filter_enabled = __pfq_vlan_filters_enabled(gid);
+		struct pfq_computation_tree *prg;
 		struct gc_queue_buff refs = { len:0 };
 
-		socket_mask = 0;
+		pfq_bitmap_zero(socket_mask, Q_MAX_ID_WORDS);
+
+		pfq_spill_cache_reset(&local->spill);
+
+		/* BPF filter of the group, over the batch */
+
+		pfq_group_bpf_batch(local, this_group, gid, this_batch_len, cpu);
+
+		/* batch-at-a-time evaluation of the computation */
+
+		prg = (struct pfq_computation_tree *)atomic_long_read(&this_group->comp);
+		if (vector && prg) {
+
+			pfq_process_group_batch(local, this_group, gid, prg, &refs, this_batch_len,
+						vlan_filter_enabled, cpu, socket_mask);
+			goto endpoints;
+		}
 
 		for_each_gcbuff(&gcollector->pool, buff, n)
 		{
-			struct pfq_computation_tree *prg;
-			unsigned long sock_mask = 0;
+			unsigned long sock_mask[Q_MAX_ID_WORDS];
 
 			/* stop processing packets in GC ? */
 
@@ -337,39 +551,18 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int direct)
 
 			/* skip this packet for this group ? */
 
-			if ((PFQ_CB(buff.skb)->group_mask & bit) == 0)
+			if ((local->group_queue[gid] & (1ULL << n)) == 0)
 				continue;
 
 			/* increment recv counter for this group */
 
 			__sparse_inc(&this_group->stats.recv, cpu);
 
+			/* check for vlan filters */
 
-			/* check for bp filter */
-
-			if (bf_filter_enabled) {
-
-				struct sk_filter *bpf = (struct sk_filter *)atomic_long_read(&this_group->bp_filter);
-
-#if (LINUX_VERSION_CODE < KERNEL_VERSION(3,15,0))
-				if (bpf && !sk_run_filter(buff.skb, bpf->insns))
-#else
-				if (bpf && !SK_RUN_FILTER(bpf, buff.skb))
-#endif
-                        	{
-					__sparse_inc(&this_group->stats.drop, cpu);
-					continue;
-				}
-			}
-
-			/* check vlan filter */
-
-			if (vlan_filter_enabled) {
-
-				if (!__pfq_check_group_vlan_filter(gid, buff.skb->vlan_tci & ~VLAN_TAG_PRESENT)) {
-					__sparse_inc(&this_group->stats.drop, cpu);
-					continue;
-				}
+			if (!pfq_group_filters(this_group, gid, buff.skb, vlan_filter_enabled)) {
+				__sparse_inc(&this_group->stats.drop, cpu);
+				continue;
 			}
 
 			/* check where a functional program is available for this group */
@@ -377,16 +570,12 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int direct)
 			prg = (struct pfq_computation_tree *)atomic_long_read(&this_group->comp);
 			if (prg) {
 
-				unsigned long cbit, eligible_mask = 0;
 				size_t to_kernel = PFQ_CB(buff.skb)->log->to_kernel;
 				size_t num_fwd   = PFQ_CB(buff.skb)->log->num_devs;
 
 				/* setup monad for this computation */
 
-				monad.fanout.class_mask = Q_CLASS_DEFAULT;
-				monad.fanout.type       = fanout_copy;
-				monad.state  		= 0;
-				monad.group 		= this_group;
+				pfq_monad_init(&monad, this_group);
 
 				/* run the functional program */
 
@@ -413,64 +602,40 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int direct)
                                 	continue;
 				}
 
-				/* compute the eligible mask of sockets enabled for this packet... */
-
-				pfq_bitwise_foreach(monad.fanout.class_mask, cbit,
-				{
-					int class = pfq_ctz(cbit);
-					eligible_mask |= atomic_long_read(&this_group->sock_mask[class]);
-				})
-
-
-				if (is_steering(monad.fanout)) {
-
-					/* cache the number of sockets in the mask */
-
-					if (eligible_mask != local->eligible_mask) {
-
-						unsigned long ebit;
-
-						local->eligible_mask = eligible_mask;
-						local->sock_cnt = 0;
-
-						pfq_bitwise_foreach(eligible_mask, ebit,
-						{
-							local->sock_mask[local->sock_cnt++] = ebit;
-						})
-					}
-
-					if (likely(local->sock_cnt)) {
-						unsigned int h = monad.fanout.hash ^ (monad.fanout.hash >> 8) ^ (monad.fanout.hash >> 16);
-						sock_mask |= local->sock_mask[pfq_fold(h, local->sock_cnt)];
-					}
-				}
-				else {  /* clone or continue ... */
-
-					sock_mask |= eligible_mask;
-				}
+				pfq_fanout_sock_mask(local, this_group, &monad.fanout, sock_mask, cpu);
+				pfq_save_steering_hash(buff.skb, &monad.fanout);
 			}
 			else { /* save a reference to the current packet */
 
 				refs.queue[refs.len++] = buff;
-				sock_mask |= atomic_long_read(&this_group->sock_mask[0]);
+				__pfq_group_sock_mask(this_group, 0, sock_mask);
+				pfq_save_steering_hash(buff.skb, NULL);
 			}
 
-			mask_to_sock_queue(n, sock_mask, sock_queue);
+			/* sockets refer to the packet by its position in refs */
 
-			socket_mask |= sock_mask;
+			mask_to_sock_queue(refs.len - 1, sock_mask, local->sock_queue);
+
+			pfq_bitmap_or(socket_mask, sock_mask, Q_MAX_ID_WORDS);
 		}
 
+	endpoints:
+
 		/* copy payload of packets to endpoints... */
 
-		pfq_bitwise_foreach(socket_mask, lb,
+		pfq_bitmap_foreach(socket_mask, Q_MAX_ID_WORDS, i,
 		{
-			int i = pfq_ctz(lb);
 			struct pfq_sock * so = pfq_get_sock_by_id(i);
 
-			copy_to_endpoint_buffs(so, &refs, sock_queue[i], cpu, gid);
+			copy_to_endpoint_buffs(so, &refs, local->sock_queue[i], cpu, gid);
+			local->sock_queue[i] = 0;
 		})
+
+		local->group_queue[gid] = 0;
 	})
 
+	rcu_read_unlock();
+
 
 	/* forward skbs to kernel */
 
@@ -521,14 +686,140 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int direct)
 
 	gc_reset(gcollector);
 
-	put_cpu();
-
 #ifdef PFQ_RX_PROFILE
 	stop = get_cycles();
 
 	if (printk_ratelimit())
-		printk(KERN_INFO "[PFQ] Rx profile: %llu_tsc.\n", (stop-start)/batch_len);
+		printk(KERN_INFO "[PFQ] Rx profile: %llu_tsc.\n", (stop-start)/this_batch_len);
 #endif
+}
+
+
+/* flush a partial batch which is waiting in the GC for too long (tasklet) */
+
+void pfq_receive_flush(unsigned long data)
+{
+	int cpu = (int)data;
+	struct local_data * local = per_cpu_ptr(cpu_data, cpu);
+	s64 age;
+
+	/* the GC is per-cpu: flush it from its own cpu, unless the cpu went
+	 * offline (the timer migrated here) and no one else can touch it */
+
+	if (unlikely(cpu != smp_processor_id()) && cpu_online(cpu)) {
+		if (!ACCESS_ONCE(local->flush_stop))
+			schedule_work_on(cpu, &local->flush_work);
+		return;
+	}
+
+	if (gc_size(&local->gc) == 0)
+		return;
+
+	age = ktime_to_ns(ktime_sub(ktime_get(), local->batch_ts));
+
+	/* the batch is younger than the timeout: wait for the remaining time */
+
+	if (age < (s64)batch_timeout * 1000) {
+		if (!ACCESS_ONCE(local->flush_stop))
+			hrtimer_start(&local->flush_timer, ns_to_ktime((s64)batch_timeout * 1000 - age), HRTIMER_MODE_REL_PINNED);
+		return;
+	}
+
+	__sparse_inc(&global_stats.flush, cpu);
+	__sparse_add(&global_stats.flush_lat, age, cpu);
+
+	pfq_batch_adapt(local, false);
+
+	local->last_ts = ktime_get_real();
+
+	pfq_process_batch(local, cpu);
+}
+
+
+static int
+pfq_receive(struct napi_struct *napi, struct sk_buff * skb, int direct)
+{
+	struct local_data * local;
+        struct gc_data *gcollector;
+	struct gc_buff buff;
+	size_t this_batch_len;
+        int cpu;
+
+	/* if no socket is open drop the packet */
+
+        if (pfq_get_sock_count() == 0) {
+        	kfree_skb(skb);
+               	return 0;
+	}
+
+	/* if required, timestamp the packet now */
+
+        if (skb->tstamp.tv64 == 0)
+                __net_timestamp(skb);
+
+        /* if vlan header is present, remove it */
+
+        if (vl_untag && skb->protocol == cpu_to_be16(ETH_P_8021Q)) {
+                skb = pfq_vlan_untag(skb);
+                if (unlikely(!skb)) {
+			sparse_inc(&global_stats.lost);
+                        return -1;
+		}
+        }
+
+        skb_reset_mac_len(skb);
+
+        /* push the mac header: reset skb->data to the beginning of the packet */
+
+        if (likely(skb->pkt_type != PACKET_OUTGOING)) {
+            skb_push(skb, skb->mac_len);
+        }
+
+	/* get garbage collector */
+
+	cpu = get_cpu();
+	local = per_cpu_ptr(cpu_data, cpu);
+
+	gcollector = &local->gc;
+
+	/* set the ownership of this skb to the garbage collector */
+
+	buff = gc_make_buff(gcollector, skb);
+	if (buff.skb == NULL) {
+		if (printk_ratelimit())
+			printk(KERN_INFO "[PFQ] GC: memory exhausted!\n");
+		__sparse_inc(&global_stats.lost, cpu);
+		pfq_kfree_skb_pool(skb, &local->rx_pool);
+        	put_cpu();
+		return 0;
+	}
+
+        PFQ_CB(buff.skb)->direct = direct;
+
+	this_batch_len = gc_size(gcollector);
+
+	if (this_batch_len == 1)
+		local->batch_ts = ktime_get();
+
+        if ((this_batch_len < (batch_adaptive ? local->batch_len : batch_len)) &&
+             (ktime_to_ns(ktime_sub(skb_get_ktime(buff.skb), local->last_ts)) < (s64)batch_timeout * 1000) )
+        {
+		/* arm the timer, so that this batch is flushed even if no other packet arrives */
+
+		if (this_batch_len == 1 && !hrtimer_active(&local->flush_timer))
+			hrtimer_start(&local->flush_timer, ns_to_ktime((s64)batch_timeout * 1000), HRTIMER_MODE_REL_PINNED);
+
+        	put_cpu();
+                return 0;
+	}
+
+	pfq_batch_adapt(local, this_batch_len >= (batch_adaptive ? local->batch_len : batch_len));
+
+	local->last_ts = skb_get_ktime(buff.skb);
+
+	pfq_process_batch(local, cpu);
+
+	put_cpu();
         return 0;
 }
 
@@ -584,6 +875,14 @@ static void pfq_sock_destruct(struct sock *sk)
         WARN_ON(atomic_read(&sk->sk_rmem_alloc));
         WARN_ON(atomic_read(&sk->sk_wmem_alloc));
 
+        /* a producer within the last grace period may have armed it */
+
+        hrtimer_cancel(&pfq_sk(sk)->rx_opt.wakeup_timer);
+
+        pfq_stats_free(&pfq_sk(sk)->rx_opt.stats);
+        pfq_stats_free(&pfq_sk(sk)->tx_opt.stats);
+        sparse_free(&pfq_sk(sk)->rx_opt.wakeup_local);
+
         sk_refcnt_debug_dec(sk);
 }
 
@@ -627,11 +926,34 @@ pfq_create(
 
         so = pfq_sk(sk);
 
+        /* per-cpu socket stats */
+
+        if (pfq_stats_alloc(&so->rx_opt.stats)) {
+                sk_free(sk);
+                return -ENOMEM;
+        }
+
+        if (pfq_stats_alloc(&so->tx_opt.stats)) {
+                pfq_stats_free(&so->rx_opt.stats);
+                sk_free(sk);
+                return -ENOMEM;
+        }
+
+        if (sparse_alloc(&so->rx_opt.wakeup_local)) {
+                pfq_stats_free(&so->rx_opt.stats);
+                pfq_stats_free(&so->tx_opt.stats);
+                sk_free(sk);
+                return -ENOMEM;
+        }
+
         /* get a unique id for this sock */
 
         so->id = pfq_get_free_id(so);
         if (so->id == -1) {
                 printk(KERN_WARNING "[PFQ] error: resource exhausted\n");
+                pfq_stats_free(&so->rx_opt.stats);
+                pfq_stats_free(&so->tx_opt.stats);
+                sparse_free(&so->rx_opt.wakeup_local);
                 sk_free(sk);
                 return -EBUSY;
         }
@@ -642,6 +964,8 @@ pfq_create(
 	so->egress_index = 0;
 	so->egress_queue = 0;
 
+	so->weight = 1;
+
         so->shmem.addr = NULL;
         so->shmem.size = 0;
         so->shmem.kind = 0;
@@ -655,6 +979,7 @@ pfq_create(
 
         pfq_rx_opt_init(&so->rx_opt, cap_len);
         pfq_tx_opt_init(&so->tx_opt, max_len);
+        pfq_shared_queue_init(so);
 
         /* initialize socket */
 
@@ -740,12 +1065,19 @@ pfq_poll(struct file *file, struct socket *sock, poll_table * wait)
 
 	poll_wait(file, &so->rx_opt.waitqueue, wait);
 
-        if(!pfq_get_rx_queue(&so->rx_opt))
-                return mask;
+	/* restart the wakeup coalescing; pairs with the barrier of the producers */
 
-        if (pfq_mpsc_queue_len(so) > 0)
+	atomic_set(&so->rx_opt.wakeup_pending, 0);
+
+	smp_mb();
+
+        rcu_read_lock();
+
+        if (pfq_get_rx_queue(&so->rx_opt) && pfq_mpsc_queue_len(so) > 0)
                 mask |= POLLIN | POLLRDNORM;
 
+        rcu_read_unlock();
+
         return mask;
 }
 
@@ -872,21 +1204,41 @@ static int __init pfq_init_module(void)
                 return -EFAULT;
         }
 
+        if (batch_timeout < 0) {
+                printk(KERN_INFO "[PFQ] batch_timeout=%d not allowed: valid range [0,...)!\n", batch_timeout);
+                return -EFAULT;
+        }
+
 	if (skb_pool_size > PFQ_SK_BUFF_LIST_SIZE) {
                 printk(KERN_INFO "[PFQ] skb_pool_size=%d not allowed: valid range [0,%d]!\n", skb_pool_size, PFQ_SK_BUFF_LIST_SIZE);
 		return -EFAULT;
 	}
 
-	if (pfq_percpu_init())
-		return -EFAULT;
+	/* per-cpu counters: global, memory and group stats */
 
-	if (pfq_proc_init())
+	if (pfq_stats_alloc(&global_stats) ||
+	    pfq_stats_alloc(&memory_stats) ||
+	    pfq_groups_init()) {
+                printk(KERN_INFO "[PFQ] could not allocate counters!\n");
+		pfq_stats_free(&memory_stats);
+		pfq_stats_free(&global_stats);
 		return -ENOMEM;
+	}
+
+	if (pfq_percpu_init()) {
+		n = -EFAULT;
+		goto err_percpu;
+	}
+
+	if (pfq_proc_init()) {
+		n = -ENOMEM;
+		goto err_proc;
+	}
 
         /* register pfq sniffer protocol */
         n = proto_register(&pfq_proto, 0);
         if (n != 0)
-                return n;
+                goto err_proto;
 
 	/* register the pfq socket */
         sock_register(&pfq_family_ops);
@@ -901,7 +1253,8 @@ static int __init pfq_init_module(void)
 #ifdef PFQ_USE_SKB_RECYCLE
         if (pfq_skb_pool_init() != 0) {
         	pfq_skb_pool_purge();
-        	return -ENOMEM;
+		n = -ENOMEM;
+		goto err_pool;
 	}
         pfq_skb_pool_enable(true);
         printk(KERN_INFO "[PFQ] skb pool initialized.\n");
@@ -909,6 +1262,24 @@ static int __init pfq_init_module(void)
 
 	printk(KERN_INFO "[PFQ] ready!\n");
         return 0;
+
+#ifdef PFQ_USE_SKB_RECYCLE
+err_pool:
+        unregister_device_handler();
+        sock_unregister(PF_Q);
+        synchronize_net();
+	pfq_symtable_free();
+        proto_unregister(&pfq_proto);
+#endif
+err_proto:
+	pfq_proc_fini();
+err_proc:
+	free_percpu(cpu_data);
+err_percpu:
+	pfq_groups_fini();
+	pfq_stats_free(&memory_stats);
+	pfq_stats_free(&global_stats);
+	return n;
 }
 
 
@@ -931,8 +1302,15 @@ static void __exit pfq_exit_module(void)
         /* disable direct capture */
         __pfq_devmap_monitor_reset();
 
-        /* wait grace period */
-        msleep(Q_GRACE_PERIOD);
+        /* wait for the packet handlers in flight */
+        synchronize_net();
+
+        /* wait for the shared memory released asynchronously */
+        rcu_barrier();
+        flush_scheduled_work();
+
+        /* stop batch flush timers */
+        pfq_percpu_fini();
 
         /* purge both GC and recycles queues */
         total += pfq_percpu_flush();
@@ -952,6 +1330,12 @@ static void __exit pfq_exit_module(void)
 
 	pfq_proc_fini();
 
+	/* free per-cpu counters */
+
+	pfq_groups_fini();
+	pfq_stats_free(&memory_stats);
+	pfq_stats_free(&global_stats);
+
         printk(KERN_INFO "[PFQ] unloaded.\n");
 }
 
@@ -0,0 +1,235 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+/*
+ * Lookup benchmark of the LPM table used by the PFQ/lang lpm functions.
+ *
+ * Random IPv4 and IPv6 prefixes (1k, 100k and 1M) are loaded and looked up
+ * with random addresses; with small tables the result is also checked against
+ * a linear search.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "pf_q-lpm.h"
+
+
+static uint64_t
+rand64(void)
+{
+	return ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+}
+
+
+static struct pfq_lpm_key
+random_key(int ipv6)
+{
+	struct pfq_lpm_key k;
+
+	k.hi = rand64();
+	k.lo = ipv6 ? rand64() : 0;
+
+	if (!ipv6)
+		k.hi &= 0xffffffff00000000ULL;
+
+	return k;
+}
+
+
+static int
+random_len(int ipv6)
+{
+	/* roughly the distribution of a routing table */
+
+	return ipv6 ? 16 + rand() % 49 : 8 + rand() % 25;
+}
+
+
+static int
+match(struct pfq_lpm_prefix const *p, struct pfq_lpm_key k)
+{
+	uint64_t mhi = p->len <= 0  ? 0 : p->len >= 64  ? ~0ULL : ~0ULL << (64 - p->len);
+	uint64_t mlo = p->len <= 64 ? 0 : p->len >= 128 ? ~0ULL : ~0ULL << (128 - p->len);
+
+	return (k.hi & mhi) == (p->addr.hi & mhi) && (k.lo & mlo) == (p->addr.lo & mlo);
+}
+
+
+static uint32_t
+linear_lookup(struct pfq_lpm_prefix const *p, size_t n, struct pfq_lpm_key k)
+{
+	uint32_t value = 0;
+	int len = -1;
+	size_t i;
+
+	for(i = 0; i < n; i++)
+	{
+		if (match(&p[i], k) && p[i].len > len) {
+			len = p[i].len;
+			value = p[i].value;
+		}
+	}
+
+	return value;
+}
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void
+bench(size_t n, int ipv6)
+{
+	struct pfq_lpm_prefix *prefix = malloc(n * sizeof(*prefix)), *copy = NULL;
+	struct pfq_lpm_key *keys;
+	struct pfq_lpm_table table;
+	size_t i, nkeys = 1 << 20, found = 0;
+	double t0, t1, t2;
+
+	for(i = 0; i < n; i++)
+	{
+		prefix[i].addr  = random_key(ipv6);
+		prefix[i].len   = random_len(ipv6);
+		prefix[i].value = i + 1;
+	}
+
+	if (n <= 1000) {
+		copy = malloc(n * sizeof(*prefix));
+		memcpy(copy, prefix, n * sizeof(*prefix));
+	}
+
+	keys = malloc(nkeys * sizeof(*keys));
+
+	for(i = 0; i < nkeys; i++)
+	{
+		/* half of the addresses fall within a prefix */
+
+		keys[i] = (i & 1) ? random_key(ipv6) : prefix[rand() % n].addr;
+		if (i & 2)
+			keys[i].lo ^= ipv6 ? 1 : 0, keys[i].hi ^= ipv6 ? 0 : (1ULL << 32);
+	}
+
+	t0 = now();
+
+	if (pfq_lpm_build(&table, prefix, n) < 0) {
+		fprintf(stderr, "lpm: build error!\n");
+		exit(1);
+	}
+
+	t1 = now();
+
+	for(i = 0; i < nkeys; i++)
+		found += pfq_lpm_lookup(&table, keys[i]) != 0;
+
+	t2 = now();
+
+	printf("%s %8zu prefixes: %8zu ranges, %6.1f MB, build %7.1f ms, lookup %6.1f ns (%zu%% matched)\n",
+	       ipv6 ? "IPv6" : "IPv4", n, table.size,
+	       (table.size * sizeof(struct pfq_lpm_range) + ((1 << Q_LPM_INDEX_BITS) + 1) * sizeof(uint32_t)) / 1048576.0,
+	       (t1 - t0) * 1e3, (t2 - t1) * 1e9 / nkeys, found * 100 / nkeys);
+
+	if (copy) {
+		for(i = 0; i < 100000; i++)
+		{
+			struct pfq_lpm_key k = keys[i % nkeys];
+			uint32_t v = pfq_lpm_lookup(&table, k), w = linear_lookup(copy, n, k);
+
+			/* duplicate prefixes may carry different values */
+
+			assert(v == w || (v && w && copy[v-1].len == copy[w-1].len &&
+			       match(&copy[v-1], k) && match(&copy[w-1], k)));
+		}
+		free(copy);
+	}
+
+	pfq_lpm_free(&table);
+	free(keys);
+	free(prefix);
+}
+
+
+static struct pfq_lpm_key
+ip(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	uint8_t addr[4] = { a, b, c, d };
+	return pfq_lpm_key_from_bytes(addr, 4);
+}
+
+
+static void
+check_nested(void)
+{
+	struct pfq_lpm_prefix p[] =
+	{
+		{ ip(10,1,0,0),        16, 3 },
+		{ ip(0,0,0,0),          0, 1 },
+		{ ip(255,255,255,255), 32, 4 },
+		{ ip(10,0,0,0),         8, 2 },
+		{ ip(10,1,2,0),        24, 5 },
+	};
+	struct pfq_lpm_table table;
+
+	assert(pfq_lpm_build(&table, p, sizeof(p)/sizeof(p[0])) == 0);
+
+	assert(pfq_lpm_lookup(&table, ip(1,2,3,4)) == 1);
+	assert(pfq_lpm_lookup(&table, ip(10,0,0,1)) == 2);
+	assert(pfq_lpm_lookup(&table, ip(10,1,0,1)) == 3);
+	assert(pfq_lpm_lookup(&table, ip(10,1,2,255)) == 5);
+	assert(pfq_lpm_lookup(&table, ip(10,1,3,0)) == 3);
+	assert(pfq_lpm_lookup(&table, ip(10,2,0,0)) == 2);
+	assert(pfq_lpm_lookup(&table, ip(11,0,0,0)) == 1);
+	assert(pfq_lpm_lookup(&table, ip(255,255,255,254)) == 1);
+	assert(pfq_lpm_lookup(&table, ip(255,255,255,255)) == 4);
+
+	pfq_lpm_free(&table);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	size_t sizes[] = { 1000, 100000, 1000000 };
+	size_t i;
+
+	srand(argc > 1 ? atoi(argv[1]) : 42);
+
+	check_nested();
+
+	for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+	{
+		bench(sizes[i], 0);
+		bench(sizes[i], 1);
+	}
+
+	return 0;
+}
@@ -0,0 +1 @@
+../../kernel/pf_q-lpm.c
\ No newline at end of file
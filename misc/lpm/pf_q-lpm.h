@@ -0,0 +1 @@
+../../kernel/pf_q-lpm.h
\ No newline at end of file
@@ -0,0 +1,164 @@
+/***************************************************************
+ *
+ * (C) 2011-14 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+/*
+ * Footprint and read cost of the PFQ sparse counters, before and after the
+ * move to per-cpu allocations.
+ *
+ * old: a counter is a static array of Q_MAX_CPU (256) cache-line aligned
+ *      slots, embedded in the stats and in the group context (module .bss).
+ *
+ * new: a counter is a pointer to an alloc_percpu(local_t); the per-cpu
+ *      copies live in the per-cpu units (one per possible cpu), the stride
+ *      between units is emulated with PERCPU_UNIT.
+ *
+ * The load time of the module is dominated by zeroing the .bss, emulated
+ * here by touching the memory of all the counters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define Q_MAX_CPU               256
+#define Q_MAX_GROUP             64
+#define Q_MAX_COUNTERS          64
+
+#define GROUP_STATS             7
+#define SOCKET_STATS            5       /* rx: 3, tx: 2 */
+#define GLOBAL_STATS            (11 + 9) /* global and memory stats */
+
+#define PERCPU_UNIT             (32 << 10)
+
+#define CACHELINE               64
+
+
+typedef struct { long value; } __attribute__((aligned(CACHELINE))) counter_t;
+
+typedef struct { counter_t ctx[Q_MAX_CPU]; } old_counter_t;
+
+typedef struct { size_t offset; } new_counter_t;
+
+
+static char *percpu_base;
+static int   ncpu;
+
+
+static inline long
+old_read(old_counter_t *sc)
+{
+	long ret = 0; int i;
+	for(i = 0; i < Q_MAX_CPU; i++)
+		ret += *(volatile long *)&sc->ctx[i].value;
+	return ret;
+}
+
+
+static inline long
+new_read(new_counter_t *sc)
+{
+	long ret = 0; int i;
+	for(i = 0; i < ncpu; i++)
+		ret += *(volatile long *)(percpu_base + (size_t)i * PERCPU_UNIT + sc->offset);
+	return ret;
+}
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	size_t ngroup_ctr = Q_MAX_GROUP * (Q_MAX_COUNTERS + GROUP_STATS);
+	size_t nctr = ngroup_ctr + GLOBAL_STATS;
+	size_t old_size, new_size, n, loops = 1000000;
+	old_counter_t *old_ctr;
+	new_counter_t *new_ctr;
+	double t0, t1;
+	long sum = 0;
+
+	ncpu = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu <= 0 || ncpu > Q_MAX_CPU) {
+		fprintf(stderr, "cpus: valid range [1,%d]\n", Q_MAX_CPU);
+		return 1;
+	}
+
+	/* footprint */
+
+	old_size = nctr * sizeof(old_counter_t);
+	new_size = nctr * (sizeof(new_counter_t) + (size_t)ncpu * sizeof(long));
+
+	printf("cpus: %d, counters: %zu (groups: %zu)\n", ncpu, nctr, ngroup_ctr);
+	printf("footprint old: %zu KB (%zu KB per socket)\n", old_size >> 10, (SOCKET_STATS * sizeof(old_counter_t)) >> 10);
+	printf("footprint new: %zu KB (%zu bytes per socket)\n", new_size >> 10, SOCKET_STATS * (sizeof(new_counter_t) + (size_t)ncpu * sizeof(long)));
+
+	/* load: zero the counters */
+
+	t0 = now();
+	old_ctr = aligned_alloc(CACHELINE, old_size);
+	memset(old_ctr, 0, old_size);
+	t1 = now();
+	printf("load old: %.3f msec\n", (t1 - t0) * 1e3);
+
+	t0 = now();
+	percpu_base = aligned_alloc(CACHELINE, (size_t)ncpu * PERCPU_UNIT + nctr * sizeof(long));
+	new_ctr = malloc(nctr * sizeof(new_counter_t));
+	for(n = 0; n < nctr; n++)
+	{
+		int i;
+		new_ctr[n].offset = (n * sizeof(long)) % PERCPU_UNIT;
+		for(i = 0; i < ncpu; i++)
+			*(long *)(percpu_base + (size_t)i * PERCPU_UNIT + new_ctr[n].offset) = 0;
+	}
+	t1 = now();
+	printf("load new: %.3f msec\n", (t1 - t0) * 1e3);
+
+	/* sparse_read */
+
+	t0 = now();
+	for(n = 0; n < loops; n++)
+		sum += old_read(&old_ctr[n % nctr]);
+	t1 = now();
+	printf("sparse_read old: %.1f nsec\n", (t1 - t0) * 1e9 / loops);
+
+	t0 = now();
+	for(n = 0; n < loops; n++)
+		sum += new_read(&new_ctr[n % nctr]);
+	t1 = now();
+	printf("sparse_read new: %.1f nsec\n", (t1 - t0) * 1e9 / loops);
+
+	free(new_ctr);
+	free(percpu_base);
+	free(old_ctr);
+	return (int)(sum & 1);
+}
@@ -28,6 +28,7 @@
 #include <pfq/util.hpp>
 
 #include <functional>
+#include <utility>
 #include <vector>
 #include <string>
 #include <cmath>
@@ -161,6 +162,36 @@ namespace lang
         return predicate("all_bit", prop, mask);
     }
 
+    namespace details
+    {
+        // a switch is serialized as: switch prop [values] (case f1 (case f2 ... default))
+
+        template <typename Def, typename ...Cs> struct switch_chain;
+
+        template <typename Def>
+        struct switch_chain<Def>
+        {
+            using type = Def;
+
+            static type make(Def const &d)
+            {
+                return d;
+            }
+        };
+
+        template <typename Def, typename Fun, typename ...Cs>
+        struct switch_chain<Def, std::pair<uint64_t, Fun>, Cs...>
+        {
+            using rest = switch_chain<Def, Cs...>;
+            using type = MFunction<Fun, typename rest::type>;
+
+            static type make(Def const &d, std::pair<uint64_t, Fun> const &c, Cs const &...cs)
+            {
+                return mfunction("case", c.second, rest::make(d, cs...));
+            }
+        };
+    }
+
     namespace
     {
         //
@@ -346,6 +377,18 @@ namespace lang
 
         auto ip_ttl     = property("ip_ttl");
 
+        //! Evaluate to the /source address/ of the IP header (host byte order).
+
+        auto ip_saddr   = property("ip_saddr");
+
+        //! Evaluate to the /destination address/ of the IP header (host byte order).
+
+        auto ip_daddr   = property("ip_daddr");
+
+        //! Evaluate to a 64-bit hash of the 5-tuple of the IP packet.
+
+        auto ip_flow    = property("ip_flow");
+
         //! Evaluate to the /source port/ of the TCP header.
 
         auto tcp_source = property("tcp_source");
@@ -378,6 +421,10 @@ namespace lang
 
         auto icmp_code  = property("icmp_code");
 
+        //! Evaluate to the VLAN id of the packet (untagged packets have no value).
+
+        auto vlan_vid   = property("vlan_vid");
+
         //
         // default netfunctions:
         //
@@ -692,6 +739,63 @@ namespace lang
 
         auto dec            = [] (int value) { return mfunction("dec", value); };
 
+        //! Count the packets by the value of the property, in the i-th state map of the current group.
+        /*!
+         * The map is created with set_group_state_map and read with group_state_map;
+         * packets for which the property is not defined are not counted. Example:
+         *
+         * ip >> count_by (0, ip_tos)
+         */
+
+        template <typename Prop>
+        auto count_by(int map, Prop p)
+            -> decltype(mfunction(nullptr, map, p))
+        {
+            static_assert(is_property<Prop>::value, "count_by: argument 1: property expected");
+            return mfunction("count_by", map, p);
+        }
+
+        //! Count the packet by the value of the property in the count-min sketch of the current group.
+        /*!
+         * The sketch is created with set_group_sketch and the heavy hitters are
+         * read with group_topk. Example:
+         *
+         * ip >> count_min (ip_saddr)
+         */
+
+        template <typename Prop>
+        auto count_min(Prop p)
+            -> decltype(mfunction(nullptr, p))
+        {
+            static_assert(is_property<Prop>::value, "count_min: argument 0: property expected");
+            return mfunction("count_min", p);
+        }
+
+        //! Evaluate to \c true if the estimate of the property in the sketch of the current cpu reaches the threshold.
+        /*!
+         * Example:
+         *
+         * ip >> count_min (ip_flow) >> when (heavy_hitter (ip_flow, 100000), steer_flow)
+         */
+
+        template <typename Prop>
+        auto heavy_hitter(Prop p, uint64_t threshold)
+            -> decltype(predicate(nullptr, p, threshold))
+        {
+            static_assert(is_property<Prop>::value, "heavy_hitter: argument 0: property expected");
+            return predicate("heavy_hitter", p, threshold);
+        }
+
+        //! Track the IPv4 flows of the packet in the flow table of the current group.
+        /*!
+         * The table is created with set_group_flow_track; the records of the expired
+         * flows are read through the ring returned by map_flow_ring. Example:
+         *
+         * ip >> flow_track
+         */
+
+        auto flow_track     = mfunction("flow_track");
+
         //! Monadic version of \c is_l3_proto predicate.
         /*!
          * Predicates are used in conditional expressions, while monadic functions
@@ -817,6 +921,37 @@ namespace lang
             return mfunction("conditional", p, f1, f2);
         }
 
+        //! A case of \c switch_: the value of the property and the monadic function it selects.
+
+        template <typename Fun>
+        std::pair<uint64_t, Fun>
+        case_(uint64_t value, Fun f)
+        {
+            static_assert(is_monadic_function<Fun>::value, "case_: argument 1: monadic function expected");
+
+            return std::make_pair(value, std::move(f));
+        }
+
+        //! Dispatch on the value of a property.
+        /*!
+         * The function evaluates to the monadic function of the case that matches the
+         * value of the property, or to the default one. The lookup is O(1) in the number
+         * of cases. Example:
+         *
+         * switch_ (udp_dest, kernel, case_(53, log_msg("dns")), case_(123, drop))
+         *
+         */
+
+        template <typename Prop, typename Def, typename ...Fs>
+        auto switch_(Prop p, Def d, std::pair<uint64_t, Fs> const &...cs)
+            -> decltype(mfunction(nullptr, p, std::vector<uint64_t>{}, details::switch_chain<Def, std::pair<uint64_t, Fs>...>::make(d, cs...)))
+        {
+            static_assert(is_property<Prop>::value,       "switch_: argument 0: property expected");
+            static_assert(is_monadic_function<Def>::value, "switch_: argument 1: monadic function expected");
+
+            return mfunction("switch", p, std::vector<uint64_t>{ cs.first... }, details::switch_chain<Def, std::pair<uint64_t, Fs>...>::make(d, cs...));
+        }
+
         //! Function that inverts a monadic NetFunction.
         /*!
          * Useful to invert filters:
@@ -939,6 +1074,69 @@ namespace lang
             return std::pow(1 - std::pow(1 - 1.0/m, n * bloomK), bloomK);
         }
 
+        //
+        // longest-prefix match:
+        //
+
+        //! Predicate that evaluates to \c true when the source or the destination address
+        // of the packet belongs to one of the given IPv4/IPv6 networks.
+        /*!
+         * The match is exact (no false positives) and the lookup cost grows with the
+         * logarithm of the number of networks. A plain address is a host route. Example:
+         *
+         * filter (lpm ({"10.0.0.0/8", "192.168.1.0/24", "2001:db8::/32"})) >> kernel
+         *
+         */
+
+        auto lpm        = [] (std::vector<std::string> const &nets) { return predicate("lpm", nets); };
+
+        //! Similarly to \c lpm, evaluates to \c true when the source address matches.  \see lpm
+
+        auto lpm_src    = [] (std::vector<std::string> const &nets) { return predicate("lpm_src", nets); };
+
+        //! Similarly to \c lpm, evaluates to \c true when the destination address matches.  \see lpm
+
+        auto lpm_dst    = [] (std::vector<std::string> const &nets) { return predicate("lpm_dst", nets); };
+
+        //! Monadic counterpart of \c lpm function.  \see lpm
+
+        auto lpm_filter = [] (std::vector<std::string> const &nets) { return mfunction("lpm_filter", nets); };
+
+        //! Steer the packets by the longest prefixes matching their addresses.
+        /*!
+         * Packets exchanged by the same pair of networks are delivered to the same socket,
+         * in both the directions; packets that match no network are dropped.
+         */
+
+        auto steer_lpm  = [] (std::vector<std::string> const &nets) { return mfunction("steer_lpm", nets); };
+
+        //
+        // eBPF programs:
+        //
+
+        //! Predicate that evaluates to \c true when the eBPF program returns a non-zero value.
+        /*!
+         * The argument is the fd of a socket filter program loaded with bpf(BPF_PROG_LOAD);
+         * the program is JIT compiled when net.core.bpf_jit_enable is set. Example:
+         *
+         * filter (ebpf (fd)) >> kernel
+         *
+         */
+
+        auto ebpf        = [] (int fd) { return predicate("ebpf", fd); };
+
+        //! Property that evaluates to the value returned by the eBPF program (low 31 bits).  \see ebpf
+
+        auto ebpf_value  = [] (int fd) { return property("ebpf_value", fd); };
+
+        //! Run the eBPF program and take the action encoded by its return value.
+        /*!
+         * 0 drops the packet, Q_EBPF_STEER|hash steers it by hash, Q_EBPF_MARK|value marks
+         * it with value; any other value passes the packet.  \see ebpf
+         */
+
+        auto ebpf_action = [] (int fd) { return mfunction("ebpf_action", fd); };
+
     }
 
 } // namespace lang
@@ -44,6 +44,7 @@
 #include <algorithm>
 #include <thread>
 #include <chrono>
+#include <limits>
 
 #include <pfq/util.hpp>
 #include <pfq/queue.hpp>
@@ -134,6 +135,89 @@ namespace pfq {
 
     //////////////////////////////////////////////////////////////////////
 
+    //! flow_ring: the export ring of a group flow table.
+    /*!
+     * The ring is filled by the kernel with the records of the expired flows
+     * and drained by the user. Obtained by means of socket::map_flow_ring.
+     */
+
+    class flow_ring
+    {
+    public:
+
+        flow_ring(int fd, int gid)
+        : ring_(nullptr)
+        , size_(0)
+        {
+            long page = ::sysconf(_SC_PAGESIZE);
+
+            auto hdr = static_cast<pfq_flow_ring *>(::mmap(nullptr, page, PROT_READ, MAP_SHARED, fd, Q_FLOW_RING_PGOFF(gid) * page));
+            if (hdr == MAP_FAILED)
+                throw pfq_error(errno, "PFQ: flow ring mmap error");
+
+            size_ = (Q_FLOW_RING_MEM(hdr->size) + page - 1) & ~(page - 1);
+
+            ::munmap(hdr, page);
+
+            auto addr = ::mmap(nullptr, size_, PROT_READ|PROT_WRITE, MAP_SHARED, fd, Q_FLOW_RING_PGOFF(gid) * page);
+            if (addr == MAP_FAILED)
+                throw pfq_error(errno, "PFQ: flow ring mmap error");
+
+            ring_ = static_cast<pfq_flow_ring *>(addr);
+        }
+
+        ~flow_ring()
+        {
+            if (ring_)
+                ::munmap(ring_, size_);
+        }
+
+        flow_ring(const flow_ring &) = delete;
+        flow_ring& operator=(const flow_ring &) = delete;
+
+        flow_ring(flow_ring &&other)
+        : ring_(other.ring_)
+        , size_(other.size_)
+        {
+            other.ring_ = nullptr;
+        }
+
+        //! Drain the available records.
+
+        std::vector<pfq_flow_record>
+        read(size_t max = std::numeric_limits<size_t>::max())
+        {
+            std::vector<pfq_flow_record> ret;
+
+            uint64_t cons = ring_->cons, prod = ring_->prod;
+
+            smp_rmb();
+
+            for(; cons != prod && ret.size() < max; cons++)
+                ret.push_back(ring_->record[cons & (ring_->size - 1)]);
+
+            smp_wmb();
+
+            ring_->cons = cons;
+            return ret;
+        }
+
+        //! Return the number of records dropped because the ring was full.
+
+        uint64_t
+        drop() const
+        {
+            return ring_->drop;
+        }
+
+    private:
+
+        pfq_flow_ring *ring_;
+        size_t size_;
+    };
+
+    //////////////////////////////////////////////////////////////////////
+
     //! PFQ: the socket
     /*!
      * This class is the main interface to the PFQ kernel module.
@@ -167,6 +251,14 @@ namespace pfq {
             size_t tx_num_bind;
 
             bool   tx_async;
+
+            int    rx_mode;
+            size_t rx_rings;
+            size_t rx_ring_next;    // next ring to read (round-robin)
+            int    rx_ring_cons;    // ring to release at the next read
+            uint64_t rx_ring_pos;
+
+            int    rx_hdr_ext;      // slots end with a pfq_pkthdr_ext
         };
 
         int fd_;
@@ -428,7 +520,13 @@ namespace pfq {
                                         0,
                                         0,
                                         0,
-                                        true
+                                        true,
+                                        Q_RX_MODE_DOUBLE_BUFFER,
+                                        0,
+                                        0,
+                                        -1,
+                                        0,
+                                        0
                                      });
 
             // get id
@@ -542,7 +640,15 @@ namespace pfq {
             data()->rx_queue_addr = static_cast<char *>(data()->shm_addr) + sizeof(pfq_shared_queue);
             data()->rx_queue_size = data()->rx_slots * data()->rx_slot_size;
 
-            data()->tx_queue_addr = static_cast<char *>(data()->shm_addr) + sizeof(pfq_shared_queue) + data()->rx_queue_size * 2;
+            data()->rx_rings     = static_cast<pfq_shared_queue *>(data()->shm_addr)->rx.rings;
+            data()->rx_ring_next = 0;
+            data()->rx_ring_cons = -1;
+
+            if (data()->rx_mode != Q_RX_MODE_DOUBLE_BUFFER)
+                data()->tx_queue_addr = static_cast<char *>(data()->rx_queue_addr) + data()->rx_rings * (sizeof(pfq_rx_ring) + data()->rx_queue_size);
+            else
+                data()->tx_queue_addr = static_cast<char *>(data()->rx_queue_addr) + data()->rx_queue_size * 2;
+
             data()->tx_queue_size = data()->tx_slots * data()->tx_slot_size;
         }
 
@@ -625,7 +731,7 @@ namespace pfq {
                 throw pfq_error(errno, "PFQ: set caplen error");
             }
 
-            data()->rx_slot_size = align<8>(sizeof(pfq_pkthdr) + value);
+            data()->rx_slot_size = align<8>(sizeof(pfq_pkthdr) + value) + Q_RX_HDR_EXT_SIZE(data()->rx_hdr_ext);
         }
 
         //! Return the capture length of packets, in bytes.
@@ -685,6 +791,140 @@ namespace pfq {
             return data()->rx_slot_size;
         }
 
+        //! Specify the mode of the Rx queue.
+        /*!
+         * Q_RX_MODE_DOUBLE_BUFFER (default), Q_RX_MODE_PERCPU_RINGS, that is one
+         * single-producer ring per cpu (read in round-robin), or Q_RX_MODE_RING,
+         * a multi-producer ring with per-slot commit (wait for the slot to be ready).
+         * Q_RX_MODE_PACKED can be or-ed to Q_RX_MODE_PERCPU_RINGS to store variable-length slots.
+         * The mode must be set before the socket is enabled.
+         */
+
+        void
+        rx_mode(int value)
+        {
+            if (enabled())
+                throw pfq_error("PFQ: enabled (Rx mode could not be set)");
+
+            if (::setsockopt(fd_, PF_Q, Q_SO_SET_RX_MODE, &value, sizeof(value)) == -1) {
+                throw pfq_error(errno, "PFQ: set Rx mode error");
+            }
+
+            data()->rx_mode = value;
+        }
+
+        //! Return the mode of the Rx queue.
+
+        int
+        rx_mode() const
+        {
+            return data()->rx_mode;
+        }
+
+        //! Enable the extended packet header.
+        /*!
+         * Each slot ends with a pfq_pkthdr_ext that carries the offsets of the
+         * network and transport headers, the transport protocol and the steering
+         * hash computed by the kernel (see queue::iterator::header_ext).
+         * The extended header must be enabled before the socket is enabled.
+         */
+
+        void
+        rx_hdr_ext(bool value)
+        {
+            if (enabled())
+                throw pfq_error("PFQ: enabled (Rx extended header could not be set)");
+
+            int ext = value ? 1 : 0;
+            if (::setsockopt(fd_, PF_Q, Q_SO_SET_RX_HDR_EXT, &ext, sizeof(ext)) == -1) {
+                throw pfq_error(errno, "PFQ: set Rx extended header error");
+            }
+
+            data()->rx_slot_size = data()->rx_slot_size - Q_RX_HDR_EXT_SIZE(data()->rx_hdr_ext) + Q_RX_HDR_EXT_SIZE(ext);
+            data()->rx_hdr_ext = ext;
+        }
+
+        //! Check whether the extended packet header is enabled.
+
+        bool
+        rx_hdr_ext() const
+        {
+            return data()->rx_hdr_ext;
+        }
+
+        //! Specify the wakeup threshold of the Rx queue, in packets.
+        /*!
+         * A reader sleeping in poll (or epoll) is woken up when the given number of
+         * packets has been enqueued. The default is Q_RX_WAKEUP_DEFAULT.
+         */
+
+        void
+        rx_wakeup(int packets)
+        {
+            if (::setsockopt(fd_, PF_Q, Q_SO_SET_RX_WAKEUP, &packets, sizeof(packets)) == -1)
+                throw pfq_error(errno, "PFQ: set Rx wakeup error");
+        }
+
+        //! Return the wakeup threshold of the Rx queue, in packets.
+
+        int
+        rx_wakeup() const
+        {
+            int ret; socklen_t size = sizeof(int);
+            if (::getsockopt(fd_, PF_Q, Q_SO_GET_RX_WAKEUP, &ret, &size) == -1)
+                throw pfq_error(errno, "PFQ: get Rx wakeup error");
+            return ret;
+        }
+
+        //! Specify the max wakeup delay of the Rx queue, in microseconds.
+        /*!
+         * A reader sleeping in poll (or epoll) is woken up no later than the given
+         * delay from the first packet enqueued, even if the wakeup threshold is not
+         * reached. 0 disables the delay (default).
+         */
+
+        void
+        rx_wakeup_delay(int microseconds)
+        {
+            if (::setsockopt(fd_, PF_Q, Q_SO_SET_RX_WAKEUP_DELAY, &microseconds, sizeof(microseconds)) == -1)
+                throw pfq_error(errno, "PFQ: set Rx wakeup delay error");
+        }
+
+        //! Return the max wakeup delay of the Rx queue, in microseconds.
+
+        int
+        rx_wakeup_delay() const
+        {
+            int ret; socklen_t size = sizeof(int);
+            if (::getsockopt(fd_, PF_Q, Q_SO_GET_RX_WAKEUP_DELAY, &ret, &size) == -1)
+                throw pfq_error(errno, "PFQ: get Rx wakeup delay error");
+            return ret;
+        }
+
+        //! Specify the steering weight of the socket.
+        /*!
+         * In groups with consistent steering, a socket receives a share of the flows
+         * proportional to its weight (1 by default, up to Q_MAX_STEERING_WEIGHT).
+         */
+
+        void
+        weight(int value)
+        {
+            if (::setsockopt(fd_, PF_Q, Q_SO_SET_WEIGHT, &value, sizeof(value)) == -1)
+                throw pfq_error(errno, "PFQ: set weight error");
+        }
+
+        //! Return the steering weight of the socket.
+
+        int
+        weight() const
+        {
+            int ret; socklen_t size = sizeof(int);
+            if (::getsockopt(fd_, PF_Q, Q_SO_GET_WEIGHT, &ret, &size) == -1)
+                throw pfq_error(errno, "PFQ: get weight error");
+            return ret;
+        }
+
         //! Specify the length of the Tx queue, in number of packets.
         /*!
          * The number of Tx slots can't exceed the value specified by
@@ -876,17 +1116,27 @@ namespace pfq {
         }
 
         //! Obtain the list of the joined groups.
+        /*!
+         * Unlike groups_mask(), the list includes the groups beyond the
+         * first word (modules built with PFQ_MAX_ID > 64).
+         */
 
         std::vector<int>
         groups() const
         {
+            constexpr size_t bits = sizeof(unsigned long) * 8;
+
+            unsigned long mask[16]; socklen_t size = sizeof(mask);
+            if (::getsockopt(fd_, PF_Q, Q_SO_GET_GROUPS, mask, &size) == -1)
+                throw pfq_error(errno, "PFQ: get groups error");
+
             std::vector<int> vec;
-            auto grps = this->groups_mask();
-            for(int n = 0; grps != 0; n++)
+            for(size_t w = 0; w < sizeof(mask)/sizeof(mask[0]); w++)
             {
-                if (grps & (1L << n)) {
-                    vec.push_back(n);
-                    grps &= ~(1L << n);
+                for(size_t n = 0; n < bits; n++)
+                {
+                    if (mask[w] & (1UL << n))
+                        vec.push_back(static_cast<int>(w * bits + n));
                 }
             }
 
@@ -950,6 +1200,23 @@ namespace pfq {
         }
 
 
+        //! Replace an argument of a function of the running group computation.
+        /*!
+         * The function is identified by its index in the serialized computation
+         * (see pfq::lang::serialize), the argument by its position. The computation
+         * is neither reinstalled nor relinked, e.g. the addresses of a bloom filter
+         * can be changed while the packets are processed.
+         */
+
+        void
+        set_group_function_arg(int gid, int index, int arg, pfq::lang::argument_type const &value)
+        {
+            struct pfq_group_function_arg p { gid, index, arg, { value.ptr ? value.ptr->forall_addr() : nullptr, value.size, value.nelem } };
+            if (::setsockopt(fd_, PF_Q, Q_SO_GROUP_FUNCTION_ARG, &p, sizeof(p)) == -1)
+                throw pfq_error(errno, "PFQ: group function argument error");
+        }
+
+
         //! Specify a functional computation for the given group, from string.
         /*!
          * This function is limited to simple PFQ/lang functional computations.
@@ -997,6 +1264,77 @@ namespace pfq {
                 throw pfq_error(errno, "PFQ: reset group fprog error");
         }
 
+        //! Specify an eBPF socket filter for the given group.
+        /*!
+         * The program is loaded by the caller (bpf(BPF_PROG_LOAD), type
+         * BPF_PROG_TYPE_SOCKET_FILTER); the fd can be closed afterwards.
+         * Use reset_group_fprog to remove the filter.
+         */
+
+        void
+        set_group_ebpf(int gid, int fd)
+        {
+            struct pfq_group_ebpf ebpf = { gid, fd };
+
+            if (::setsockopt(fd_, PF_Q, Q_SO_GROUP_EBPF, &ebpf, sizeof(ebpf)) == -1)
+                throw pfq_error(errno, "PFQ: set group ebpf error");
+        }
+
+
+        //! Create a state map of the given group.
+        /*!
+         * State maps are per-cpu key/value tables (index 0..Q_MAX_STATE_MAPS-1) used by
+         * stateful functions (e.g. count_by). The size is the number of entries per cpu;
+         * an existing map is replaced (its state is lost), size 0 removes it.
+         */
+
+        void
+        set_group_state_map(int gid, int index, size_t size)
+        {
+            struct pfq_group_state_map value = { gid, index, size };
+
+            if (::setsockopt(fd_, PF_Q, Q_SO_GROUP_STATE_MAP, &value, sizeof(value)) == -1)
+                throw pfq_error(errno, "PFQ: set group state map error");
+        }
+
+
+        //! Create the count-min sketch of the given group (used by count_min and heavy_hitter).
+        /*!
+         * The sketch has depth rows of width counters per cpu and keeps the topk keys
+         * with the highest estimates; width 0 removes it.
+         */
+
+        void
+        set_group_sketch(int gid, int depth, size_t width, size_t topk)
+        {
+            struct pfq_group_sketch value = { gid, depth, width, topk };
+
+            if (::setsockopt(fd_, PF_Q, Q_SO_GROUP_SKETCH, &value, sizeof(value)) == -1)
+                throw pfq_error(errno, "PFQ: set group sketch error");
+        }
+
+        //! Enable the flow table of the given group (used by the flow_track function).
+        /*!
+         * size is the number of flows per cpu (0 removes the table), ring the number
+         * of records of the export ring (power of 2); timeouts are in seconds.
+         */
+
+        void
+        set_group_flow_track(int gid, size_t size, size_t ring, int idle_timeout = 15, int active_timeout = 1800)
+        {
+            struct pfq_group_flow_track value = { gid, idle_timeout, active_timeout, size, ring };
+
+            if (::setsockopt(fd_, PF_Q, Q_SO_GROUP_FLOW_TRACK, &value, sizeof(value)) == -1)
+                throw pfq_error(errno, "PFQ: set group flow track error");
+        }
+
+        //! Map the export ring of the flow table of the given group.
+
+        flow_ring
+        map_flow_ring(int gid) const
+        {
+            return flow_ring(fd_, gid);
+        }
 
         //! Join the given group.
         /*!
@@ -1074,6 +1412,9 @@ namespace pfq {
             if (!data()->shm_addr)
                 throw pfq_error("PFQ: read: socket not enabled");
 
+            if (data_->rx_mode != Q_RX_MODE_DOUBLE_BUFFER)
+                return read_rings(microseconds);
+
             auto q = static_cast<struct pfq_shared_queue *>(data()->shm_addr);
 
             size_t data = q->rx.data;
@@ -1094,9 +1435,125 @@ namespace pfq {
             auto queue_len = std::min(static_cast<size_t>(Q_SHARED_QUEUE_LEN(data)), data_->rx_slots);
 
             return queue(static_cast<char *>(data_->rx_queue_addr) + (index & 1) * data_->rx_queue_size,
-                         data_->rx_slot_size, queue_len, index);
+                         data_->rx_slot_size, queue_len, index, queue_len * data_->rx_slot_size, Q_RX_HDR_EXT_SIZE(data_->rx_hdr_ext));
+        }
+
+    private:
+
+        queue
+        read_rings(long int microseconds)
+        {
+            auto rings = static_cast<pfq_rx_ring *>(data_->rx_queue_addr);
+            auto ring_bytes = data_->rx_queue_size;
+
+            // release the slots returned by the previous read...
+
+            if (data_->rx_ring_cons != -1) {
+
+                // multi-producer ring: clear the commit of the released slots...
+
+                if (data_->rx_mode == Q_RX_MODE_RING) {
+                    auto rbase = reinterpret_cast<char *>(rings + data_->rx_rings);
+                    for(uint64_t pos = rings[0].cons; pos + data_->rx_slot_size <= data_->rx_ring_pos; pos += data_->rx_slot_size)
+                        reinterpret_cast<pfq_pkthdr *>(rbase + pos % ring_bytes)->commit = 0;
+                }
+
+                smp_mb();
+                rings[data_->rx_ring_cons].cons = data_->rx_ring_pos;
+                data_->rx_ring_cons = -1;
+            }
+
+            // look for a non-empty ring, in round-robin...
+
+            size_t n = 0, r = 0;
+            uint64_t cons = 0;
+
+            for(bool poll = true;; poll = false)
+            {
+                for(n = 0; n < data_->rx_rings; n++)
+                {
+                    r = (data_->rx_ring_next + n) % data_->rx_rings;
+                    cons = rings[r].cons;
+                    if (const_cast<volatile uint64_t &>(rings[r].prod) != cons)
+                        break;
+                }
+
+                if (n != data_->rx_rings || !poll)
+                    break;
+#ifdef PFQ_USE_POLL
+                this->poll(microseconds);
+#else
+                (void)microseconds;
+#endif
+            }
+
+            auto base = reinterpret_cast<char *>(rings + data_->rx_rings);
+
+            if (n == data_->rx_rings)
+                return queue(base, data_->rx_slot_size, 0, 0);
+
+            smp_rmb();
+
+            auto prod = const_cast<volatile uint64_t &>(rings[r].prod);
+
+            data_->rx_ring_next = r + 1;
+            data_->rx_ring_cons = static_cast<int>(r);
+
+            if (data_->rx_mode & Q_RX_MODE_PACKED)
+            {
+                // walk the committed records, up to the end of the ring...
+
+                uint64_t start = cons, pos = cons;
+                size_t len = 0;
+
+                while (pos != prod)
+                {
+                    auto room = ring_bytes - pos % ring_bytes;
+                    auto h = reinterpret_cast<pfq_pkthdr *>(base + r * ring_bytes + pos % ring_bytes);
+
+                    if (room >= sizeof(pfq_pkthdr))
+                    {
+                        if (const_cast<volatile uint8_t &>(h->commit) != Q_RX_RING_COMMIT(pos, ring_bytes))
+                            break;
+                        smp_rmb();
+
+                        if (h->len != 0) {
+                            pos += Q_RX_PACKED_SLOT_SIZE(h->caplen) + Q_RX_HDR_EXT_SIZE(data_->rx_hdr_ext);
+                            len++;
+                            continue;
+                        }
+                    }
+
+                    // end of the ring: skip to the beginning, unless records are already taken...
+
+                    if (len)
+                        break;
+
+                    pos  += room;
+                    start = pos;
+                }
+
+                data_->rx_ring_pos = pos;
+
+                return queue(base + r * ring_bytes + start % ring_bytes, 0, len, Q_RX_RING_COMMIT(start, ring_bytes), pos - start,
+                             Q_RX_HDR_EXT_SIZE(data_->rx_hdr_ext));
+            }
+
+            // return the contiguous slots, up to the end of the ring...
+
+            auto pos   = cons % ring_bytes;
+            auto avail = std::min<uint64_t>(prod - cons, ring_bytes - pos);
+
+            data_->rx_ring_pos  = cons + avail;
+
+            auto len = avail / data_->rx_slot_size;
+
+            return queue(base + r * ring_bytes + pos, data_->rx_slot_size, len, Q_RX_RING_COMMIT(cons, ring_bytes),
+                         len * data_->rx_slot_size, Q_RX_HDR_EXT_SIZE(data_->rx_hdr_ext));
         }
 
+    public:
+
         //! Return the current commit version (used internally by the memory mapped queue).
 
         uint8_t
@@ -1124,8 +1581,8 @@ namespace pfq {
             if (buff.second < data_->rx_slots * data_->rx_slot_size)
                 throw pfq_error("PFQ: buffer too small");
 
-            memcpy(buff.first, this_queue.data(), this_queue.slot_size() * this_queue.size());
-            return queue(buff.first, this_queue.slot_size(), this_queue.size(), this_queue.index());
+            memcpy(buff.first, this_queue.data(), this_queue.bytes());
+            return queue(buff.first, this_queue.slot_size(), this_queue.size(), this_queue.index(), this_queue.bytes(), this_queue.ext_size());
         }
 
 
@@ -1156,6 +1613,38 @@ namespace pfq {
             return n;
         }
 
+        //! Specify the steering mode of the given group.
+        /*!
+         * With Q_STEERING_CONSISTENT a hash is mapped to a socket by a Maglev table,
+         * weighted by the sockets weight: when a socket joins or leaves the group only
+         * about 1/N of the flows move to a different socket. Q_STEERING_FOLD is the
+         * default.
+         */
+
+        void set_group_steering(int gid, int mode)
+        {
+            pfq_group_steering value { gid, mode };
+
+            if (::setsockopt(fd_, PF_Q, Q_SO_GROUP_STEERING, &value, sizeof(value)) == -1)
+                throw pfq_error(errno, "PFQ: group steering error");
+        }
+
+        //! Specify the overflow policy of the given steering group.
+        /*!
+         * A socket is congested when its Rx queue is filled above the threshold (percent).
+         * With Q_SPILL_NEW_FLOWS the new flows steered to a congested socket move to the
+         * least loaded one (and stick to it), with Q_SPILL_ALL every packet does.
+         * Spilled packets are counted in the spill field of the group stats.
+         */
+
+        void set_group_spill(int gid, int policy, int threshold = Q_SPILL_THRESHOLD_DEFAULT)
+        {
+            pfq_group_spill value { gid, policy, threshold };
+
+            if (::setsockopt(fd_, PF_Q, Q_SO_GROUP_SPILL, &value, sizeof(value)) == -1)
+                throw pfq_error(errno, "PFQ: group spill error");
+        }
+
         //! Set vlan filtering for the given group.
 
         void vlan_filters_enable(int gid, bool toggle)
@@ -1248,6 +1737,80 @@ namespace pfq {
             return std::vector<unsigned long>(std::begin(cs.counter), std::end(cs.counter));
         }
 
+        //! Return the per-node profiling counters of the computation of the given group.
+        /*!
+         * The counters are updated only when the lang_profile module parameter is set.
+         */
+
+        std::vector<pfq_lang_node_stats>
+        group_lang_stats(int gid) const
+        {
+            pfq_lang_stats ls;
+            ls.gid = gid;
+            socklen_t size = sizeof(struct pfq_lang_stats);
+            if (::getsockopt(fd_, PF_Q, Q_SO_GET_GROUP_LANG_STATS, &ls, &size) == -1)
+                throw pfq_error(errno, "PFQ: get group lang stats error");
+
+            return std::vector<pfq_lang_node_stats>(ls.node, ls.node + ls.size);
+        }
+
+        //! Return the entries of a state map of the given group.
+        /*!
+         * With aggregate, the values of a key are summed across the cpus and each key
+         * is returned once; otherwise every per-cpu entry is returned.
+         */
+
+        std::vector<pfq_state_entry>
+        group_state_map(int gid, int index, bool aggregate = true) const
+        {
+            std::vector<pfq_state_entry> entries(1024);
+
+            for(;;)
+            {
+                pfq_group_state state;
+                state.gid       = gid;
+                state.index     = index;
+                state.aggregate = aggregate;
+                state.size      = entries.size();
+                state.entry     = entries.data();
+
+                socklen_t size = sizeof(state);
+                if (::getsockopt(fd_, PF_Q, Q_SO_GET_GROUP_STATE_MAP, &state, &size) == -1)
+                    throw pfq_error(errno, "PFQ: get group state map error");
+
+                if (state.total <= entries.size()) {
+                    entries.resize(state.size);
+                    return entries;
+                }
+
+                entries.resize(state.total + state.total/4);
+            }
+        }
+
+        //! Return the heavy hitters of the given group, sorted by count.
+        /*!
+         * If reset is true a new measurement window is started.
+         */
+
+        std::vector<pfq_heavy_hitter>
+        group_topk(int gid, bool reset = false) const
+        {
+            std::vector<pfq_heavy_hitter> entries(Q_MAX_TOPK);
+
+            pfq_group_topk topk;
+            topk.gid   = gid;
+            topk.reset = reset;
+            topk.size  = entries.size();
+            topk.entry = entries.data();
+
+            socklen_t size = sizeof(topk);
+            if (::getsockopt(fd_, PF_Q, Q_SO_GET_GROUP_TOPK, &topk, &size) == -1)
+                throw pfq_error(errno, "PFQ: get group top-k error");
+
+            entries.resize(topk.size);
+            return entries;
+        }
+
         //! Return the memory size of the Rx queue.
 
         size_t
@@ -1406,7 +1969,7 @@ namespace pfq {
     typename std::basic_ostream<CharT, Traits> &
     operator<<(std::basic_ostream<CharT,Traits> &out, const pfq_stats& rhs)
     {
-        return out << rhs.recv << ' ' << rhs.lost << ' ' << rhs.drop << ' ' << rhs.sent << ' ' << rhs.disc << ' ' << rhs.frwd << ' ' << rhs.kern;
+        return out << rhs.recv << ' ' << rhs.lost << ' ' << rhs.drop << ' ' << rhs.sent << ' ' << rhs.disc << ' ' << rhs.frwd << ' ' << rhs.kern << ' ' << rhs.spill;
     }
 
     inline pfq_stats&
@@ -1422,6 +1985,8 @@ namespace pfq {
         lhs.frwd += rhs.frwd;
         lhs.kern += rhs.kern;
 
+        lhs.spill += rhs.spill;
+
         return lhs;
     }
 
@@ -1438,6 +2003,8 @@ namespace pfq {
         lhs.frwd -= rhs.frwd;
         lhs.kern -= rhs.kern;
 
+        lhs.spill -= rhs.spill;
+
         return lhs;
     }
 
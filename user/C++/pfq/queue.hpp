@@ -47,21 +47,21 @@ namespace pfq {
         {
             friend struct queue::const_iterator;
 
-            iterator(pfq_pkthdr *h, size_t slot_size, size_t index)
-            : hdr_(h), slot_size_(slot_size), index_(index)
+            iterator(pfq_pkthdr *h, size_t slot_size, size_t index, size_t ext = 0)
+            : hdr_(h), slot_size_(slot_size), index_(index), ext_(ext)
             {}
 
             ~iterator() = default;
 
             iterator(const iterator &other)
-            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_)
+            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_), ext_(other.ext_)
             {}
 
             iterator &
             operator++()
             {
                 hdr_ = reinterpret_cast<pfq_pkthdr *>(
-                        reinterpret_cast<char *>(hdr_) + slot_size_);
+                        reinterpret_cast<char *>(hdr_) + (slot_size_ ? slot_size_ : Q_RX_PACKED_SLOT_SIZE(hdr_->caplen) + ext_));
                 return *this;
             }
 
@@ -91,6 +91,17 @@ namespace pfq {
                 return hdr_+1;
             }
 
+            //! Return the extended header of the packet (nullptr if not enabled).
+
+            pfq_pkthdr_ext *
+            header_ext() const
+            {
+                if (ext_ == 0)
+                    return nullptr;
+                return reinterpret_cast<pfq_pkthdr_ext *>(reinterpret_cast<char *>(hdr_) +
+                        (slot_size_ ? slot_size_ - ext_ : Q_RX_PACKED_SLOT_SIZE(hdr_->caplen)));
+            }
+
             bool
             ready() const
             {
@@ -115,22 +126,23 @@ namespace pfq {
             pfq_pkthdr *hdr_;
             size_t   slot_size_;
             size_t   index_;
+            size_t   ext_;
         };
 
         //! Constant forward iterator over packets.
 
         struct const_iterator : public std::iterator<std::forward_iterator_tag, pfq_pkthdr>
         {
-            const_iterator(pfq_pkthdr *h, size_t slot_size, size_t index)
-            : hdr_(h), slot_size_(slot_size), index_(index)
+            const_iterator(pfq_pkthdr *h, size_t slot_size, size_t index, size_t ext = 0)
+            : hdr_(h), slot_size_(slot_size), index_(index), ext_(ext)
             {}
 
             const_iterator(const const_iterator &other)
-            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_)
+            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_), ext_(other.ext_)
             {}
 
             const_iterator(const queue::iterator &other)
-            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_)
+            : hdr_(other.hdr_), slot_size_(other.slot_size_), index_(other.index_), ext_(other.ext_)
             {}
 
             ~const_iterator() = default;
@@ -139,7 +151,7 @@ namespace pfq {
             operator++()
             {
                 hdr_ = reinterpret_cast<pfq_pkthdr *>(
-                        reinterpret_cast<char *>(hdr_) + slot_size_);
+                        reinterpret_cast<char *>(hdr_) + (slot_size_ ? slot_size_ : Q_RX_PACKED_SLOT_SIZE(hdr_->caplen) + ext_));
                 return *this;
             }
 
@@ -169,6 +181,17 @@ namespace pfq {
                 return hdr_+1;
             }
 
+            //! Return the extended header of the packet (nullptr if not enabled).
+
+            const pfq_pkthdr_ext *
+            header_ext() const
+            {
+                if (ext_ == 0)
+                    return nullptr;
+                return reinterpret_cast<const pfq_pkthdr_ext *>(reinterpret_cast<const char *>(hdr_) +
+                        (slot_size_ ? slot_size_ - ext_ : Q_RX_PACKED_SLOT_SIZE(hdr_->caplen)));
+            }
+
             bool
             ready() const
             {
@@ -193,6 +216,7 @@ namespace pfq {
             pfq_pkthdr *hdr_;
             size_t  slot_size_;
             size_t  index_;
+            size_t  ext_;
         };
 
     public:
@@ -203,7 +227,17 @@ namespace pfq {
          */
 
         queue(void *addr, size_t slot_size, size_t queue_len, size_t index)
-        : addr_(addr), slot_size_(slot_size), queue_len_(queue_len), index_(index)
+        : addr_(addr), slot_size_(slot_size), queue_len_(queue_len), index_(index), bytes_(queue_len * slot_size), ext_(0)
+        {}
+
+        //! Constructor
+        /*!
+         * Construct a queue descriptor of packed slots (slot_size 0), with the given size in bytes.
+         * The slots end with an extended header of ext bytes, if not 0.
+         */
+
+        queue(void *addr, size_t slot_size, size_t queue_len, size_t index, size_t bytes, size_t ext = 0)
+        : addr_(addr), slot_size_(slot_size), queue_len_(queue_len), index_(index), bytes_(bytes), ext_(ext)
         {}
 
         //! Defaulted copy constructor.
@@ -239,7 +273,7 @@ namespace pfq {
             return index_;
         }
 
-        //! Return the size of the queue slot, in bytes.
+        //! Return the size of the queue slot, in bytes (0 for packed slots).
 
         size_t
         slot_size() const
@@ -247,6 +281,22 @@ namespace pfq {
             return slot_size_;
         }
 
+        //! Return the size of the extended header that ends the slots, in bytes (0 if not enabled).
+
+        size_t
+        ext_size() const
+        {
+            return ext_;
+        }
+
+        //! Return the size of the queue, in bytes.
+
+        size_t
+        bytes() const
+        {
+            return bytes_;
+        }
+
         //! Return the pointer to the packet.
 
         const void *
@@ -263,7 +313,7 @@ namespace pfq {
         iterator
         begin()
         {
-            return iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_);
+            return iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_, ext_);
         }
 
         //! Return a constant iterator to the first slot of a non-empty queue.
@@ -274,7 +324,7 @@ namespace pfq {
         const_iterator
         begin() const
         {
-            return const_iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_);
+            return const_iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_, ext_);
         }
 
         //! Return an iterator past to the end of the queue.
@@ -283,7 +333,7 @@ namespace pfq {
         end()
         {
             return iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        static_cast<char *>(addr_) + bytes_), slot_size_, index_, ext_);
         }
 
         //! Return a constant iterator past to the end of the queue.
@@ -292,7 +342,7 @@ namespace pfq {
         end() const
         {
             return const_iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        static_cast<char *>(addr_) + bytes_), slot_size_, index_, ext_);
         }
 
         //! Return a constant iterator to the first slot of an non-empty queue.
@@ -303,7 +353,7 @@ namespace pfq {
         const_iterator
         cbegin() const
         {
-            return const_iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_);
+            return const_iterator(reinterpret_cast<pfq_pkthdr *>(addr_), slot_size_, index_, ext_);
         }
 
         //! Return a constant iterator past to the end of the queue.
@@ -312,7 +362,7 @@ namespace pfq {
         cend() const
         {
             return const_iterator(reinterpret_cast<pfq_pkthdr *>(
-                        static_cast<char *>(addr_) + queue_len_ * slot_size_), slot_size_, index_);
+                        static_cast<char *>(addr_) + bytes_), slot_size_, index_, ext_);
         }
 
     private:
@@ -320,6 +370,8 @@ namespace pfq {
         size_t  slot_size_;
         size_t  queue_len_;
         size_t  index_;
+        size_t  bytes_;
+        size_t  ext_;
     };
 
     //! Return the pointer to the packet.
@@ -212,6 +212,22 @@ namespace pfq {
         }
 
 
+        //! Hash mixer (the finalizer of MurmurHash3).
+
+        inline uint32_t
+        hash_mix(uint32_t h) noexcept
+        {
+            h ^= h >> 16;
+            h *= 0x85ebca6b;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35;
+            h ^= h >> 16;
+            return h;
+        }
+
+
+        //! Symmetric hash: both the directions of a flow get the same hash.
+
         inline uint32_t
         symmetric_hash(const char *buf) noexcept
         {
@@ -224,14 +240,22 @@ namespace pfq {
             ptr += sizeof(ethhdr);
 
             auto ih = reinterpret_cast<const iphdr *>(ptr);
+
+            uint32_t a = std::min(ih->saddr, ih->daddr);
+            uint32_t b = std::max(ih->saddr, ih->daddr);
+
             if (ih->protocol != IPPROTO_TCP &&
                 ih->protocol != IPPROTO_UDP)
-                return (ih->saddr ^ ih->daddr);
+                return hash_mix(a ^ hash_mix(b));
 
-            ptr += sizeof(ih->ihl << 2);
+            ptr += ih->ihl << 2;
 
             auto uh = reinterpret_cast<const udphdr *>(ptr);
-            return (ih->saddr ^ ih->daddr ^ uh->source ^ uh->dest);
+
+            uint32_t p = std::min(uh->source, uh->dest);
+            uint32_t q = std::max(uh->source, uh->dest);
+
+            return hash_mix(a ^ hash_mix(b ^ hash_mix((p << 16) | q)));
         }
 
 
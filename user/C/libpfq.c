@@ -148,6 +148,13 @@ typedef struct pfq_data
 	size_t rx_slots;
 	size_t rx_slot_size;
 
+	int    rx_mode;
+	int    rx_hdr_ext;
+	size_t rx_rings;
+	size_t rx_ring_next;		/* next ring to read (round-robin) */
+	int    rx_ring_cons;		/* ring to release at the next read */
+	uint64_t rx_ring_pos;
+
         size_t tx_slots;
 	size_t tx_slot_size;
 
@@ -240,6 +247,9 @@ pfq_open_group(unsigned long class_mask, int group_policy, size_t caplen, size_t
 	q->gid 	    = -1;
         q->tx_async =  1;
 
+	q->rx_mode  = Q_RX_MODE_DOUBLE_BUFFER;
+	q->rx_ring_cons = -1;
+
         memset(&q->netq, 0, sizeof(q->netq));
 
 	/* get id */
@@ -359,7 +369,15 @@ pfq_enable(pfq_t *q)
        	q->rx_queue_addr = (char *)(q->shm_addr) + sizeof(struct pfq_shared_queue);
         q->rx_queue_size = q->rx_slots * q->rx_slot_size;
 
-        q->tx_queue_addr = (char *)(q->shm_addr) + sizeof(struct pfq_shared_queue) + q->rx_queue_size * 2;
+	q->rx_rings     = ((struct pfq_shared_queue *)q->shm_addr)->rx.rings;
+	q->rx_ring_next = 0;
+	q->rx_ring_cons = -1;
+
+	if (q->rx_mode != Q_RX_MODE_DOUBLE_BUFFER)
+		q->tx_queue_addr = (char *)(q->rx_queue_addr) + q->rx_rings * (sizeof(struct pfq_rx_ring) + q->rx_queue_size);
+	else
+		q->tx_queue_addr = (char *)(q->rx_queue_addr) + q->rx_queue_size * 2;
+
         q->tx_queue_size = q->tx_slots * q->tx_slot_size;
 
         return Q_OK(q);
@@ -483,7 +501,7 @@ pfq_set_caplen(pfq_t *q, size_t value)
 		return Q_ERROR(q, "PFQ: set caplen error");
 	}
 
-	q->rx_slot_size = ALIGN(sizeof(struct pfq_pkthdr) + value, 8);
+	q->rx_slot_size = ALIGN(sizeof(struct pfq_pkthdr) + value, 8) + Q_RX_HDR_EXT_SIZE(q->rx_hdr_ext);
 	return Q_OK(q);
 }
 
@@ -564,6 +582,120 @@ pfq_get_rx_slot_size(pfq_t const *q)
 }
 
 
+int
+pfq_set_rx_mode(pfq_t *q, int mode)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (Rx mode could not be set)");
+	}
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_MODE, &mode, sizeof(mode)) == -1) {
+		return Q_ERROR(q, "PFQ: set Rx mode error");
+	}
+
+	q->rx_mode = mode;
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_rx_mode(pfq_t const *q)
+{
+	return q->rx_mode;
+}
+
+
+int
+pfq_set_rx_hdr_ext(pfq_t *q, int value)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (Rx extended header could not be set)");
+	}
+	value = value ? 1 : 0;
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_HDR_EXT, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set Rx extended header error");
+	}
+
+	q->rx_slot_size = q->rx_slot_size - Q_RX_HDR_EXT_SIZE(q->rx_hdr_ext) + Q_RX_HDR_EXT_SIZE(value);
+	q->rx_hdr_ext = value;
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_rx_hdr_ext(pfq_t const *q)
+{
+	return q->rx_hdr_ext;
+}
+
+
+int
+pfq_set_rx_wakeup(pfq_t *q, int packets)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_WAKEUP, &packets, sizeof(packets)) == -1) {
+		return Q_ERROR(q, "PFQ: set Rx wakeup error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_rx_wakeup(pfq_t const *q)
+{
+	int ret; socklen_t size = sizeof(int);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_RX_WAKEUP, &ret, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get Rx wakeup error");
+	}
+	return Q_VALUE(q, ret);
+}
+
+
+int
+pfq_set_rx_wakeup_delay(pfq_t *q, int microseconds)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_WAKEUP_DELAY, &microseconds, sizeof(microseconds)) == -1) {
+		return Q_ERROR(q, "PFQ: set Rx wakeup delay error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_rx_wakeup_delay(pfq_t const *q)
+{
+	int ret; socklen_t size = sizeof(int);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_RX_WAKEUP_DELAY, &ret, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get Rx wakeup delay error");
+	}
+	return Q_VALUE(q, ret);
+}
+
+
+int
+pfq_set_weight(pfq_t *q, int weight)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_WEIGHT, &weight, sizeof(weight)) == -1) {
+		return Q_ERROR(q, "PFQ: set weight error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_weight(pfq_t const *q)
+{
+	int ret; socklen_t size = sizeof(int);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_WEIGHT, &ret, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get weight error");
+	}
+	return Q_VALUE(q, ret);
+}
+
+
 int
 pfq_bind_group(pfq_t *q, int gid, const char *dev, int queue)
 {
@@ -701,6 +833,19 @@ pfq_set_group_computation(pfq_t *q, int gid, struct pfq_computation_descr *comp)
 }
 
 
+int
+pfq_set_group_function_arg(pfq_t *q, int gid, int index, int arg, struct pfq_functional_arg_descr const *value)
+{
+        struct pfq_group_function_arg p = { gid, index, arg, *value };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_FUNCTION_ARG, &p, sizeof(p)) == -1) {
+		return Q_ERROR(q, "PFQ: group function argument error");
+        }
+
+	return Q_OK(q);
+}
+
+
 int
 pfq_set_group_computation_from_string(pfq_t *q, int gid, const char *comp)
 {
@@ -774,6 +919,19 @@ pfq_group_fprog_reset(pfq_t *q, int gid)
 }
 
 
+int
+pfq_group_ebpf(pfq_t *q, int gid, int fd)
+{
+	struct pfq_group_ebpf ebpf = { gid, fd };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_EBPF, &ebpf, sizeof(ebpf)) == -1) {
+		return Q_ERROR(q, "PFQ: set group ebpf error");
+	}
+
+	return Q_OK(q);
+}
+
+
 int
 pfq_join_group(pfq_t *q, int gid, unsigned long class_mask, int group_policy)
 {
@@ -869,6 +1027,169 @@ pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs)
 }
 
 
+int
+pfq_get_group_lang_stats(pfq_t const *q, int gid, struct pfq_lang_stats *stats)
+{
+	socklen_t size = sizeof(struct pfq_lang_stats);
+
+	stats->gid = gid;
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_LANG_STATS, stats, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get group lang stats error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_group_state_map(pfq_t const *q, struct pfq_group_state *state)
+{
+	socklen_t size = sizeof(struct pfq_group_state);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_STATE_MAP, state, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get group state map error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_group_topk(pfq_t const *q, struct pfq_group_topk *topk)
+{
+	socklen_t size = sizeof(struct pfq_group_topk);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_TOPK, topk, &size) == -1) {
+		return Q_ERROR(q, "PFQ: get group top-k error");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_set_group_sketch(pfq_t *q, int gid, int depth, size_t width, size_t topk)
+{
+        struct pfq_group_sketch value = { gid, depth, width, topk };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_SKETCH, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: group sketch error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_set_group_steering(pfq_t *q, int gid, int mode)
+{
+        struct pfq_group_steering value = { gid, mode };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_STEERING, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: group steering error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_set_group_spill(pfq_t *q, int gid, int policy, int threshold)
+{
+        struct pfq_group_spill value = { gid, policy, threshold };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_SPILL, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: group spill error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_set_group_state_map(pfq_t *q, int gid, int index, size_t size)
+{
+        struct pfq_group_state_map value = { gid, index, size };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_STATE_MAP, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: group state map error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_set_group_flow_track(pfq_t *q, int gid, size_t size, size_t ring, int idle_timeout, int active_timeout)
+{
+        struct pfq_group_flow_track value = { gid, idle_timeout, active_timeout, size, ring };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_FLOW_TRACK, &value, sizeof(value)) == -1) {
+	        return Q_ERROR(q, "PFQ: group flow track error");
+        }
+
+        return Q_OK(q);
+}
+
+
+int
+pfq_flow_ring_map(pfq_t const *q, int gid, struct pfq_flow_ring **ring)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	struct pfq_flow_ring *hdr;
+	size_t mem;
+
+	/* map the header first, to get the size of the ring */
+
+	hdr = mmap(NULL, page, PROT_READ, MAP_SHARED, q->fd, Q_FLOW_RING_PGOFF(gid) * page);
+	if (hdr == MAP_FAILED) {
+		return Q_ERROR(q, "PFQ: flow ring mmap error");
+	}
+
+	mem = (Q_FLOW_RING_MEM(hdr->size) + page - 1) & ~(page - 1);
+
+	munmap(hdr, page);
+
+	*ring = mmap(NULL, mem, PROT_READ|PROT_WRITE, MAP_SHARED, q->fd, Q_FLOW_RING_PGOFF(gid) * page);
+	if (*ring == MAP_FAILED) {
+		*ring = NULL;
+		return Q_ERROR(q, "PFQ: flow ring mmap error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_flow_ring_unmap(pfq_t const *q, struct pfq_flow_ring *ring)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t mem = (Q_FLOW_RING_MEM(ring->size) + page - 1) & ~(page - 1);
+
+	if (munmap(ring, mem) == -1) {
+		return Q_ERROR(q, "PFQ: flow ring munmap error");
+	}
+
+	return Q_OK(q);
+}
+
+
+size_t
+pfq_flow_ring_read(struct pfq_flow_ring *ring, struct pfq_flow_record *rec, size_t max)
+{
+	uint64_t cons = ring->cons, prod = ring->prod;
+	size_t n = 0;
+
+	smp_rmb();
+
+	for(; cons != prod && n < max; cons++, n++)
+		rec[n] = ring->record[cons & (ring->size - 1)];
+
+	smp_wmb();
+
+	ring->cons = cons;
+	return n;
+}
+
+
 int
 pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle)
 {
@@ -905,6 +1226,138 @@ int pfq_vlan_reset_filter(pfq_t *q, int gid, int vid)
 }
 
 
+static int
+pfq_read_rings(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
+{
+	struct pfq_rx_ring * rings = (struct pfq_rx_ring *)q->rx_queue_addr;
+	size_t n, r = 0, avail, ring_bytes = q->rx_queue_size;
+	uint64_t cons = 0, prod, pos;
+	char *base;
+	int poll = 1;
+
+	/* release the slots returned by the previous read */
+
+	if (q->rx_ring_cons != -1) {
+
+		/* multi-producer ring: clear the commit of the released slots */
+
+		if (q->rx_mode == Q_RX_MODE_RING) {
+			char *rbase = (char *)(rings + q->rx_rings);
+			for(pos = rings[0].cons; pos + q->rx_slot_size <= q->rx_ring_pos; pos += q->rx_slot_size)
+				((struct pfq_pkthdr *)(rbase + pos % ring_bytes))->commit = 0;
+		}
+
+		smp_mb();
+		rings[q->rx_ring_cons].cons = q->rx_ring_pos;
+		q->rx_ring_cons = -1;
+	}
+
+	/* look for a non-empty ring, in round-robin */
+
+	for(;;)
+	{
+		for(n = 0; n < q->rx_rings; n++)
+		{
+			r = (q->rx_ring_next + n) % q->rx_rings;
+			cons = rings[r].cons;
+			if (*(volatile uint64_t *)&rings[r].prod != cons)
+				break;
+		}
+
+		if (n != q->rx_rings || !poll)
+			break;
+
+		poll = 0;
+#ifdef PFQ_USE_POLL
+		if (pfq_poll(q, microseconds) < 0) {
+			return Q_ERROR(q, "PFQ: poll error");
+		}
+#else
+		(void)microseconds;
+#endif
+	}
+
+	if (n == q->rx_rings) {
+		nq->queue = (char *)(rings + q->rx_rings);
+		nq->index = 0;
+		nq->len   = 0;
+		nq->slot_size = q->rx_slot_size;
+		nq->ext   = Q_RX_HDR_EXT_SIZE(q->rx_hdr_ext);
+		nq->bytes = 0;
+		return Q_VALUE(q, 0);
+	}
+
+	smp_rmb();
+
+	base = (char *)(rings + q->rx_rings) + r * ring_bytes;
+	prod = *(volatile uint64_t *)&rings[r].prod;
+
+	q->rx_ring_next = r + 1;
+	q->rx_ring_cons = (int)r;
+
+	if (q->rx_mode & Q_RX_MODE_PACKED) {
+
+		/* walk the committed records, up to the end of the ring */
+
+		uint64_t start = cons;
+
+		for(pos = cons, n = 0; pos != prod;)
+		{
+			size_t room = ring_bytes - pos % ring_bytes;
+			struct pfq_pkthdr *h = (struct pfq_pkthdr *)(base + pos % ring_bytes);
+
+			if (room >= sizeof(struct pfq_pkthdr)) {
+
+				if (*(volatile uint8_t *)&h->commit != Q_RX_RING_COMMIT(pos, ring_bytes))
+					break;
+				smp_rmb();
+
+				if (h->len != 0) {
+					pos += Q_RX_PACKED_SLOT_SIZE(h->caplen) + Q_RX_HDR_EXT_SIZE(q->rx_hdr_ext);
+					n++;
+					continue;
+				}
+			}
+
+			/* end of the ring: skip to the beginning, unless records are already taken */
+
+			if (n)
+				break;
+
+			pos  += room;
+			start = pos;
+		}
+
+		q->rx_ring_pos = pos;
+
+		nq->queue = base + start % ring_bytes;
+		nq->index = Q_RX_RING_COMMIT(start, ring_bytes);
+		nq->len   = n;
+		nq->slot_size = 0;
+		nq->ext   = Q_RX_HDR_EXT_SIZE(q->rx_hdr_ext);
+		nq->bytes = pos - start;
+
+		return Q_VALUE(q, (int)nq->len);
+	}
+
+	/* return the contiguous slots, up to the end of the ring */
+
+	pos   = cons % ring_bytes;
+	avail = min(prod - cons, ring_bytes - pos);
+
+	q->rx_ring_pos = cons + avail;
+
+	nq->queue = base + pos;
+	nq->index = Q_RX_RING_COMMIT(cons, ring_bytes);
+	nq->len   = avail / q->rx_slot_size;
+	nq->slot_size = q->rx_slot_size;
+	nq->ext   = Q_RX_HDR_EXT_SIZE(q->rx_hdr_ext);
+	nq->bytes = nq->len * nq->slot_size;
+
+	return Q_VALUE(q, (int)nq->len);
+}
+
+
 int
 pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 {
@@ -915,6 +1368,9 @@ pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
          	return Q_ERROR(q, "PFQ: read: socket not enabled");
 	}
 
+	if (q->rx_mode != Q_RX_MODE_DOUBLE_BUFFER)
+		return pfq_read_rings(q, nq, microseconds);
+
 	qd    = (struct pfq_shared_queue *)(q->shm_addr);
 	data  = qd->rx.data;
 	index = Q_SHARED_QUEUE_INDEX(data);
@@ -938,7 +1394,9 @@ pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 	nq->queue = (char *)(q->rx_queue_addr) + (index & 1) * q->rx_queue_size;
 	nq->index = index;
 	nq->len   = queue_len;
-        nq->slot_size = q->rx_slot_size;
+	nq->slot_size = q->rx_slot_size;
+	nq->ext   = Q_RX_HDR_EXT_SIZE(q->rx_hdr_ext);
+	nq->bytes = queue_len * q->rx_slot_size;
 
 	return Q_VALUE(q, (int)queue_len);
 }
@@ -954,7 +1412,7 @@ pfq_recv(pfq_t *q, void *buf, size_t buflen, struct pfq_net_queue *nq, long int
 		return Q_ERROR(q, "PFQ: buffer too small");
 	}
 
-	memcpy(buf, nq->queue, q->rx_slot_size * nq->len);
+	memcpy(buf, nq->queue, nq->bytes);
 	return Q_OK(q);
 }
 
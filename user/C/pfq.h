@@ -52,8 +52,10 @@ struct pfq_net_queue
 {
         pfq_iterator_t queue; 	  		/* net queue */
         size_t         len;       		/* number of packets in the queue */
-        size_t         slot_size;
+        size_t         slot_size; 		/* 0 for packed slots */
         unsigned int   index; 	  		/* current queue index */
+        size_t         bytes; 	  		/* size of the queue in bytes */
+        size_t         ext;       		/* size of the extended header, 0 if disabled */
 };
 
 
@@ -72,7 +74,7 @@ static inline
 pfq_iterator_t
 pfq_net_queue_end(struct pfq_net_queue const *nq)
 {
-        return nq->queue + nq->len * nq->slot_size;
+        return nq->queue + (nq->slot_size ? nq->len * nq->slot_size : nq->bytes);
 }
 
 /*! Return an iterator to the next slot. */
@@ -81,10 +83,12 @@ static inline
 pfq_iterator_t
 pfq_net_queue_next(struct pfq_net_queue const *nq, pfq_iterator_t iter)
 {
+        if (nq->slot_size == 0)
+                return iter + Q_RX_PACKED_SLOT_SIZE(((const struct pfq_pkthdr *)iter)->caplen) + nq->ext;
         return iter + nq->slot_size;
 }
 
-/*! Return an iterator to the previous slot. */
+/*! Return an iterator to the previous slot (not available for packed slots). */
 
 static inline
 pfq_iterator_t
@@ -111,6 +115,23 @@ pfq_iterator_data(pfq_iterator_t iter)
         return (const char *)(iter + sizeof(struct pfq_pkthdr));
 }
 
+/*! Given an iterator, return a pointer to the extended packet header. */
+/*!
+ * Return NULL if the extended header is not enabled. Offsets are relative
+ * to the packet data and must be checked against the caplen.
+ */
+
+static inline
+const struct pfq_pkthdr_ext *
+pfq_iterator_header_ext(struct pfq_net_queue const *nq, pfq_iterator_t iter)
+{
+        if (nq->ext == 0)
+                return NULL;
+        if (nq->slot_size == 0)
+                return (const struct pfq_pkthdr_ext *)(iter + Q_RX_PACKED_SLOT_SIZE(pfq_iterator_header(iter)->caplen));
+        return (const struct pfq_pkthdr_ext *)(iter + nq->slot_size - nq->ext);
+}
+
 /*! Given an iterator, return 1 if the packet is available. */
 
 static inline
@@ -143,12 +164,31 @@ pfq_yield()
 typedef void (*pfq_handler_t)(char *user, const struct pfq_pkthdr *h, const char *data);
 
 
-/*! Symmetric hashx */
+/*! Hash mixer (the finalizer of MurmurHash3) */
+
+static inline
+unsigned int pfq_hash_mix(unsigned int h)
+{
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+}
+
+
+/*! Symmetric hash */
+/*!
+ * Addresses and ports of the two endpoints are sorted before being mixed,
+ * so that both the directions of a flow get the same hash.
+ */
 
 static inline
 unsigned int pfq_symmetric_hash(const char *buf)
 {
         const char *ptr = buf;
+        unsigned int a, b, p, q;
 
         struct ethhdr const *eh = (struct ethhdr const *)(ptr);
         if (eh->h_proto != htons(0x800))
@@ -157,15 +197,22 @@ unsigned int pfq_symmetric_hash(const char *buf)
         ptr += sizeof(struct ethhdr);
 
         struct iphdr const *ih = (struct iphdr const *)(ptr);
+
+        a = ih->saddr < ih->daddr ? ih->saddr : ih->daddr;
+        b = ih->saddr < ih->daddr ? ih->daddr : ih->saddr;
+
         if (ih->protocol != IPPROTO_TCP &&
             ih->protocol != IPPROTO_UDP)
-            return (ih->saddr ^ ih->daddr);
+            return pfq_hash_mix(a ^ pfq_hash_mix(b));
 
-        ptr += sizeof(ih->ihl << 2);
+        ptr += ih->ihl << 2;
 
         struct udphdr const *uh = (struct udphdr const *)(ptr);
-        return (ih->saddr ^ ih->daddr ^ uh->source ^ uh->dest);
 
+        p = uh->source < uh->dest ? uh->source : uh->dest;
+        q = uh->source < uh->dest ? uh->dest : uh->source;
+
+        return pfq_hash_mix(a ^ pfq_hash_mix(b ^ pfq_hash_mix((p << 16) | q)));
 }
 
 
@@ -348,6 +395,82 @@ extern size_t pfq_get_rx_slots(pfq_t const *q);
 extern size_t pfq_get_rx_slot_size(pfq_t const *q);
 
 
+/*! Specify the mode of the Rx queue. */
+/*!
+ * Q_RX_MODE_DOUBLE_BUFFER (default), Q_RX_MODE_PERCPU_RINGS, that is one
+ * single-producer ring per cpu (read in round-robin), or Q_RX_MODE_RING,
+ * a multi-producer ring with per-slot commit (wait for the slot to be ready).
+ * Q_RX_MODE_PACKED can be or-ed to Q_RX_MODE_PERCPU_RINGS to store variable-length slots.
+ * The mode must be set before the socket is enabled.
+ */
+
+extern int pfq_set_rx_mode(pfq_t *q, int mode);
+
+
+/*! Return the mode of the Rx queue. */
+
+extern int pfq_get_rx_mode(pfq_t const *q);
+
+
+/*! Enable the extended packet header. */
+/*!
+ * Each slot ends with a pfq_pkthdr_ext that carries the offsets of the
+ * network and transport headers, the transport protocol and the steering
+ * hash computed by the kernel (see pfq_iterator_header_ext).
+ * The extended header must be enabled before the socket is enabled.
+ */
+
+extern int pfq_set_rx_hdr_ext(pfq_t *q, int value);
+
+
+/*! Return 1 if the extended packet header is enabled, 0 otherwise. */
+
+extern int pfq_get_rx_hdr_ext(pfq_t const *q);
+
+
+/*! Specify the wakeup threshold of the Rx queue, in packets. */
+/*!
+ * A reader sleeping in poll (or epoll) is woken up when the given number of
+ * packets has been enqueued. The default is Q_RX_WAKEUP_DEFAULT.
+ */
+
+extern int pfq_set_rx_wakeup(pfq_t *q, int packets);
+
+
+/*! Return the wakeup threshold of the Rx queue, in packets. */
+
+extern int pfq_get_rx_wakeup(pfq_t const *q);
+
+
+/*! Specify the max wakeup delay of the Rx queue, in microseconds. */
+/*!
+ * A reader sleeping in poll (or epoll) is woken up no later than the given
+ * delay from the first packet enqueued, even if the wakeup threshold is not
+ * reached. 0 disables the delay (default).
+ */
+
+extern int pfq_set_rx_wakeup_delay(pfq_t *q, int microseconds);
+
+
+/*! Return the max wakeup delay of the Rx queue, in microseconds. */
+
+extern int pfq_get_rx_wakeup_delay(pfq_t const *q);
+
+
+/*! Specify the steering weight of the socket. */
+/*!
+ * In groups with consistent steering, a socket receives a share of the flows
+ * proportional to its weight (1 by default, up to Q_MAX_STEERING_WEIGHT).
+ */
+
+extern int pfq_set_weight(pfq_t *q, int weight);
+
+
+/*! Return the steering weight of the socket. */
+
+extern int pfq_get_weight(pfq_t const *q);
+
+
 /*! Specify the length of the Tx queue, in number of packets. */
 /*!
  * The number of Tx slots can't exceed the value specified by
@@ -447,6 +570,16 @@ extern int pfq_set_group_computation(pfq_t *q, int gid, struct pfq_computation_d
 extern int pfq_set_group_computation_from_string(pfq_t *q, int gid, const char *prg);
 
 
+/*! Replace an argument of a function of the running group computation. */
+/*!
+ * The function is the one at the given index of the computation descriptor;
+ * the argument is described as in pfq_functional_arg_descr. The computation
+ * is neither reinstalled nor relinked.
+ */
+
+extern int pfq_set_group_function_arg(pfq_t *q, int gid, int index, int arg, struct pfq_functional_arg_descr const *value);
+
+
 /*! Specify a BPF program for the given group. */
 /*!
  * This function can be used to set a specific BPF filter for the group.
@@ -461,6 +594,82 @@ extern int pfq_group_fprog(pfq_t *q, int gid, struct sock_fprog *);
 extern int pfq_group_fprog_reset(pfq_t *q, int gid);
 
 
+/*! Specify an eBPF socket filter for the given group. */
+/*!
+ * The program is loaded by the caller (bpf(BPF_PROG_LOAD), type
+ * BPF_PROG_TYPE_SOCKET_FILTER); fd = -1 resets the filter.
+ * The kernel runs it JIT compiled when net.core.bpf_jit_enable is set.
+ */
+
+extern int pfq_group_ebpf(pfq_t *q, int gid, int fd);
+
+
+/*! Specify the steering mode of the given group. */
+/*!
+ * With Q_STEERING_CONSISTENT a hash is mapped to a socket by a Maglev table,
+ * weighted by the sockets weight: when a socket joins or leaves the group only
+ * about 1/N of the flows move to a different socket. Q_STEERING_FOLD is the
+ * default.
+ */
+
+extern int pfq_set_group_steering(pfq_t *q, int gid, int mode);
+
+
+/*! Specify the overflow policy of the given steering group. */
+/*!
+ * A socket is congested when its Rx queue is filled above the threshold (percent,
+ * Q_SPILL_THRESHOLD_DEFAULT). With Q_SPILL_NEW_FLOWS the new flows steered to a
+ * congested socket move to the least loaded one (and stick to it), with Q_SPILL_ALL
+ * every packet does. Spilled packets are counted in the spill field of the group stats.
+ */
+
+extern int pfq_set_group_spill(pfq_t *q, int gid, int policy, int threshold);
+
+
+/*! Create a state map of the given group. */
+/*!
+ * State maps are per-cpu key/value tables (index 0..Q_MAX_STATE_MAPS-1) used by
+ * stateful functions (e.g. count_by). The size is the number of entries per cpu;
+ * an existing map is replaced (its state is lost), size 0 removes it.
+ */
+
+extern int pfq_set_group_state_map(pfq_t *q, int gid, int index, size_t size);
+
+
+/*! Create the count-min sketch of the given group (used by count_min and heavy_hitter). */
+/*!
+ * The sketch has depth rows of width counters per cpu and keeps the topk keys
+ * with the highest estimates; an existing sketch is replaced, width 0 removes it.
+ */
+
+extern int pfq_set_group_sketch(pfq_t *q, int gid, int depth, size_t width, size_t topk);
+
+
+/*! Enable the flow table of the given group (used by the flow_track function). */
+/*!
+ * size is the number of flows per cpu (0 removes the table), ring the number of
+ * records of the export ring (power of 2); timeouts are in seconds. Records are
+ * exported when a flow is idle or active for too long, or when it is evicted.
+ */
+
+extern int pfq_set_group_flow_track(pfq_t *q, int gid, size_t size, size_t ring, int idle_timeout, int active_timeout);
+
+
+/*! Map the export ring of the flow table of the given group. */
+
+extern int pfq_flow_ring_map(pfq_t const *q, int gid, struct pfq_flow_ring **ring);
+
+
+/*! Unmap an export ring. */
+
+extern int pfq_flow_ring_unmap(pfq_t const *q, struct pfq_flow_ring *ring);
+
+
+/*! Drain up to max records from the export ring; return the number of records read. */
+
+extern size_t pfq_flow_ring_read(struct pfq_flow_ring *ring, struct pfq_flow_record *rec, size_t max);
+
+
 /*! Set vlan filtering for the given group. */
 
 extern int pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle);
@@ -556,6 +765,33 @@ extern int pfq_get_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats)
 extern int pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs);
 
 
+/*! Return the per-node profiling counters of the computation of the given group.
+ *
+ * The counters are updated only when the lang_profile module parameter is set.
+ */
+
+extern int pfq_get_group_lang_stats(pfq_t const *q, int gid, struct pfq_lang_stats *stats);
+
+
+/*! Return the entries of a state map of the given group. */
+/*!
+ * gid, index, aggregate, size and entry of the state are set by the caller.
+ * On return size holds the entries copied, total those in the map and miss
+ * the insertions failed because the map was full.
+ */
+
+extern int pfq_get_group_state_map(pfq_t const *q, struct pfq_group_state *state);
+
+
+/*! Return the heavy hitters of the given group, sorted by count. */
+/*!
+ * gid, reset, size and entry of topk are set by the caller; on return size
+ * holds the entries copied. With reset a new measurement window is started.
+ */
+
+extern int pfq_get_group_topk(pfq_t const *q, struct pfq_group_topk *topk);
+
+
 /*! Flush the Tx queue(s). */
 /*!
  * Transmit the packets in the Tx queues of the socket.
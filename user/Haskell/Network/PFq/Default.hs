@@ -71,6 +71,9 @@ module Network.PFq.Default
         ip_id       ,
         ip_frag     ,
         ip_ttl      ,
+        ip_saddr    ,
+        ip_daddr    ,
+        ip_flow     ,
         get_mark    ,
 
         tcp_source  ,
@@ -83,6 +86,7 @@ module Network.PFq.Default
 
         icmp_type   ,
         icmp_code   ,
+        vlan_vid    ,
 
         -- * Combinators
 
@@ -110,6 +114,7 @@ module Network.PFq.Default
         conditional ,
         when'       ,
         unless'     ,
+        switch      ,
 
         -- * Filters
         -- | A collection of monadic NetFunctions.
@@ -188,11 +193,29 @@ module Network.PFq.Default
         bloomCalcM  ,
         bloomCalcP  ,
 
+        -- * Longest-prefix match
+
+        lpm         ,
+        lpm_src     ,
+        lpm_dst     ,
+        lpm_filter  ,
+        steer_lpm   ,
+
+        -- * eBPF programs
+
+        ebpf        ,
+        ebpf_value  ,
+        ebpf_action ,
+
         -- * Miscellaneous
 
         unit       ,
         inc        ,
         dec        ,
+        count_by   ,
+        count_min  ,
+        heavy_hitter,
+        flow_track ,
         mark       ,
 
     ) where
@@ -388,6 +411,15 @@ ip_frag = Property "ip_frag" () () () () () () () ()
 -- | Evaluate to the /TTL/ field of the IP header.
 ip_ttl = Property "ip_ttl" () () () () () () () ()
 
+-- | Evaluate to the /source address/ of the IP header (host byte order).
+ip_saddr = Property "ip_saddr" () () () () () () () ()
+
+-- | Evaluate to the /destination address/ of the IP header (host byte order).
+ip_daddr = Property "ip_daddr" () () () () () () () ()
+
+-- | Evaluate to a 64-bit hash of the 5-tuple of the IP packet.
+ip_flow = Property "ip_flow" () () () () () () () ()
+
 -- | Evaluate to the /source port/ of the TCP header.
 tcp_source = Property "tcp_source" () () () () () () () ()
 
@@ -412,6 +444,9 @@ icmp_type = Property "icmp_type" () () () () () () () ()
 -- | Evaluate to the /code/ field of the ICMP header.
 icmp_code = Property "icmp_code" () () () () () () () ()
 
+-- | Evaluate to the VLAN id of the packet (untagged packets have no value).
+vlan_vid = Property "vlan_vid" () () () () () () () ()
+
 
 -- Predefined in-kernel computations:
 
@@ -619,6 +654,36 @@ inc n = MFunction "inc" n () () () () () () ()
 dec :: CInt -> NetFunction
 dec n = MFunction "dec" n () () () () () () ()
 
+-- | Count the packets by the value of the property, in the i-th state map of the current
+-- group. The map is created and read through the socket; packets for which the property
+-- is not defined are not counted.
+--
+-- > ip >-> count_by 0 ip_tos
+count_by :: CInt -> NetProperty -> NetFunction
+count_by n p = MFunction "count_by" n p () () () () () ()
+
+-- | Count the packet by the value of the property in the count-min sketch of the
+-- current group. The sketch is created and the heavy hitters are read through the
+-- socket.
+--
+-- > ip >-> count_min ip_saddr
+count_min :: NetProperty -> NetFunction
+count_min p = MFunction "count_min" p () () () () () () ()
+
+-- | Evaluate to /True/ if the estimate of the property in the sketch of the current
+-- cpu reaches the given threshold.
+--
+-- > ip >-> count_min ip_flow >-> when' (heavy_hitter ip_flow 100000) steer_flow
+heavy_hitter :: NetProperty -> Word64 -> NetPredicate
+heavy_hitter p x = Predicate "heavy_hitter" p x () () () () () ()
+
+-- | Track the IPv4 flows of the packet in the flow table of the current group.
+-- The table is created and its records are read through the socket.
+--
+-- > ip >-> flow_track
+flow_track :: NetFunction
+flow_track = MFunction "flow_track" () () () () () () () ()
+
 -- | Mark the packet with the given value.
 --
 -- > mark 42
@@ -701,6 +766,15 @@ unless' p c = MFunction "unless" p c () () () () () ()
 conditional :: NetPredicate -> NetFunction -> NetFunction -> NetFunction
 conditional p c1 c2 = MFunction "conditional" p c1 c2 () () () () ()
 
+-- | Dispatch on the value of a property.
+--
+-- The function evaluates to the NetFunction associated with the value of the property,
+-- or to the default one. The lookup is O(1) in the number of cases. Example:
+--
+-- > switch udp_dest [(53, log_msg "DNS"), (123, drop')] kernel
+switch :: NetProperty -> [(Word64, NetFunction)] -> NetFunction -> NetFunction
+switch p cs d = MFunction "switch" p (map fst cs) (foldr (\(_, f) r -> MFunction "case" f r () () () () () ()) d cs) () () () () ()
+
 -- | Function that inverts a monadic NetFunction. Useful to invert filters:
 --
 -- > inv ip >-> log_msg "This is not an IPv4 Packet"
@@ -786,3 +860,47 @@ bloomCalcN m p = ceiling $ fromIntegral (-m) * log(1 - p ** (1 / fromIntegral bl
 bloomCalcP :: Int -> Int -> Double
 bloomCalcP n m = (1 - (1 - 1 / fromIntegral m) ** fromIntegral (n * bloomK))^bloomK
 
+-- | Evaluate to /True/ when the source or the destination address of the packet belongs
+-- to one of the given IPv4/IPv6 networks. The match is exact and a plain address is a host
+-- route. Example:
+--
+-- > filter' (lpm ["10.0.0.0/8", "192.168.1.0/24", "2001:db8::/32"]) >-> kernel
+lpm :: [String] -> NetPredicate
+
+-- | Similarly to 'lpm', evaluates to /True/ when the source address matches.
+lpm_src :: [String] -> NetPredicate
+
+-- | Similarly to 'lpm', evaluates to /True/ when the destination address matches.
+lpm_dst :: [String] -> NetPredicate
+
+-- | Monadic counterpart of 'lpm' function.
+lpm_filter :: [String] -> NetFunction
+
+-- | Steer the packets by the longest prefixes matching their addresses: packets exchanged by
+-- the same pair of networks are delivered to the same socket, the others are dropped.
+steer_lpm :: [String] -> NetFunction
+
+lpm nets        = Predicate "lpm" nets () () () () () () ()
+lpm_src nets    = Predicate "lpm_src" nets () () () () () () ()
+lpm_dst nets    = Predicate "lpm_dst" nets () () () () () () ()
+lpm_filter nets = MFunction "lpm_filter" nets () () () () () () ()
+steer_lpm nets  = MFunction "steer_lpm" nets () () () () () () ()
+
+-- | Evaluate to /True/ when the eBPF program returns a non-zero value. The argument is the fd
+-- of a socket filter program loaded with bpf(BPF_PROG_LOAD). Example:
+--
+-- > filter' (ebpf fd) >-> kernel
+ebpf :: CInt -> NetPredicate
+
+-- | Evaluate to the value returned by the eBPF program (low 31 bits).
+ebpf_value :: CInt -> NetProperty
+
+-- | Run the eBPF program and take the action encoded by its return value: 0 drops the
+-- packet, Q_EBPF_STEER|hash steers it by hash, Q_EBPF_MARK|value marks it with value;
+-- any other value passes the packet.
+ebpf_action :: CInt -> NetFunction
+
+ebpf fd        = Predicate "ebpf" fd () () () () () () ()
+ebpf_value fd  = Property "ebpf_value" fd () () () () () () ()
+ebpf_action fd = MFunction "ebpf_action" fd () () () () () () ()
+
@@ -161,6 +161,7 @@ struct pcap_md {
         pfq_t          *q;
         pfq_iterator_t 	current;
         pfq_iterator_t 	end;
+        struct pfq_net_queue nq;
         uint64_t        ifs_promisc;
 
     } pfq;
@@ -234,6 +235,7 @@ struct pcap_opt {
 		int caplen;
 
 		int rx_slots;
+		int rx_mode;
 		int tx_slots;
 
 		int tx_flush;
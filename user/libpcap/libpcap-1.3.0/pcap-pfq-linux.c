@@ -496,6 +496,7 @@ pfq_getenv(pcap_t *handle)
        		.group    = -1,
        		.caplen   = handle->snapshot,
        		.rx_slots = 4096,
+       		.rx_mode  = Q_RX_MODE_DOUBLE_BUFFER,
 		.tx_slots = 4096,
 		.tx_flush = 1,
 		.tx_async = 0,
@@ -514,6 +515,9 @@ pfq_getenv(pcap_t *handle)
 	if ((opt = getenv("PFQ_RX_SLOTS")))
 		rc.rx_slots = atoi(opt);
 
+	if ((opt = getenv("PFQ_RX_MODE")))
+		rc.rx_mode = atoi(opt);
+
 	if ((opt = getenv("PFQ_TX_SLOTS")))
 		rc.tx_slots = atoi(opt);
 
@@ -567,6 +571,7 @@ pfq_parse_filename(const char *device)
 #define KEY_tx_task 		6
 #define KEY_vlan 		7
 #define KEY_computation 	8
+#define KEY_rx_mode 		9
 
 
 struct pfq_conf_key {
@@ -581,7 +586,8 @@ struct pfq_conf_key {
 	KEY(tx_flush),
 	KEY(tx_task),
 	KEY(vlan),
-	KEY(computation)
+	KEY(computation),
+	KEY(rx_mode)
 };
 
 
@@ -638,6 +644,7 @@ pfq_parse_config(struct pfq_opt *opt, const char *filename)
 				case KEY_group:  	opt->group 	= atoi(value); 	break;
 				case KEY_caplen:	opt->caplen 	= atoi(value);  break;
 				case KEY_rx_slots: 	opt->rx_slots 	= atoi(value);  break;
+				case KEY_rx_mode: 	opt->rx_mode 	= atoi(value);  break;
 				case KEY_tx_slots:	opt->tx_slots 	= atoi(value);  break;
 				case KEY_tx_flush:	opt->tx_flush   = atoi(value);  break;
 				case KEY_tx_queue:  {
@@ -733,10 +740,11 @@ pfq_activate_linux(pcap_t *handle)
         	handle->opt.pfq.rx_slots = handle->opt.buffer_size/handle->opt.pfq.caplen;
 
 
-        fprintf(stderr, "[PFQ] buffer_size = %d caplen = %d, rx_slots = %d, tx_slots = %d, tx_flush = %d\n",
+        fprintf(stderr, "[PFQ] buffer_size = %d caplen = %d, rx_slots = %d, rx_mode = %d, tx_slots = %d, tx_flush = %d\n",
         		handle->opt.buffer_size,
         		handle->opt.pfq.caplen,
         		handle->opt.pfq.rx_slots,
+        		handle->opt.pfq.rx_mode,
         		handle->opt.pfq.tx_slots,
         		handle->opt.pfq.tx_flush);
 
@@ -988,6 +996,14 @@ pfq_activate_linux(pcap_t *handle)
 		goto fail;
 	}
 
+	/* set the Rx queue mode */
+
+	if (handle->opt.pfq.rx_mode != Q_RX_MODE_DOUBLE_BUFFER &&
+	    pfq_set_rx_mode(handle->md.pfq.q, handle->opt.pfq.rx_mode) == -1) {
+		snprintf(handle->errbuf, PCAP_ERRBUF_SIZE, "%s", pfq_error(handle->md.pfq.q));
+		goto fail;
+	}
+
 	/* enable socket */
 
 	if (pfq_enable(handle->md.pfq.q) == -1) {
@@ -1095,7 +1111,7 @@ static int
 pfq_read_linux(pcap_t *handle, int max_packets, pcap_handler callback, u_char *user)
 {
         int start = handle->md.packets_read;
-	struct pfq_net_queue nq;
+	struct pfq_net_queue *nq = &handle->md.pfq.nq;
 	int n = max_packets;
 
 	pfq_iterator_t it, it_end;
@@ -1105,23 +1121,23 @@ pfq_read_linux(pcap_t *handle, int max_packets, pcap_handler callback, u_char *u
 
         if (it == it_end) {
 
-        	if (pfq_read(handle->md.pfq.q, &nq, handle->md.timeout > 0 ? handle->md.timeout * 1000 : 1000000) < 0) {
+        	if (pfq_read(handle->md.pfq.q, nq, handle->md.timeout > 0 ? handle->md.timeout * 1000 : 1000000) < 0) {
 			snprintf(handle->errbuf, sizeof(handle->errbuf), "PFQ read error");
 			return PCAP_ERROR;
 		}
 
-		it = handle->md.pfq.current = pfq_net_queue_begin(&nq);
-	        it_end = handle->md.pfq.end = pfq_net_queue_end(&nq);
+		it = handle->md.pfq.current = pfq_net_queue_begin(nq);
+	        it_end = handle->md.pfq.end = pfq_net_queue_end(nq);
 	}
 
-	for(; (max_packets <= 0 || n > 0) && (it != it_end); it = pfq_net_queue_next(&nq, it))
+	for(; (max_packets <= 0 || n > 0) && (it != it_end); it = pfq_net_queue_next(nq, it))
 	{
 		struct pcap_pkthdr pcap_h;
 		struct pfq_pkthdr *h;
                 uint16_t vlan_tci;
 		const char *pkt;
 
-		while (!pfq_iterator_ready(&nq, it))
+		while (!pfq_iterator_ready(nq, it))
 			pfq_yield();
 
 		h = (struct pfq_pkthdr *)pfq_iterator_header(it);
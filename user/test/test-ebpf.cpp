@@ -0,0 +1,98 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+
+#include <pfq/pfq.hpp>
+
+//
+// eBPF socket filter for a group: the program (drop the packets shorter
+// than 128 bytes) is loaded with bpf(BPF_PROG_LOAD) and attached by fd.
+// It runs JIT compiled when net.core.bpf_jit_enable is set.
+//
+
+static int
+load_program()
+{
+    struct bpf_insn prog[] =
+    {
+        // r0 = skb->len
+        { BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_1, static_cast<__s16>(offsetof(struct __sk_buff, len)), 0 },
+        // if r0 >= 128 goto exit
+        { BPF_JMP | BPF_JGE | BPF_K, BPF_REG_0, 0, 1, 128 },
+        // r0 = 0
+        { BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0 },
+        // exit
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 }
+    };
+
+    char license[] = "GPL";
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns     = reinterpret_cast<uintptr_t>(prog);
+    attr.insn_cnt  = sizeof(prog)/sizeof(prog[0]);
+    attr.license   = reinterpret_cast<uintptr_t>(license);
+
+    int fd = static_cast<int>(::syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr)));
+    if (fd < 0)
+        throw std::runtime_error("bpf: BPF_PROG_LOAD error");
+    return fd;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    std::ifstream jit("/proc/sys/net/core/bpf_jit_enable");
+    int jit_enable = 0;
+    jit >> jit_enable;
+
+    std::cout << "bpf_jit_enable: " << jit_enable << std::endl;
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    int fd = load_program();
+
+    q.set_group_ebpf(gid, fd);
+
+    ::close(fd);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto s = q.group_stats(gid);
+
+    std::cout << "captured: " << total << " group recv: " << s.recv << " drop: " << s.drop << std::endl;
+
+    q.reset_group_fprog(gid);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+
+#include <arpa/inet.h>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// In-kernel flow tracking: the IPv4 flows are tracked in the per-cpu flow
+// table of the group and the expired records are drained from the mmapped
+// export ring, NetFlow-like.
+//
+
+static const char *reason[] = { "", "idle", "active", "evicted", "flush" };
+
+static std::string
+ip_addr(uint32_t a)
+{
+    char buf[INET_ADDRSTRLEN];
+    return inet_ntop(AF_INET, &a, buf, sizeof(buf));
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 30;
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    q.set_group_flow_track(gid, 4096, 8192, 2 /* idle */, 10 /* active */);
+
+    auto ring = q.map_flow_ring(gid);
+
+    auto comp = ip >> flow_track;
+
+    std::cout << pretty(comp) << std::endl;
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    size_t flows = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        q.read(100000 /* timeout: micro */);
+
+        for(auto const &r : ring.read())
+        {
+            std::cout << ip_addr(r.saddr) << ':' << ntohs(r.sport) << " -> "
+                      << ip_addr(r.daddr) << ':' << ntohs(r.dport)
+                      << " proto " << static_cast<int>(r.proto)
+                      << " packets " << r.packets << " bytes " << r.bytes
+                      << " duration " << (r.last - r.first)/1000000 << "ms"
+                      << " (" << reason[r.reason < 5 ? r.reason : 0] << ")" << std::endl;
+            flows++;
+        }
+    }
+
+    std::cout << "flows: " << flows << " (dropped records: " << ring.drop() << ")" << std::endl;
+
+    q.set_group_flow_track(gid, 0, 0);
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <utility>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Check the extended packet header: the offsets and the protocol exported by
+// the kernel are compared with the ones parsed in user-space, and the packets
+// steered by steer_flow are expected to carry the steering hash. Both the
+// fixed slots and the packed slots are tested.
+//
+
+struct result
+{
+    size_t total;
+    size_t parsed;
+    size_t mismatch;
+    size_t hashed;
+};
+
+
+static bool
+check(const char *pkt, size_t caplen, pfq_pkthdr_ext const &ext)
+{
+    auto eh = reinterpret_cast<const ethhdr *>(pkt);
+
+    if (caplen < sizeof(ethhdr) + sizeof(iphdr) || eh->h_proto != htons(ETH_P_IP))
+        return (ext.flags & Q_PKTHDR_EXT_IP) == 0;
+
+    auto ih = reinterpret_cast<const iphdr *>(pkt + sizeof(ethhdr));
+
+    return (ext.flags & Q_PKTHDR_EXT_IP) &&
+           ext.l3_off   == sizeof(ethhdr) &&
+           ext.l4_off   == sizeof(ethhdr) + (ih->ihl << 2) &&
+           ext.l4_proto == ih->protocol;
+}
+
+
+static result
+run(const char *dev, int mode, int seconds)
+{
+    pfq::socket q(128, 65536);
+
+    q.rx_mode(mode);
+    q.rx_hdr_ext(true);
+
+    q.bind(dev, pfq::any_queue);
+
+    q.set_group_computation(q.group_id(), steer_flow);
+
+    q.enable();
+
+    result r {0, 0, 0, 0};
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+
+        for(auto it = many.begin(); it != many.end(); ++it)
+        {
+            if (!it.ready())
+                break;
+
+            auto ext = it.header_ext();
+            if (ext == nullptr)
+                throw std::runtime_error("extended header not available");
+
+            r.total++;
+
+            if (ext->flags & Q_PKTHDR_EXT_HASH)
+                r.hashed++;
+
+            if (ext->flags & Q_PKTHDR_EXT_IP)
+                r.parsed++;
+
+            if (!check(static_cast<const char *>(it.data()), it->caplen, *ext))
+                r.mismatch++;
+        }
+    }
+
+    return r;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    std::pair<int, const char *> modes[] =
+    {
+        { Q_RX_MODE_DOUBLE_BUFFER,                  "double buffer:"         },
+        { Q_RX_MODE_PERCPU_RINGS|Q_RX_MODE_PACKED,  "per-cpu rings (packed):" },
+    };
+
+    bool ok = true;
+
+    for(auto const &m : modes)
+    {
+        auto r = run(argv[1], m.first, seconds);
+
+        std::cout << m.second << std::endl;
+        std::cout << "    packets: " << r.total << " ip: " << r.parsed << " steered (with hash): " << r.hashed
+                  << " mismatch: " << r.mismatch << std::endl;
+
+        ok = ok && r.mismatch == 0;
+    }
+
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
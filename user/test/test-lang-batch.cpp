@@ -0,0 +1,89 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Compare per-packet and batch-at-a-time evaluation of PFQ/lang.
+//
+// The module parameter lang_batch is toggled at runtime. With the module
+// parameter lang_profile set, the cycles per node of both the engines are
+// reported in /proc/pfq/computations (see also test-lang-profile).
+//
+
+static void
+set_lang_batch(int value)
+{
+    std::ofstream param("/sys/module/pfq/parameters/lang_batch");
+    if (!param)
+        throw std::runtime_error("lang_batch: could not open module parameter");
+    param << value << std::endl;
+}
+
+
+static double
+run(const char *dev, int seconds)
+{
+    pfq::socket q(128);
+
+    q.bind(dev, pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    auto comp = ip >> udp >> steer_flow;
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto start = std::chrono::system_clock::now();
+    auto stop  = start + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto s = q.group_stats(gid);
+
+    std::cout << "    group recv: " << s.recv << " drop: " << s.drop << std::endl;
+
+    return static_cast<double>(total) / seconds;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    std::cout << pretty (ip >> udp >> steer_flow) << std::endl;
+
+    for(int mode = 0; mode < 2; mode++)
+    {
+        set_lang_batch(mode);
+
+        std::cout << (mode ? "batch-at-a-time:" : "per-packet:") << std::endl;
+
+        auto pps = run(argv[1], seconds);
+
+        std::cout << "    " << pps << " pkt/sec" << std::endl;
+    }
+
+    set_lang_batch(0);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// eBPF programs as PFQ/lang functions: the program drops the packets shorter
+// than 128 bytes and marks the others with their length (Q_EBPF_MARK), the
+// computation counts the packets by mark.
+//
+
+static int
+load_program()
+{
+    struct bpf_insn prog[] =
+    {
+        // r0 = skb->len
+        { BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_1, static_cast<__s16>(offsetof(struct __sk_buff, len)), 0 },
+        // if r0 >= 128 goto mark
+        { BPF_JMP | BPF_JGE | BPF_K, BPF_REG_0, 0, 2, 128 },
+        // r0 = 0
+        { BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0 },
+        // exit
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+        // mark: r0 |= Q_EBPF_MARK
+        { BPF_ALU | BPF_OR | BPF_K, BPF_REG_0, 0, 0, Q_EBPF_MARK },
+        // exit
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 }
+    };
+
+    char license[] = "GPL";
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns     = reinterpret_cast<uintptr_t>(prog);
+    attr.insn_cnt  = sizeof(prog)/sizeof(prog[0]);
+    attr.license   = reinterpret_cast<uintptr_t>(license);
+
+    int fd = static_cast<int>(::syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr)));
+    if (fd < 0)
+        throw std::runtime_error("bpf: BPF_PROG_LOAD error");
+    return fd;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    int fd = load_program();
+
+    auto comp = ebpf_action(fd) >> conditional (get_mark < 512, inc(0), inc(1));
+
+    std::cout << pretty(comp) << std::endl;
+
+    q.set_group_computation(gid, comp);
+
+    ::close(fd);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto c = q.group_counters(gid);
+    auto s = q.group_stats(gid);
+
+    std::cout << "captured: " << total << " group recv: " << s.recv << " drop: " << s.drop << std::endl;
+    std::cout << "len < 512: " << c[0] << " len >= 512: " << c[1] << std::endl;
+
+    return 0;
+}
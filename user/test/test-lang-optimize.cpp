@@ -0,0 +1,95 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Load-time optimization of PFQ/lang computations.
+//
+// The computation below contains a unit, a filter implied by the following
+// one (ip >-> udp) and an 'and' whose expensive operand comes first. The
+// module parameter lang_optimize is toggled at runtime; the original and the
+// rewritten trees are printed from /proc/pfq/computations.
+//
+
+static void
+set_lang_optimize(int value)
+{
+    std::ofstream param("/sys/module/pfq/parameters/lang_optimize");
+    if (!param)
+        throw std::runtime_error("lang_optimize: could not open module parameter");
+    param << value << std::endl;
+}
+
+
+static void
+print_computations()
+{
+    std::ifstream proc("/proc/pfq/computations");
+    std::string line;
+
+    while (std::getline(proc, line))
+        std::cout << "    " << line << std::endl;
+}
+
+
+static double
+run(const char *dev, int seconds)
+{
+    pfq::socket q(128);
+
+    q.bind(dev, pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    auto comp = ip >> unit >> udp >> filter (bloom (1024, {"192.168.0.13", "192.168.0.42"}, 32) & is_udp) >> steer_flow;
+
+    q.set_group_computation(gid, comp);
+
+    print_computations();
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    return static_cast<double>(total) / seconds;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    for(int mode = 0; mode < 2; mode++)
+    {
+        set_lang_optimize(mode);
+
+        std::cout << (mode ? "optimized:" : "as written:") << std::endl;
+
+        auto pps = run(argv[1], seconds);
+
+        std::cout << "    " << pps << " pkt/sec" << std::endl;
+    }
+
+    set_lang_optimize(1);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Measure the per-packet parsed-header cache shared by PFQ/lang functions.
+//
+// The module parameter lang_hdr_cache is toggled at runtime: when disabled,
+// every function parses the packet headers on its own. With the module
+// parameter lang_profile set, the cycles per node are reported in
+// /proc/pfq/computations (see also test-lang-profile).
+//
+// Single functions should cost the same in both modes; chains of functions
+// that inspect the same headers should get cheaper with the cache enabled.
+//
+
+static void
+set_lang_hdr_cache(int value)
+{
+    std::ofstream param("/sys/module/pfq/parameters/lang_hdr_cache");
+    if (!param)
+        throw std::runtime_error("lang_hdr_cache: could not open module parameter");
+    param << value << std::endl;
+}
+
+
+template <typename Comp>
+static double
+run(const char *dev, Comp const &comp, int seconds)
+{
+    pfq::socket q(128);
+
+    q.bind(dev, pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto start = std::chrono::system_clock::now();
+    auto stop  = start + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    return static_cast<double>(total) / seconds;
+}
+
+
+template <typename Comp>
+static void
+measure(const char *dev, Comp const &comp, int seconds)
+{
+    std::cout << pretty(comp) << std::endl;
+
+    for(int mode = 0; mode < 2; mode++)
+    {
+        set_lang_hdr_cache(mode);
+
+        auto pps = run(dev, comp, seconds);
+
+        std::cout << "    " << (mode ? "cached:   " : "uncached: ") << pps << " pkt/sec" << std::endl;
+    }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    // single functions...
+
+    measure(argv[1], filter(is_udp), seconds);
+    measure(argv[1], filter(has_port(53)), seconds);
+    measure(argv[1], filter(ip_tos == 0), seconds);
+    measure(argv[1], steer_flow, seconds);
+
+    // a chain that inspects the same headers at every stage...
+
+    measure(argv[1], pfq::lang::ip >> udp >> port(53) >> filter(ip_tos == 0) >> steer_flow, seconds);
+
+    set_lang_hdr_cache(1);
+    return 0;
+}
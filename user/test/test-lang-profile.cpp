@@ -0,0 +1,78 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Per-node profiling counters of a PFQ/lang computation.
+//
+// The module parameter lang_profile is enabled at runtime; at the end of the
+// capture the counters of every node of the group computation are printed
+// (the same figures are available in /proc/pfq/computations).
+//
+
+static void
+set_lang_profile(int value)
+{
+    std::ofstream param("/sys/module/pfq/parameters/lang_profile");
+    if (!param)
+        throw std::runtime_error("lang_profile: could not open module parameter");
+    param << value << std::endl;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    auto comp = ip >> udp >> steer_flow;
+
+    std::cout << pretty(comp) << std::endl;
+
+    q.set_group_computation(gid, comp);
+
+    set_lang_profile(1);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto stats = q.group_lang_stats(gid);
+
+    std::cout << "read: " << total << " packets" << std::endl;
+
+    for(size_t n = 0; n < stats.size(); n++)
+    {
+        auto &s = stats[n];
+        std::cout << "node " << n << ": run " << s.run << " drop " << s.drop << " steer " << s.steer
+                  << " cycles/run " << (s.run ? s.cycles / s.run : 0) << std::endl;
+    }
+
+    set_lang_profile(0);
+    return 0;
+}
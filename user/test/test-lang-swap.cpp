@@ -0,0 +1,105 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+#include <linux/filter.h>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Reconfiguration latency of a group while packets are captured: the
+// computation and the BPF filter are swapped repeatedly with programs that
+// accept every packet, hence the drop counter of the group must not change
+// (packets lost for a full queue are reported apart).
+//
+
+static void
+latency(std::string const &what, int count, std::function<void(int)> fun)
+{
+    std::vector<double> lat;
+
+    for(int n = 0; n < count; n++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fun(n);
+        auto stop  = std::chrono::steady_clock::now();
+
+        lat.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+    }
+
+    std::sort(lat.begin(), lat.end());
+
+    double sum = 0;
+    for(auto l : lat)
+        sum += l;
+
+    std::cout << what << ": min " << lat.front() << " avg " << sum / lat.size()
+              << " max " << lat.back() << " usec (" << count << " swaps)" << std::endl;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [swaps]"));
+
+    int count = argc > 2 ? std::stoi(argv[2]) : 100;
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    q.enable();
+
+    std::atomic_bool stop(false);
+    std::atomic<size_t> total(0);
+
+    std::thread reader([&] {
+        while (!stop)
+        {
+            auto many = q.read(100000 /* timeout: micro */);
+            total += many.size();
+        }
+    });
+
+    auto before = q.group_stats(gid);
+
+    latency("computation", count, [&](int n) {
+        if (n & 1)
+            q.set_group_computation(gid, unit);
+        else
+            q.set_group_computation(gid, inc(0) >> unit);
+    });
+
+    struct sock_filter accept_all[] = { BPF_STMT(BPF_RET|BPF_K, 0xffff) };
+    struct sock_fprog fprog { 1, accept_all };
+
+    latency("bpf filter", count, [&](int) {
+        q.set_group_fprog(gid, fprog);
+    });
+
+    stop = true;
+    reader.join();
+
+    auto after = q.group_stats(gid);
+
+    std::cout << "captured: " << total << " group recv: " << after.recv - before.recv
+              << " drop: " << after.drop - before.drop << " lost: " << q.stats().lost << std::endl;
+
+    q.reset_group_fprog(gid);
+
+    return after.drop == before.drop ? 0 : 1;
+}
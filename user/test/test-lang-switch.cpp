@@ -0,0 +1,74 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Dispatch on a property value: the linear chain of 'when' and the
+// equivalent 'switch_' with O(1) lookup are compared on the same traffic.
+//
+
+template <typename Comp>
+static double
+run(const char *dev, int seconds, Comp const &comp)
+{
+    pfq::socket q(128);
+
+    q.bind(dev, pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto c = q.group_counters(gid);
+
+    std::cout << "    counters: " << c[0] << ' ' << c[1] << ' ' << c[2] << ' ' << c[3] << std::endl;
+
+    return static_cast<double>(total) / seconds;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    auto chain = udp >> when (udp_dest == 53,  inc(0))
+                     >> when (udp_dest == 123, inc(1))
+                     >> when (udp_dest == 161, inc(2))
+                     >> when (udp_dest == 514, inc(3));
+
+    auto table = udp >> switch_ (udp_dest, unit, case_(53, inc(0)),
+                                                 case_(123, inc(1)),
+                                                 case_(161, inc(2)),
+                                                 case_(514, inc(3)));
+
+    std::cout << pretty(chain) << std::endl;
+    std::cout << "    " << run(argv[1], seconds, chain) << " pkt/sec" << std::endl;
+
+    std::cout << pretty(table) << std::endl;
+    std::cout << "    " << run(argv[1], seconds, table) << " pkt/sec" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Runtime update of a function argument: the networks of an lpm predicate
+// are swapped once per second while packets are processed. The computation
+// is installed once; see /proc/pfq/computations for the number of updates.
+//
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    std::vector<std::vector<std::string>> nets =
+    {
+        { "10.0.0.0/8", "192.168.0.0/16" },
+        { "172.16.0.0/12", "2001:db8::/32" }
+    };
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    auto comp = conditional (lpm (nets[0]), inc(0) >> drop, inc(1));
+
+    // index of the lpm predicate in the serialized computation
+    //
+
+    int index = -1;
+    for(auto const &descr : serialize(comp, 0).first)
+        if (descr.symbol == "lpm")
+            index = static_cast<int>(descr.index);
+
+    std::cout << pretty(comp) << std::endl << "lpm @" << index << std::endl;
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    size_t total = 0;
+
+    for(int n = 1; n <= seconds; n++)
+    {
+        auto stop = std::chrono::system_clock::now() + std::chrono::seconds(1);
+
+        while (std::chrono::system_clock::now() < stop)
+        {
+            auto many = q.read(100000 /* timeout: micro */);
+            total += many.size();
+        }
+
+        auto cs = q.group_counters(gid);
+
+        std::cout << "matched: " << cs[0] << " not matched: " << cs[1] << " captured: " << total << std::endl;
+
+        q.set_group_function_arg(gid, index, 0, nets[n & 1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <chrono>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Longest-prefix match: the networks are read from a file (one per line,
+// e.g. a blocklist) or given on the command line; the packets of the matching
+// networks are counted and dropped, the others are captured.
+//
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 3)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev (file | net [net...])"));
+
+    std::vector<std::string> nets;
+
+    std::ifstream file(argv[2]);
+    if (file) {
+        std::string line;
+        while (std::getline(file, line))
+            if (!line.empty() && line[0] != '#')
+                nets.push_back(line);
+    }
+    else
+        nets.assign(argv + 2, argv + argc);
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    auto comp = conditional (lpm (nets), inc(0) >> drop, inc(1));
+
+    std::cout << nets.size() << " networks" << std::endl;
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(10);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto cs = q.group_counters(gid);
+
+    std::cout << "matched: " << cs[0] << " not matched: " << cs[1] << " captured: " << total << std::endl;
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <vector>
+
+#include <pfq/pfq.hpp>
+
+//
+// Open a number of sockets, each one in its own private group bound to the
+// same device, and read from them round-robin. Run it with 64, 128 and 256
+// sockets against a module built with PFQ_MAX_ID=256 to compare the receive
+// rate. When the module is compiled with PFQ_RX_PROFILE, the cycles per
+// packet of the receive path are reported in the kernel log:
+//
+//     [PFQ] Rx profile: ..._tsc.
+//
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 3)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev num_sockets [seconds]"));
+
+    size_t num = std::stoul(argv[2]);
+    int seconds = argc > 3 ? std::stoi(argv[3]) : 5;
+
+    std::vector<pfq::socket> qs;
+
+    for(size_t n = 0; n < num; n++)
+    {
+        qs.emplace_back(64, 1024);
+
+        qs.back().bind(argv[1], pfq::any_queue);
+        qs.back().enable();
+    }
+
+    std::cout << num << " sockets, groups of the last: ";
+    for(auto gid : qs.back().groups())
+        std::cout << gid << ' ';
+    std::cout << std::endl;
+
+    size_t total = 0;
+
+    auto start = std::chrono::system_clock::now();
+    auto stop  = start + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        for(auto &q : qs)
+        {
+            auto many = q.read(1000 / num + 1 /* timeout: micro */);
+            total += many.size();
+        }
+    }
+
+    size_t recv = 0, lost = 0, drop = 0;
+
+    for(auto &q : qs)
+    {
+        auto s = q.stats();
+        recv += s.recv; lost += s.lost; drop += s.drop;
+    }
+
+    std::cout << "recv: " << recv << " lost: " << lost << " drop: " << drop << std::endl;
+    std::cout << static_cast<double>(total) / seconds << " pkt/sec (" << static_cast<double>(total) / seconds / num << " per socket)" << std::endl;
+
+    return 0;
+}
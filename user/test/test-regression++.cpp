@@ -1,4 +1,6 @@
 #include <future>
+#include <chrono>
+#include <iostream>
 #include <system_error>
 
 #include <sys/types.h>
@@ -250,6 +252,46 @@ Context(PFQ)
     }
 
 
+    Test(restart)
+    {
+        // close and disable do not wait for a grace period: a capture
+        // process can be restarted without stalling
+
+        for(int n = 0; n < 10; n++)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            pfq::socket x(64);
+            x.bind(DEV.c_str());
+            x.enable();
+
+            auto ready = std::chrono::steady_clock::now();
+
+            auto first = ready;
+            for(int i = 0; i < 10; i++)
+            {
+                if (!x.read(100000).empty()) {
+                    first = std::chrono::steady_clock::now();
+                    break;
+                }
+            }
+
+            auto closing = std::chrono::steady_clock::now();
+
+            x.disable();
+            x.close();
+
+            auto stop = std::chrono::steady_clock::now();
+
+            std::cout << "restart " << n << ": enabled in " << std::chrono::duration_cast<std::chrono::microseconds>(ready - start).count()
+                      << " usec, first packet after " << std::chrono::duration_cast<std::chrono::microseconds>(first - start).count()
+                      << " usec, closed in " << std::chrono::duration_cast<std::chrono::microseconds>(stop - closing).count() << " usec" << std::endl;
+
+            Assert(std::chrono::duration_cast<std::chrono::milliseconds>(stop - closing).count() < 100);
+        }
+    }
+
+
     Test(stats)
     {
         pfq::socket x;
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <utility>
+#include <cstdlib>
+
+#include <pfq/pfq.hpp>
+
+//
+// Compare the receive rate of the double-buffer queue, of the per-cpu
+// single-producer rings and of the multi-producer ring. Run it with a
+// different number of cores serving the RSS queues of the device (e.g. by
+// changing the irq affinity) to see how the modes scale with the number of
+// producers. The packed modes store variable-length slots (e.g. run it with
+// a large caplen and short packets).
+//
+
+static double
+run(const char *dev, int mode, int seconds, size_t caplen)
+{
+    pfq::socket q(caplen, 65536);
+
+    q.rx_mode(mode);
+
+    q.bind(dev, pfq::any_queue);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto start = std::chrono::system_clock::now();
+    auto stop  = start + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto s = q.stats();
+
+    std::cout << "    recv: " << s.recv << " lost: " << s.lost << " drop: " << s.drop << std::endl;
+
+    return static_cast<double>(total) / seconds;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds] [caplen]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+    size_t caplen = argc > 3 ? std::stoul(argv[3]) : 128;
+
+    std::pair<int, const char *> modes[] =
+    {
+        { Q_RX_MODE_DOUBLE_BUFFER,                  "double buffer:"         },
+        { Q_RX_MODE_PERCPU_RINGS,                   "per-cpu rings:"         },
+        { Q_RX_MODE_RING,                           "ring:"                  },
+        { Q_RX_MODE_PERCPU_RINGS|Q_RX_MODE_PACKED,  "per-cpu rings (packed):" },
+    };
+
+    for(auto const &m : modes)
+    {
+        std::cout << m.second << std::endl;
+
+        auto pps = run(argv[1], m.first, seconds, caplen);
+
+        std::cout << "    " << pps << " pkt/sec" << std::endl;
+    }
+
+    return 0;
+}
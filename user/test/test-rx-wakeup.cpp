@@ -0,0 +1,129 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <pfq/pfq.hpp>
+
+//
+// Multiplex a number of PFQ sockets with epoll (edge-triggered) and report
+// the CPU usage against the delivery latency of packets, for the given wakeup
+// threshold and max wakeup delay. Run it with the generator sending at
+// different rates (e.g. 1k, 100k and 10M pps):
+//
+//     test-rx-wakeup eth0 16 8192 100
+//
+
+
+static double
+to_seconds(struct timeval const &tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [sockets] [wakeup] [delay_usec] [seconds]"));
+
+    size_t sockets = argc > 2 ? std::stoul(argv[2]) : 1;
+    int wakeup     = argc > 3 ? std::stoi(argv[3]) : Q_RX_WAKEUP_DEFAULT;
+    int delay      = argc > 4 ? std::stoi(argv[4]) : 0;
+    int seconds    = argc > 5 ? std::stoi(argv[5]) : 5;
+
+    int ep = epoll_create1(0);
+    if (ep == -1)
+        throw std::runtime_error("epoll_create1");
+
+    std::vector<std::unique_ptr<pfq::socket>> qs;
+
+    for(size_t n = 0; n < sockets; n++)
+    {
+        qs.emplace_back(new pfq::socket(128, 65536));
+
+        auto &q = *qs.back();
+
+        q.timestamp_enable(true);
+        q.rx_wakeup(wakeup);
+        q.rx_wakeup_delay(delay);
+        q.bind(argv[1], pfq::any_queue);
+        q.enable();
+
+        struct epoll_event ev;
+        ev.events   = EPOLLIN | EPOLLET;
+        ev.data.u64 = n;
+
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, q.fd(), &ev) == -1)
+            throw std::runtime_error("epoll_ctl");
+    }
+
+    size_t total = 0;
+    double lat_sum = 0, lat_max = 0;
+
+    struct rusage ru_start, ru_stop;
+    getrusage(RUSAGE_SELF, &ru_start);
+
+    auto start = std::chrono::steady_clock::now();
+    auto stop  = start + std::chrono::seconds(seconds);
+
+    struct epoll_event events[64];
+
+    while (std::chrono::steady_clock::now() < stop)
+    {
+        int n = epoll_wait(ep, events, 64, 100 /* msec */);
+
+        for(int i = 0; i < n; i++)
+        {
+            auto &q = *qs[events[i].data.u64];
+
+            // edge-triggered: drain the queue...
+
+            for(;;)
+            {
+                auto many = q.read(0);
+                if (many.empty())
+                    break;
+
+                struct timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+
+                for(auto it = many.begin(); it != many.end(); ++it)
+                {
+                    while (!it.ready())
+                        std::this_thread::yield();
+
+                    auto lat = (now.tv_sec - static_cast<double>(it->tstamp.tv.sec)) * 1000000.0 +
+                               (now.tv_nsec - static_cast<double>(it->tstamp.tv.nsec)) / 1000.0;
+
+                    lat_sum += lat;
+                    lat_max  = std::max(lat_max, lat);
+                }
+
+                total += many.size();
+            }
+        }
+    }
+
+    auto wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    getrusage(RUSAGE_SELF, &ru_stop);
+
+    auto cpu = to_seconds(ru_stop.ru_utime) - to_seconds(ru_start.ru_utime) +
+               to_seconds(ru_stop.ru_stime) - to_seconds(ru_start.ru_stime);
+
+    std::cout << "sockets: " << sockets << " wakeup: " << wakeup << " delay: " << delay << " usec" << std::endl;
+    std::cout << "    " << total / wall << " pkt/sec, cpu: " << 100.0 * cpu / wall << "%" << std::endl;
+    std::cout << "    latency avg: " << (total ? lat_sum / total : 0) << " usec, max: " << lat_max << " usec" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+
+#include <arpa/inet.h>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Heavy hitters: the packets are counted by source address in the count-min
+// sketch of the group (per-cpu, no locks on the fast path); every second the
+// merged top-K is read and a new measurement window is started. Packets of
+// the hottest sources are dropped by the heavy_hitter predicate.
+//
+
+static std::string
+ip_addr(uint64_t a)
+{
+    char buf[INET_ADDRSTRLEN];
+    uint32_t n = htonl(static_cast<uint32_t>(a));
+    return inet_ntop(AF_INET, &n, buf, sizeof(buf));
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds] [threshold]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 10;
+    uint64_t threshold = argc > 3 ? std::stoull(argv[3]) : 1000000;
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    q.set_group_sketch(gid, 4, 16384, 16);
+
+    auto comp = ip >> count_min(ip_saddr) >> when(heavy_hitter(ip_saddr, threshold), drop);
+
+    std::cout << pretty(comp) << std::endl;
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    for(int n = 0; n < seconds; n++)
+    {
+        auto stop = std::chrono::system_clock::now() + std::chrono::seconds(1);
+
+        while (std::chrono::system_clock::now() < stop)
+            q.read(100000 /* timeout: micro */);
+
+        std::cout << "window " << n << ':' << std::endl;
+
+        for(auto const &h : q.group_topk(gid, true))
+            std::cout << "    " << ip_addr(h.key) << ": " << h.count << std::endl;
+    }
+
+    q.set_group_sketch(gid, 0, 0, 0);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <vector>
+#include <utility>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Steer the traffic across a group of sockets, with the last one stalled
+// (it never reads its queue), and compare the spill policies: with
+// Q_SPILL_NONE the share of the stalled socket is dropped, with
+// Q_SPILL_NEW_FLOWS its new flows move to the other sockets, with
+// Q_SPILL_ALL every packet does.
+//
+
+static void
+run(const char *dev, int policy, size_t num, int seconds)
+{
+    std::vector<pfq::socket> qs;
+
+    qs.emplace_back(pfq::group_policy::shared, 128, 4096);
+
+    auto gid = qs.front().group_id();
+
+    for(size_t n = 1; n < num; n++)
+    {
+        qs.emplace_back(pfq::group_policy::undefined, 128, 4096);
+        qs.back().join_group(gid, pfq::group_policy::shared);
+    }
+
+    qs.front().set_group_spill(gid, policy);
+    qs.front().set_group_computation(gid, pfq::lang::ip >> steer_flow);
+    qs.front().bind(dev, pfq::any_queue);
+
+    for(auto &q : qs)
+        q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        for(size_t n = 0; n < num - 1; n++)
+        {
+            auto many = qs[n].read(1000 /* timeout: micro */);
+            total += many.size();
+        }
+    }
+
+    size_t drop = 0;
+    for(auto &q : qs)
+        drop += q.stats().drop;
+
+    auto g = qs.front().group_stats(gid);
+
+    std::cout << "    read: " << total << " socket drop: " << drop << " group spill: " << g.spill << std::endl;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [num_sockets] [seconds]"));
+
+    size_t num  = argc > 2 ? std::stoul(argv[2]) : 4;
+    int seconds = argc > 3 ? std::stoi(argv[3]) : 5;
+
+    if (num < 2)
+        throw std::runtime_error("at least 2 sockets required");
+
+    std::pair<int, const char *> policies[] =
+    {
+        { Q_SPILL_NONE,         "no spill:"     },
+        { Q_SPILL_NEW_FLOWS,    "spill new flows:" },
+        { Q_SPILL_ALL,          "spill all:"    },
+    };
+
+    for(auto const &p : policies)
+    {
+        std::cout << p.second << std::endl;
+        run(argv[1], p.first, num, seconds);
+    }
+
+    return 0;
+}
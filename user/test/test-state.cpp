@@ -0,0 +1,65 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <algorithm>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Per-group state maps: the packets are counted by IP TTL in the state
+// map 0 (per-cpu tables, no locks on the fast path) and the map is read back
+// both per cpu and aggregated.
+//
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [seconds]"));
+
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    pfq::socket q(128);
+
+    q.bind(argv[1], pfq::any_queue);
+
+    auto gid = q.group_id();
+
+    q.set_group_state_map(gid, 0, 256);
+
+    auto comp = ip >> count_by(0, ip_ttl);
+
+    std::cout << pretty(comp) << std::endl;
+
+    q.set_group_computation(gid, comp);
+
+    q.enable();
+
+    size_t total = 0;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        auto many = q.read(100000 /* timeout: micro */);
+        total += many.size();
+    }
+
+    auto per_cpu = q.group_state_map(gid, 0, false);
+    auto state   = q.group_state_map(gid, 0);
+
+    std::sort(std::begin(state), std::end(state), [](pfq_state_entry const &a, pfq_state_entry const &b) { return a.value > b.value; });
+
+    std::cout << "captured: " << total << " (" << per_cpu.size() << " per-cpu entries)" << std::endl;
+
+    for(auto const &e : state)
+        std::cout << "    ttl " << e.key << ": " << e.value << std::endl;
+
+    q.set_group_state_map(gid, 0, 0);
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <functional>
+
+#include <pfq/pfq.hpp>
+#include <pfq/util.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Compare the xor hash and the symmetric hash used for steering.
+//
+// Offline: the user-space hashes are evaluated over synthetic flows (with
+// identical ports and addresses that differ in the high bits only, and
+// random ones) and the load of the buckets is reported, with the cost
+// per packet.
+//
+// Online (if a device is given): the module parameter steer_hash is toggled
+// and the traffic is steered across a group of sockets with steer_flow. The
+// cycles per packet are in the kernel log when the module is compiled with
+// PFQ_RX_PROFILE.
+//
+
+static const size_t buckets = 16;
+
+
+static uint32_t
+xor_hash(const char *buf)
+{
+    auto ih = reinterpret_cast<const iphdr *>(buf + sizeof(ethhdr));
+    auto uh = reinterpret_cast<const udphdr *>(buf + sizeof(ethhdr) + (ih->ihl << 2));
+    return ih->saddr ^ ih->daddr ^ uh->source ^ uh->dest;
+}
+
+
+static std::vector<char>
+make_packet(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport)
+{
+    std::vector<char> buf(sizeof(ethhdr) + sizeof(iphdr) + sizeof(udphdr));
+
+    auto eh = reinterpret_cast<ethhdr *>(buf.data());
+    auto ih = reinterpret_cast<iphdr *>(buf.data() + sizeof(ethhdr));
+    auto uh = reinterpret_cast<udphdr *>(buf.data() + sizeof(ethhdr) + sizeof(iphdr));
+
+    eh->h_proto = htons(0x800);
+    ih->ihl = 5;
+    ih->protocol = IPPROTO_UDP;
+    ih->saddr = htonl(saddr);
+    ih->daddr = htonl(daddr);
+    uh->source = htons(sport);
+    uh->dest = htons(dport);
+
+    return buf;
+}
+
+
+static void
+evaluate(const char *name, std::vector<std::vector<char>> const &pkts, std::function<uint32_t(const char *)> hash)
+{
+    std::vector<size_t> load(buckets);
+
+    auto start = std::chrono::system_clock::now();
+
+    for(auto const &p : pkts)
+        load[pfq::fold(hash(p.data()), buckets)]++;
+
+    auto stop = std::chrono::system_clock::now();
+
+    auto mm = std::minmax_element(load.begin(), load.end());
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+
+    std::cout << "    " << name << ": min " << *mm.first << " max " << *mm.second
+              << " (max/mean " << static_cast<double>(*mm.second) * buckets / pkts.size() << ") "
+              << ns / pkts.size() << " ns/pkt" << std::endl;
+}
+
+
+static void
+offline()
+{
+    std::vector<std::vector<char>> high_bits, random;
+
+    std::mt19937 gen(42);
+
+    for(uint32_t n = 0; n < 65536; n++)
+    {
+        high_bits.push_back(make_packet((10u << 24) | n, (11u << 24) | n, 53, 53));
+        random.push_back(make_packet(gen(), gen(), gen(), gen()));
+    }
+
+    std::cout << "endpoints differing in the high bits only (10.x.y.z <-> 11.x.y.z), identical ports:" << std::endl;
+    evaluate("xor      ", high_bits, xor_hash);
+    evaluate("symmetric", high_bits, pfq::symmetric_hash);
+
+    std::cout << "random flows:" << std::endl;
+    evaluate("xor      ", random, xor_hash);
+    evaluate("symmetric", random, pfq::symmetric_hash);
+}
+
+
+static void
+set_steer_hash(int value)
+{
+    std::ofstream param("/sys/module/pfq/parameters/steer_hash");
+    if (!param)
+        throw std::runtime_error("steer_hash: could not open module parameter");
+    param << value << std::endl;
+}
+
+
+static void
+online(const char *dev, int seconds)
+{
+    const char *names[] = { "xor", "symmetric jhash", "NIC hash" };
+
+    for(int mode = 0; mode < 3; mode++)
+    {
+        set_steer_hash(mode);
+
+        std::vector<pfq::socket> qs;
+
+        qs.emplace_back(pfq::group_policy::shared, 64, 8192);
+
+        auto gid = qs.front().group_id();
+
+        for(size_t n = 1; n < buckets; n++)
+        {
+            qs.emplace_back(pfq::group_policy::undefined, 64, 8192);
+            qs.back().join_group(gid, pfq::group_policy::shared);
+        }
+
+        qs.front().set_group_computation(gid, steer_flow);
+        qs.front().bind(dev, pfq::any_queue);
+
+        for(auto &q : qs)
+            q.enable();
+
+        std::vector<size_t> load(buckets);
+
+        auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+        while (std::chrono::system_clock::now() < stop)
+        {
+            for(size_t n = 0; n < buckets; n++)
+                load[n] += qs[n].read(1000 /* timeout: micro */).size();
+        }
+
+        auto mm = std::minmax_element(load.begin(), load.end());
+
+        std::cout << names[mode] << ": min " << *mm.first << " max " << *mm.second << " pkt/socket" << std::endl;
+    }
+
+    set_steer_hash(1);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    offline();
+
+    if (argc > 1)
+        online(argv[1], argc > 2 ? std::stoi(argv[2]) : 5);
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+using namespace pfq::lang;
+
+//
+// Measure the fraction of flows that move to a different socket when a
+// member of a steering group leaves, with the fold and the consistent
+// (Maglev) steering. With N sockets the consistent steering should move
+// only the flows of the leaving socket (about 1/N). The first socket can be
+// given a different weight, to check that it receives a proportional share
+// of the flows.
+//
+
+typedef std::unordered_map<uint64_t, size_t> flow_map;
+
+
+static uint64_t
+flow_key(const char *buf, size_t caplen)
+{
+    if (caplen < sizeof(ethhdr) + sizeof(iphdr) + sizeof(udphdr))
+        return 0;
+
+    auto eh = reinterpret_cast<const ethhdr *>(buf);
+    if (eh->h_proto != htons(ETH_P_IP))
+        return 0;
+
+    auto ih = reinterpret_cast<const iphdr *>(buf + sizeof(ethhdr));
+    auto uh = reinterpret_cast<const udphdr *>(buf + sizeof(ethhdr) + (ih->ihl << 2));
+
+    /* symmetric, as steer_flow */
+
+    return (static_cast<uint64_t>(ih->saddr ^ ih->daddr) << 32) |
+           (static_cast<uint64_t>(ih->protocol) << 16) | static_cast<uint16_t>(uh->source ^ uh->dest);
+}
+
+
+static flow_map
+capture(std::vector<pfq::socket> &qs, int seconds)
+{
+    flow_map flows;
+
+    auto stop = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+
+    while (std::chrono::system_clock::now() < stop)
+    {
+        for(size_t n = 0; n < qs.size(); n++)
+        {
+            auto many = qs[n].read(1000 /* timeout: micro */);
+
+            for(auto it = many.begin(); it != many.end(); ++it)
+            {
+                while (!it.ready())
+                    std::this_thread::yield();
+
+                auto key = flow_key(static_cast<const char *>(it.data()), it->caplen);
+                if (key)
+                    flows[key] = n;
+            }
+        }
+    }
+
+    return flows;
+}
+
+
+static void
+run(const char *dev, int mode, size_t num, int weight, int seconds)
+{
+    std::vector<pfq::socket> qs;
+
+    qs.emplace_back(pfq::group_policy::shared, 128, 8192);
+
+    auto gid = qs.front().group_id();
+
+    for(size_t n = 1; n < num; n++)
+    {
+        qs.emplace_back(pfq::group_policy::undefined, 128, 8192);
+        qs.back().join_group(gid, pfq::group_policy::shared);
+    }
+
+    qs.front().weight(weight);
+    qs.front().set_group_steering(gid, mode);
+    qs.front().set_group_computation(gid, pfq::lang::ip >> steer_flow);
+    qs.front().bind(dev, pfq::any_queue);
+
+    for(auto &q : qs)
+        q.enable();
+
+    auto before = capture(qs, seconds);
+
+    std::vector<size_t> share(num);
+    for(auto const &f : before)
+        share[f.second]++;
+
+    std::cout << "    flows per socket:";
+    for(auto s : share)
+        std::cout << ' ' << s;
+    std::cout << std::endl;
+
+    /* the last socket leaves the group */
+
+    qs.pop_back();
+
+    auto after = capture(qs, seconds);
+
+    size_t total = 0, moved = 0;
+
+    for(auto const &f : after)
+    {
+        auto it = before.find(f.first);
+        if (it == before.end() || it->second == num - 1)
+            continue;
+
+        total++;
+        if (it->second != f.second)
+            moved++;
+    }
+
+    std::cout << "    flows moved: " << moved << '/' << total;
+    if (total)
+        std::cout << " (" << 100.0 * moved / total << "%)";
+    std::cout << std::endl;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2)
+        throw std::runtime_error(std::string("usage: ").append(argv[0]).append(" dev [num_sockets] [weight] [seconds]"));
+
+    size_t num  = argc > 2 ? std::stoul(argv[2]) : 4;
+    int weight  = argc > 3 ? std::stoi(argv[3]) : 1;
+    int seconds = argc > 4 ? std::stoi(argv[4]) : 5;
+
+    if (num < 2)
+        throw std::runtime_error("at least 2 sockets required");
+
+    std::cout << "fold steering:" << std::endl;
+    run(argv[1], Q_STEERING_FOLD, num, weight, seconds);
+
+    std::cout << "consistent steering:" << std::endl;
+    run(argv[1], Q_STEERING_CONSISTENT, num, weight, seconds);
+
+    return 0;
+}
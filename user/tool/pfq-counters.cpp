@@ -44,6 +44,7 @@ namespace opt
     size_t caplen  = 64;
     size_t slots   = 131072;
     bool flow      = false;
+    bool profile   = false;
 }
 
 
@@ -149,6 +150,12 @@ namespace thread
             return m_pfq.stats();
         }
 
+        std::vector<pfq_lang_node_stats>
+        lang_stats() const
+        {
+            return m_pfq.group_lang_stats(m_bind.gid);
+        }
+
         unsigned long long
         read() const
         {
@@ -195,6 +202,17 @@ bool any_strcmp(const char *arg, const char *opt, Ts&&...args)
 }
 
 
+void print_lang_stats(std::vector<pfq_lang_node_stats> const &ns)
+{
+    for(size_t n = 0; n < ns.size(); n++)
+    {
+        std::cout << "  node " << n << ": run " << ns[n].run << " drop " << ns[n].drop
+                  << " steer " << ns[n].steer << " cycles/run "
+                  << (ns[n].run ? ns[n].cycles / ns[n].run : 0) << std::endl;
+    }
+}
+
+
 void usage(std::string name)
 {
     throw std::runtime_error
@@ -204,6 +222,7 @@ void usage(std::string name)
         " -c --caplen INT               Set caplen\n"
         " -w --flow                     Enable flow counter\n"
         " -s --slot INT                 Set slots\n"
+        " -p --profile                  Display per-node counters (lang_profile)\n"
         "    --seconds INT              Terminate after INT seconds\n"
         " -f --function FUNCTION\n"
         " -t --thread BINDING\n\n"
@@ -269,6 +288,12 @@ try
             continue;
         }
 
+        if (any_strcmp(argv[i], "-p", "--profile"))
+        {
+            opt::profile = true;
+            continue;
+        }
+
         if (any_strcmp(argv[i], "-t", "--thread"))
         {
             if (++i == argc)
@@ -320,7 +345,7 @@ try
     });
 
     unsigned long long sum, flow, old = 0;
-    pfq_stats sum_stats, old_stats = {0,0,0,0,0,0,0};
+    pfq_stats sum_stats, old_stats = {0,0,0,0,0,0,0,0};
 
     std::cout << "----------- capture started ------------\n";
 
@@ -332,7 +357,7 @@ try
 
         sum = 0;
         flow = 0;
-        sum_stats = {0,0,0,0,0,0,0};
+        sum_stats = {0,0,0,0,0,0,0,0};
 
         std::for_each(thread_ctx.begin(), thread_ctx.end(), [&](const thread::context *c) {
             sum += c->read();
@@ -376,6 +401,9 @@ try
 
         std::cout << std::endl;
 
+        if (opt::profile && !opt::function.empty())
+            print_lang_stats(thread_ctx.front()->lang_stats());
+
         old = sum, begin = end;
         old_stats = sum_stats;
     }
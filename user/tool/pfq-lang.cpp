@@ -46,6 +46,7 @@ namespace opt
     size_t caplen = 64;
     size_t slots  = 131072;
     bool   flow   = false;
+    bool   profile = false;
 }
 
 
@@ -60,6 +61,17 @@ bool any_strcmp(const char *arg, const char *opt, Ts&&...args)
 }
 
 
+void print_lang_stats(std::vector<pfq_lang_node_stats> const &ns)
+{
+    for(size_t n = 0; n < ns.size(); n++)
+    {
+        std::cout << "  node " << n << ": run " << ns[n].run << " drop " << ns[n].drop
+                  << " steer " << ns[n].steer << " cycles/run "
+                  << (ns[n].run ? ns[n].cycles / ns[n].run : 0) << std::endl;
+    }
+}
+
+
 void usage(std::string name)
 {
     throw std::runtime_error
@@ -68,6 +80,7 @@ void usage(std::string name)
         " -h --help                     Display this help\n"
         " -c --caplen INT               Set caplen\n"
         " -s --slot INT                 Set slots\n"
+        " -p --profile                  Display per-node counters (lang_profile)\n"
         " -f --function FUNCTION\n"
         " -b --binding=BINDING\n\n"
         "      BINDING = " + pfq::binding_format + "\n" +
@@ -120,6 +133,12 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "-p", "--profile") )
+        {
+            opt::profile = true;
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "-b", "--binding") )
         {
             if (++i == argc)
@@ -192,7 +211,7 @@ try
         std::cout << "----------- capture started ------------\n";
 
         unsigned long long sum, old = 0;
-        pfq_stats sum_stats, old_stats = {0,0,0,0,0,0,0};
+        pfq_stats sum_stats, old_stats = {0,0,0,0,0,0,0,0};
 
         auto begin = std::chrono::system_clock::now();
 
@@ -201,7 +220,7 @@ try
             std::this_thread::sleep_for(std::chrono::seconds(1));
 
             sum = 0;
-            sum_stats = {0,0,0,0,0,0,0};
+            sum_stats = {0,0,0,0,0,0,0,0};
 
             sum       += read;
             sum_stats += q.stats();
@@ -216,6 +235,9 @@ try
                 (static_cast<int64_t>(sum-old)*1000000)/std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count()
             << vt100::RESET << " pkt/sec" << std::endl;
 
+            if (opt::profile)
+                print_lang_stats(q.group_lang_stats(bind.gid));
+
             old = sum, begin = end;
             old_stats = sum_stats;
         }